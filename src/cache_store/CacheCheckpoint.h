@@ -0,0 +1,107 @@
+// Binary checkpoints of a CacheStore (see CacheStoreBase::saveCheckpoint / restoreCheckpoint).
+//
+// File layout, all integers in host byte order:
+//  - CacheCheckpointHeader
+//  - the replacement policy's metadata (ReplacementPolicy::saveState), replacementBytes long
+//  - padding up to arraysOffset, a multiple of CACHE_CHECKPOINT_PAGE so the rest can be mmapped
+//  - the tags, state and data of all lines, laid out as CacheLineStorage::getArraysLayout says
+//  - for a sectored store, the {valid, dirty} sector masks of all lines, right after the arrays
+// A restore checks the magic, version and byte order, and that the file was written by a store of the same
+// geometry, index function, sector size and replacement policy. The replacement metadata and sector masks are small
+// and copied; the arrays are mapped.
+
+#ifndef CacheCheckpoint_H
+#define CacheCheckpoint_H
+
+#include <stdint.h>
+#include <string.h>     // memcmp, memcpy
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>      // open
+#include <unistd.h>     // pread, close
+
+static const char     CACHE_CHECKPOINT_MAGIC[8] = { 'C','A','C','H','E','C','K','P' };
+static const uint32_t CACHE_CHECKPOINT_VERSION  = 2;   // 2: sectorSize
+static const uint64_t CACHE_CHECKPOINT_BYTE_ORDER = 0x0102030405060708ULL;
+// Alignment of the mapped part of the file; a multiple of every host page size (4K, 16K, 64K).
+static const uint64_t CACHE_CHECKPOINT_PAGE = 65536;
+
+struct CacheCheckpointHeader
+{
+  char      magic[8];           // CACHE_CHECKPOINT_MAGIC
+  uint32_t  version;            // CACHE_CHECKPOINT_VERSION
+  uint32_t  headerBytes;        // sizeof(CacheCheckpointHeader)
+  uint64_t  byteOrder;          // CACHE_CHECKPOINT_BYTE_ORDER, as written by the saving host
+  // the store's configuration
+  uint64_t  memorySize;
+  uint64_t  cacheSize;
+  uint64_t  lineSize;
+  uint64_t  numWays;
+  uint32_t  replacementPolicy;  // ReplacementPolicy_t
+  uint32_t  indexHash;          // CacheIndexHash_t; 0 (IndexModulo) in files written before there was a choice
+  uint64_t  sectorSize;         // 0 if the lines are not sectored
+  // where things are
+  uint64_t  replacementBytes;   // right after the header
+  uint64_t  arraysOffset;       // tags, state and data
+  uint64_t  arraysBytes;
+
+  CacheCheckpointHeader() { memset( this, 0, sizeof(*this) ); }
+};
+
+// The checkpoint file a restore reads from; closed when this goes out of scope.
+class CacheCheckpointFile
+{
+public:
+  CacheCheckpointFile( const char* path )
+  : m_path( path )
+  , m_fd( open(path, O_RDONLY) )
+  {
+    if( m_fd < 0 ) throw std::runtime_error("CacheCheckpoint: cannot open " + m_path);
+  }
+  ~CacheCheckpointFile() { close(m_fd); }
+
+  int getFd() { return m_fd; }
+
+  // Exactly bytes bytes at offset, or throws.
+  void read( uint64_t offset, void* to, uint64_t bytes )
+  {
+    uint8_t* p = reinterpret_cast<uint8_t*>(to);
+    while( bytes > 0 ) {
+      ssize_t n = pread( m_fd, p, bytes, offset );
+      if( n <= 0 ) throw std::runtime_error("CacheCheckpoint: " + m_path + " is truncated or unreadable");
+      p += n;
+      offset += n;
+      bytes -= n;
+    }
+  }
+
+  void fail( const char* why )
+  {
+    throw std::runtime_error("CacheCheckpoint: " + m_path + ": " + why);
+  }
+
+private:
+  CacheCheckpointFile(const CacheCheckpointFile&);
+  CacheCheckpointFile& operator=(const CacheCheckpointFile&);
+
+  std::string m_path;
+  int         m_fd;
+};
+
+inline void writeCheckpointBytes( std::ofstream& os, const void* from, uint64_t bytes )
+{
+  os.write( reinterpret_cast<const char*>(from), bytes );
+}
+// Zeroes up to the given file offset.
+inline void padCheckpointTo( std::ofstream& os, uint64_t offset )
+{
+  static const char zeros[4096] = {0};
+  for( uint64_t pos = os.tellp(); pos < offset; ) {
+    uint64_t n = std::min( offset - pos, (uint64_t)sizeof(zeros) );
+    os.write( zeros, n );
+    pos += n;
+  }
+}
+
+#endif
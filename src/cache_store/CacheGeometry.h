@@ -0,0 +1,178 @@
+// Geometry of a cache: line size, ways per cache block, number of cache blocks, and the shifts and
+// masks derived from them that turn a memory address into (cacheBlockIndex, cacheTag, byteIndex).
+//
+// Two flavours with the same interface, used as the GEOMETRY parameter of CacheStoreBase:
+//  - CacheGeometry                          - runtime values, for configurations chosen at startup
+//  - FixedCacheGeometry<LineSize,Ways,Sets> - everything constexpr, so shifts/masks fold into the
+//                                             code and loops over the ways can be unrolled
+// All sizes are in bytes. The line size must be a power of 2; so must Sets for FixedCacheGeometry.
+//
+// The set (cacheBlockIndex) of a memory line is picked by an index function (see CacheIndexHash_t):
+//  - IndexModulo      - lineIndex mod numCacheBlocks; the low bits of the line index for a power of 2
+//  - IndexXorFold     - the line index cut into numCacheBlocks-sized chunks that are XORed together, so that
+//                       power-of-2 strides spread over the sets instead of all landing in a few
+//  - IndexPrimeModulo - lineIndex mod the largest prime <= numCacheBlocks; the sets above it are left unused
+// Only IndexModulo with a power-of-2 number of sets leaves the low bits of the line index out of the tag. Any
+// other geometry keeps the whole line index as the tag, so a tag identifies its line whatever the index function.
+// A modulo by a set count that is not a power of 2 is done with a multiply (see FastModulo), not a divide.
+
+#ifndef CacheGeometry_H
+#define CacheGeometry_H
+
+#include <stdint.h>
+#include <stdexcept>
+#include <sstream>
+
+#include "CacheLine.h"    // logbase2
+
+// constexpr log2 of a power of 2
+constexpr uint64_t constLog2( uint64_t num ) { return num <= 1 ? 0 : 1 + constLog2( num >> 1 ); }
+constexpr bool     constIsPow2( uint64_t num ) { return num != 0 && (num & (num - 1)) == 0; }
+
+// Bits needed to tell num values apart: the log2 of the next power of 2.
+inline unsigned int ceilLog2( uint64_t num )
+{
+  unsigned int bits = 0;
+  while( bits < 64 && (1ULL << bits) < num ) bits++;
+  return bits;
+}
+
+enum CacheIndexHash_t { IndexModulo, IndexXorFold, IndexPrimeModulo };
+
+// a mod d without a divide (Lemire, Kaser & Kurz, "Faster Remainder by Direct Computation"): with
+// M = floor((2^128-1) / d) + 1, a mod d is the high 128 bits of (M*a mod 2^128) * d. Exact for all 64-bit a, d > 0.
+struct FastModulo
+{
+  uint64_t    m_divisor;
+  __uint128_t m_multiplier;
+
+  FastModulo( uint64_t divisor=1 )
+  : m_divisor( divisor )
+  , m_multiplier( ~(__uint128_t)0 / divisor + 1 )
+  {}
+  uint64_t mod( uint64_t a ) const
+  {
+    __uint128_t low = m_multiplier * a;
+    __uint128_t bottom = ((__uint128_t)(uint64_t)low * m_divisor) >> 64;
+    __uint128_t top = (__uint128_t)(uint64_t)(low >> 64) * m_divisor;
+    return (uint64_t)((bottom + top) >> 64);
+  }
+};
+
+// The largest prime <= num; num itself if there is none (0, 1).
+inline uint64_t largestPrimeAtMost( uint64_t num )
+{
+  for( uint64_t candidate = num; candidate >= 2; candidate--) {
+    bool prime = true;
+    for( uint64_t dd = 2; dd * dd <= candidate && prime; dd++) prime = (candidate % dd) != 0;
+    if( prime ) return candidate;
+  }
+  return num;
+}
+
+struct CacheGeometry
+{
+  CacheGeometry( uint64_t lineSize, uint64_t numWays, uint64_t numCacheBlocks, CacheIndexHash_t indexHash=IndexModulo )
+  : m_lineSize( lineSize )
+  , m_numWays( numWays )
+  , m_numCacheBlocks( numCacheBlocks )
+  , m_indexHash( indexHash )
+  {
+    if( !constIsPow2(lineSize) || numWays == 0 || numCacheBlocks == 0 ) {
+      std::ostringstream oss;
+      oss << "CacheGeometry: lineSize=" << lineSize << " must be a power of 2, numWays=" << numWays
+          << " and numCacheBlocks=" << numCacheBlocks << " must not be 0";
+      throw std::runtime_error(oss.str());
+    }
+    // How many bits needed to address a line? (We will often shift these away and ignore.)
+    m_bitsForLine = logbase2( m_lineSize );
+
+    // Q: So how do you calculate which Cache Block a memory line maps to? I.e., what is the hash function?
+    // A: by default you use the lowest N bits of the memory address (actually memory line index).
+    // Calculate how many bits are needed to distnguish NUM_BLOCKS blocks.
+    m_cacheBlockIndexBits = ceilLog2( m_numCacheBlocks );
+    m_cacheBlockIndexMask = (1ULL << m_cacheBlockIndexBits) - 1; // i.e. 10 1's or 1111111111
+    m_lowBitsIndex = ( indexHash == IndexModulo && constIsPow2(m_numCacheBlocks) );
+    m_modulo = FastModulo( indexHash == IndexPrimeModulo ? largestPrimeAtMost(m_numCacheBlocks) : m_numCacheBlocks );
+
+    // While the lowest bits index inside a Line and the next N bits are needed to determine the cacheBlock,
+    // the rest of the bits (highest) are used as a tag to distinguish which memoryLine is actually cached.
+    // To get the highest N bits for the cacheTag, we will just shift the memoryAddress by m_bitShiftForCacheTag.
+    // With any other index function the whole line index is the tag.
+    m_bitShiftForCacheTag = m_lowBitsIndex ? m_cacheBlockIndexBits + m_bitsForLine : m_bitsForLine;
+  }
+
+  uint64_t lineSize()             const { return m_lineSize; }
+  uint64_t numWays()              const { return m_numWays; }
+  uint64_t numCacheBlocks()       const { return m_numCacheBlocks; }
+  CacheIndexHash_t indexHash()    const { return m_indexHash; }
+  uint64_t bitsForLine()          const { return m_bitsForLine; }
+  uint64_t cacheBlockIndexMask()  const { return m_cacheBlockIndexMask; }
+  uint64_t bitShiftForCacheTag()  const { return m_bitShiftForCacheTag; }
+
+  // The set of a memory line (memoryAddress >> bitsForLine).
+  uint64_t cacheBlockIndex( uint64_t memoryLineIndex ) const
+  {
+    if( m_lowBitsIndex ) return memoryLineIndex & m_cacheBlockIndexMask;
+    if( m_indexHash == IndexXorFold && m_cacheBlockIndexBits > 0 ) {
+      uint64_t folded = 0;
+      for( uint64_t rest = memoryLineIndex; rest != 0; rest >>= m_cacheBlockIndexBits) folded ^= rest & m_cacheBlockIndexMask;
+      return folded < m_numCacheBlocks ? folded : m_modulo.mod( folded );
+    }
+    return m_modulo.mod( memoryLineIndex );
+  }
+  // The inverse of cacheBlockIndex and the tag: the memory line a set holds under a tag.
+  uint64_t memoryLineIndex( uint64_t cacheTag, uint64_t cacheBlockIndex ) const
+  {
+    if( !m_lowBitsIndex ) return cacheTag;
+    return (cacheTag << m_cacheBlockIndexBits) | cacheBlockIndex;
+  }
+
+protected:
+  uint64_t m_lineSize;
+  uint64_t m_numWays;
+  uint64_t m_numCacheBlocks;
+  CacheIndexHash_t m_indexHash;
+  uint64_t m_bitsForLine;
+  uint64_t m_cacheBlockIndexBits;
+  uint64_t m_cacheBlockIndexMask;
+  uint64_t m_bitShiftForCacheTag;
+  bool     m_lowBitsIndex;        // IndexModulo by a power of 2: the set is the low bits of the line index
+  FastModulo m_modulo;            // by numCacheBlocks, or by the prime for IndexPrimeModulo
+};
+
+template <uint64_t LineSize, uint64_t Ways, uint64_t Sets>
+struct FixedCacheGeometry
+{
+  static_assert( constIsPow2(LineSize), "FixedCacheGeometry: LineSize must be a power of 2" );
+  static_assert( Ways >= 1,             "FixedCacheGeometry: Ways must be at least 1" );
+  static_assert( constIsPow2(Sets),     "FixedCacheGeometry: Sets must be a power of 2" );
+
+  // Takes the same arguments as CacheGeometry, only to check that they agree with the template parameters.
+  // Always indexes by the low bits of the line index (IndexModulo).
+  FixedCacheGeometry( uint64_t lineSize, uint64_t numWays, uint64_t numCacheBlocks, CacheIndexHash_t indexHash=IndexModulo )
+  {
+    if( lineSize != LineSize || numWays != Ways || numCacheBlocks != Sets || indexHash != IndexModulo ) {
+      std::ostringstream oss;
+      oss << "FixedCacheGeometry<" << LineSize << "," << Ways << "," << Sets << "> constructed with lineSize="
+          << lineSize << " numWays=" << numWays << " numCacheBlocks=" << numCacheBlocks << " indexHash=" << indexHash;
+      throw std::runtime_error(oss.str());
+    }
+  }
+
+  static constexpr uint64_t lineSize()             { return LineSize; }
+  static constexpr uint64_t numWays()              { return Ways; }
+  static constexpr uint64_t numCacheBlocks()       { return Sets; }
+  static constexpr uint64_t bitsForLine()          { return constLog2(LineSize); }
+  static constexpr uint64_t cacheBlockIndexMask()  { return Sets - 1; }
+  static constexpr uint64_t bitShiftForCacheTag()  { return constLog2(Sets) + constLog2(LineSize); }
+  static constexpr CacheIndexHash_t indexHash()    { return IndexModulo; }
+
+  static constexpr uint64_t cacheBlockIndex( uint64_t memoryLineIndex ) { return memoryLineIndex & (Sets - 1); }
+  static constexpr uint64_t memoryLineIndex( uint64_t cacheTag, uint64_t cacheBlockIndex )
+  {
+    return (cacheTag << constLog2(Sets)) | cacheBlockIndex;
+  }
+};
+
+#endif
@@ -9,6 +9,9 @@
 
 #include <math.h>       // pow
 #include <limits.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <algorithm>    // min
 
 unsigned int logbase2 (unsigned int num) {
   unsigned int retVal = 0;
@@ -25,47 +28,204 @@ unsigned int logbase2 (unsigned int num) {
 // Size (B) of a Cache Line and of a cacheable chunk of memory. The LineSize has to be a power of 2.
 enum CacheLineSize_t {LineSize2=2, LineSize4=4 , LineSize8=8 , LineSize16=16 , LineSize32=32, LineSize64=64, LineSize128=128, LineSize256=256, LineSize512=512, LineSize1024=1024 };
 
+// Flags kept in the packed per-line state array (one byte per line).
+// LinePrefetched marks a line a prefetcher brought in that no demand access has used yet.
+// LineExclusive marks a line of a coherent cache that no other cache holds a copy of (see RealCacheT::setCoherent).
+enum CacheLineState_t { LineValid = 0x01, LineDirty = 0x02, LinePrefetched = 0x04, LineExclusive = 0x08 };
+
+// MESI state of a line of a coherent cache, derived from its flags: a dirty line is Modified (and always exclusive),
+// a clean exclusive one Exclusive, any other valid one Shared.
+enum CoherenceState_t { CoherenceInvalid, CoherenceShared, CoherenceExclusive, CoherenceModified };
+
+// A sectored line (see CacheStoreBase::setSectorSize) also has a valid and a dirty bit per sector, bit ii for
+// sector ii. A line that is not sectored counts as a single sector, sector 0.
+
+// A CacheLine is a view onto a tag, a state byte and a line of data.
+// A standalone CacheLine (default ctor) points these at its own members and allocates its data lazily
+// in load(), as it always has. A CacheLine handed out by a CacheStore is instead bound into the store's
+// CacheLineStorage arrays, so the store can probe tags without touching the CacheLine objects at all.
+// Copying/assigning a CacheLine copies the line contents (tag, state and data), not the binding.
 class CacheLine
 {
-  static const uint64_t EMPTY = 0-1;
+public:
+  static const uint64_t EMPTY = 0-1;    // a maxint that can never be the value of a real cache tag
 protected:
-  bool                isValid;
-  uint64_t		        tag;
+  uint64_t*           m_tag;
+  uint8_t*            m_state;
   uint32_t*           data;
+  uint32_t            m_numWords;       // capacity of data, in words
+  bool                m_ownsData;
+  uint64_t            m_ownTag;         // storage used by a standalone CacheLine
+  uint8_t             m_ownState;
+  uint64_t*           m_sectors;        // {valid, dirty} sector masks of a sectored line, or NULL
+  uint64_t            m_allSectors;     // the mask of all of its sectors
 public:
   CacheLine()
-  : isValid(false)
-  , tag(CacheLine::EMPTY)  // a maxint that can never be the value of a real cache tag
+  : m_tag(&m_ownTag)
+  , m_state(&m_ownState)
   , data(0)
+  , m_numWords(0)
+  , m_ownsData(false)
+  , m_ownTag(CacheLine::EMPTY)
+  , m_ownState(0)
+  , m_sectors(NULL)
+  , m_allSectors(1)
   {}
 
-  void load(uint64_t _tag, const uint32_t* line, CacheLineSize_t lineSize) {
-    if( data == NULL ) {
-      data = new uint32_t[lineSize];
+  CacheLine(const CacheLine& cl)
+  : m_tag(&m_ownTag)
+  , m_state(&m_ownState)
+  , data(0)
+  , m_numWords(0)
+  , m_ownsData(false)
+  , m_ownTag(CacheLine::EMPTY)
+  , m_ownState(0)
+  , m_sectors(NULL)
+  , m_allSectors(1)
+  {
+    *this = cl;
+  }
+
+  ~CacheLine() {
+    if( m_ownsData ) delete[] data;
+  }
+
+  CacheLine& operator=(const CacheLine& cl) {
+    if( this == &cl ) return *this;
+    if( data == NULL && cl.data != NULL ) allocate(cl.m_numWords);
+    uint32_t numWords = std::min(m_numWords, cl.m_numWords);
+    for( uint32_t ii=0; ii < numWords; ii++) { data[ii]=cl.data[ii];}
+    *m_tag = *cl.m_tag;
+    *m_state = *cl.m_state;
+    if( m_sectors != NULL && cl.m_sectors != NULL ) {
+      m_sectors[0] = cl.m_sectors[0];
+      m_sectors[1] = cl.m_sectors[1];
     }
-    for( int ii=0; ii < lineSize; ii++) { data[ii]=line[ii];}
-    tag = _tag;
-    isValid = true;
+    return *this;
+  }
+
+  // Point this line at externally owned tag/state/data slots (see CacheLineStorage).
+  void bind(uint64_t* _tag, uint8_t* _state, uint32_t* _data, uint32_t numWords) {
+    if( m_ownsData ) delete[] data;
+    m_ownsData = false;
+    m_tag = _tag;
+    m_state = _state;
+    data = _data;
+    m_numWords = numWords;
+  }
+  // Point this line at externally owned sector masks, or at none (NULL, a single sector).
+  void bindSectors(uint64_t* _sectors, uint64_t allSectors) {
+    m_sectors = _sectors;
+    m_allSectors = _sectors ? allSectors : 1;
   }
 
+  // Copies lineSize words into the line. A bound line never copies past the end of its slot.
+  void load(uint64_t _tag, const uint32_t* line, CacheLineSize_t lineSize) {
+    if( data == NULL ) allocate(lineSize);
+    uint32_t numWords = std::min((uint32_t)lineSize, m_numWords);
+    for( uint32_t ii=0; ii < numWords; ii++) { data[ii]=line[ii];}
+    *m_tag = _tag;
+    setValid(true);
+  }
+
+  // Making a line valid makes all of its sectors valid.
   void setValid(bool _valid) {
-    isValid = _valid;
+    if( _valid ) *m_state |= LineValid;
+    else         *m_state &= ~LineValid;
+    if( _valid && m_sectors ) m_sectors[0] = m_allSectors;
   }
 
   bool getValid() {
-    return isValid;
+    return (*m_state & LineValid) != 0;
+  }
+
+  // Dirty: the line holds data that memory does not have yet. Marking a line dirty marks all its valid sectors dirty.
+  void setDirty(bool _dirty) {
+    if( _dirty ) *m_state |= LineDirty;
+    else         *m_state &= ~LineDirty;
+    if( m_sectors ) m_sectors[1] = _dirty ? m_sectors[0] : 0;
+  }
+
+  bool getDirty() {
+    return (*m_state & LineDirty) != 0;
+  }
+
+  void setPrefetched(bool _prefetched) {
+    if( _prefetched ) *m_state |= LinePrefetched;
+    else              *m_state &= ~LinePrefetched;
+  }
+
+  bool getPrefetched() {
+    return (*m_state & LinePrefetched) != 0;
+  }
+
+  void setExclusive(bool _exclusive) {
+    if( _exclusive ) *m_state |= LineExclusive;
+    else             *m_state &= ~LineExclusive;
+  }
+
+  bool getExclusive() {
+    return (*m_state & LineExclusive) != 0;
+  }
+
+  CoherenceState_t getCoherenceState() {
+    if( !getValid() )    return CoherenceInvalid;
+    if( getDirty() )     return CoherenceModified;
+    if( getExclusive() ) return CoherenceExclusive;
+    return CoherenceShared;
+  }
+
+  // Forget all state flags (valid, dirty, prefetched, exclusive); the tag is left alone.
+  void clearState() {
+    *m_state = 0;
+    if( m_sectors ) m_sectors[0] = m_sectors[1] = 0;
+  }
+
+  // Sectors
+  //  - getValidSectors() / getDirtySectors() - masks of the sectors holding data / data memory does not have yet
+  //  - isWhole() - are all sectors valid?
+  //  - setValidSectors(mask) - e.g. 0 for a line allocated by a write that is going to fill only some sectors
+  //  - markSectorsDirty(mask) - after a write into these sectors; they become valid and dirty, so any of them that was
+  //    not valid before must have been written whole
+  // A line that is not sectored only has sector 0: setValidSectors(0) makes it invalid.
+  uint64_t getValidSectors() {
+    if( !getValid() ) return 0;
+    return m_sectors ? m_sectors[0] : 1;
+  }
+  uint64_t getDirtySectors() {
+    if( !getDirty() ) return 0;
+    return m_sectors ? m_sectors[1] : 1;
+  }
+  bool isWhole() {
+    return getValidSectors() == m_allSectors;
+  }
+  void setValidSectors(uint64_t mask) {
+    if( m_sectors ) m_sectors[0] = mask;
+    else            setValid(mask != 0);
+  }
+  void markSectorsDirty(uint64_t mask) {
+    if( m_sectors ) {
+      if( !getDirty() ) m_sectors[1] = 0;
+      m_sectors[0] |= mask;
+      m_sectors[1] |= mask;
+    }
+    *m_state |= LineValid | LineDirty;
   }
 
   void setEmpty() {
-    tag = CacheLine::EMPTY;
+    *m_tag = CacheLine::EMPTY;
   }
 
   bool getEmpty() {
-    return (tag == CacheLine::EMPTY);
+    return (*m_tag == CacheLine::EMPTY);
+  }
+
+  void setTag(uint64_t _tag) {
+    *m_tag = _tag;
   }
 
   uint64_t getTag() {
-    return tag;
+    return *m_tag;
   }
 
   uint32_t* getData(unsigned int index) {
@@ -75,7 +235,41 @@ public:
   }
 
   void invalidate() {
-    isValid = false;
+    setValid(false);
   }
+
+protected:
+  void allocate(uint32_t numWords) {
+    data = new uint32_t[numWords]();
+    m_numWords = numWords;
+    m_ownsData = true;
+  }
+};
+
+// A line borrowed from a CacheStore without copying it: data points straight into the store.
+// Returned by CacheStore::accessLine / allocateLine. Only valid until the next call that can
+// fill or evict a line of the same store.
+struct CacheLineRef
+{
+  bool        hit;      // was the line already in the cache?
+  CacheLine*  line;     // NULL if the line is not in the cache
+  uint32_t*   data;     // the words of the line, NULL if the line is not in the cache
+
+  CacheLineRef()
+  : hit(false), line(NULL), data(NULL)
+  {}
+  CacheLineRef(CacheLine* _line, bool _hit)
+  : hit(_hit), line(_line), data(_line ? _line->getData(0) : NULL)
+  {}
+  CacheLineRef(CacheLine* _line, uint32_t* _data, bool _hit)
+  : hit(_hit), line(_line), data(_data)
+  {}
+
+  bool      isHit()     { return hit; }
+  uint8_t*  bytes()     { return reinterpret_cast<uint8_t*>(data); }
+  // Call after writing through data/bytes() so the line gets written back eventually.
+  void      markDirty() { line->setDirty(true); }
+  // The same for a sectored line, naming the sectors written (see CacheStoreBase::getSectorMask).
+  void      markDirty( uint64_t sectors ) { line->markSectorsDirty(sectors); }
 };
 #endif
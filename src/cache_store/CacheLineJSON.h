@@ -6,6 +6,7 @@
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include <iostream>
+#include <vector>
 using namespace rapidjson;
 
 class CacheLineJSON : public CacheLine
@@ -18,22 +19,14 @@ public:
     Document d;
     d.Parse(json);
     this->lineSize =    (CacheLineSize_t) d["lineSize"].GetInt();
-    this->isValid =     (bool)    d["isValid"].GetBool();
-    this->tag =         (uint64_t)d["tag"].GetInt();
     const Value& aData = d["data"]; // Using a reference for consecutive access is handy and faster.
     assert(aData.IsArray());
-    this->data =  new uint32_t[this->lineSize](); //  the () inits all to 0
+    std::vector<uint32_t> line(this->lineSize, 0); // inits all to 0
     for (SizeType ii = 0; ii < aData.Size(); ii++) { // rapidjson type 'SizeType'
-      this->data[ii] = aData[ii].GetInt();
+      line[ii] = aData[ii].GetInt();
     }
-  }
-  // This assignment operator is only here for purposes of mocking/testing.
-  CacheLineJSON& operator=(const CacheLineJSON & cl) {
-    isValid = cl.isValid;
-    tag = cl.tag;
-    data = cl.data;
-    lineSize = cl.lineSize;
-    return *this;
+    this->load( (uint64_t)d["tag"].GetInt(), &line[0], this->lineSize );
+    this->setValid( (bool)d["isValid"].GetBool() );
   }
   bool dump() {
     for (int jj = 0; jj < this->lineSize; jj++) { // rapidjson type 'SizeType'
@@ -0,0 +1,172 @@
+// Contiguous structure-of-arrays backing store for all the lines of a CacheStore.
+//
+// Everything lives in ONE allocation, carved up (each part 64B aligned) as:
+//  - the CacheLine views handed out by the CacheStore API, one per line
+//  - the tags of all lines. Lines are numbered cacheBlockIndex*numWays + way, so the tags of a
+//    cache block (set) are adjacent and a 16-way probe reads 128 consecutive bytes.
+//  - the state flags of all lines, packed one byte per line (see CacheLineState_t)
+//  - the data of all lines, one slab indexed by line number.
+// The views are only touched once a lookup has already found its line in the tag array.
+// Sectored lines (setNumSectors) also get a valid and a dirty sector mask each, in a separate array.
+//
+// A checkpoint restore can swap the tags, state and data for a private mapping of a checkpoint file
+// (mapArrays); the views stay where they are.
+
+#ifndef CacheLineStorage_H
+#define CacheLineStorage_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>          // placement new
+#include <algorithm>    // fill
+#include <vector>
+#include <sys/mman.h>   // mmap, madvise
+#include <unistd.h>     // sysconf
+
+#include "CacheLine.h"
+
+class CacheLineStorage
+{
+public:
+  static const size_t ALIGNMENT = 64;   // bytes; one host cache line
+
+  CacheLineStorage(uint64_t numLines, uint64_t lineSize)
+  : m_numLines(numLines)
+  , m_numWordsPerLine( (lineSize + sizeof(uint32_t) - 1) / sizeof(uint32_t) )
+  , m_mapping( NULL )
+  , m_mappingBytes( 0 )
+  , m_numSectors( 1 )
+  {
+    size_t linesBytes = alignUp( m_numLines * sizeof(CacheLine) );
+    size_t tagsBytes  = alignUp( m_numLines * sizeof(uint64_t) );
+    size_t stateBytes = alignUp( m_numLines * sizeof(uint8_t) );
+    size_t dataBytes  = alignUp( m_numLines * m_numWordsPerLine * sizeof(uint32_t) );
+
+    // One allocation for everything. Over-allocate so the base can be aligned by hand.
+    m_raw = new uint8_t[linesBytes + tagsBytes + stateBytes + dataBytes + ALIGNMENT];
+    uint8_t* base = reinterpret_cast<uint8_t*>( alignUp( reinterpret_cast<size_t>(m_raw) ) );
+
+    m_lines = reinterpret_cast<CacheLine*>( base );
+    m_tags  = reinterpret_cast<uint64_t*>(  base + linesBytes );
+    m_state = reinterpret_cast<uint8_t*>(   base + linesBytes + tagsBytes );
+    m_data  = reinterpret_cast<uint32_t*>(  base + linesBytes + tagsBytes + stateBytes );
+
+    for( uint64_t ii = 0; ii < m_numLines; ii++) {
+      m_tags[ii]  = CacheLine::EMPTY;
+      m_state[ii] = 0;
+    }
+    std::fill( m_data, m_data + m_numLines * m_numWordsPerLine, 0 );
+    for( uint64_t ii = 0; ii < m_numLines; ii++) {
+      CacheLine* cl = new (&m_lines[ii]) CacheLine();
+      cl->bind( &m_tags[ii], &m_state[ii], getData(ii), m_numWordsPerLine );
+    }
+  }
+
+  ~CacheLineStorage()
+  {
+    for( uint64_t ii = 0; ii < m_numLines; ii++) m_lines[ii].~CacheLine();
+    delete[] m_raw;
+    if( m_mapping != NULL ) munmap( m_mapping, m_mappingBytes );
+  }
+
+  // How the tags, state and data arrays are laid out in a checkpoint: tags at offset 0, then state and data,
+  // each 64B aligned.
+  struct ArraysLayout
+  {
+    uint64_t stateOffset;
+    uint64_t dataOffset;
+    uint64_t bytes;
+  };
+  ArraysLayout getArraysLayout()
+  {
+    ArraysLayout layout;
+    layout.stateOffset = alignUp( m_numLines * sizeof(uint64_t) );
+    layout.dataOffset  = layout.stateOffset + alignUp( m_numLines * sizeof(uint8_t) );
+    layout.bytes       = layout.dataOffset + alignUp( m_numLines * m_numWordsPerLine * sizeof(uint32_t) );
+    return layout;
+  }
+
+  // Use getArraysLayout().bytes of the file fd, from fileOffset (a multiple of the page size) on, as the tags,
+  // state and data. The mapping is private: lines written from now on are copied on write and never reach the
+  // file. The views are rebound to it, and the memory of the arrays they used before is handed back to the OS.
+  // Returns false, leaving the storage as it was, if the file cannot be mapped.
+  bool mapArrays( int fd, uint64_t fileOffset )
+  {
+    ArraysLayout layout = getArraysLayout();
+    void* mapping = mmap( NULL, layout.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, fileOffset );
+    if( mapping == MAP_FAILED ) return false;
+    uint8_t* base = reinterpret_cast<uint8_t*>( mapping );
+
+    uint8_t* oldArrays = reinterpret_cast<uint8_t*>( m_tags );
+    m_tags  = reinterpret_cast<uint64_t*>( base );
+    m_state = reinterpret_cast<uint8_t*>(  base + layout.stateOffset );
+    m_data  = reinterpret_cast<uint32_t*>( base + layout.dataOffset );
+    for( uint64_t ii = 0; ii < m_numLines; ii++) {
+      m_lines[ii].bind( &m_tags[ii], &m_state[ii], getData(ii), m_numWordsPerLine );
+    }
+    if( m_mapping != NULL ) {
+      munmap( m_mapping, m_mappingBytes );
+    } else {
+      // The old arrays share m_raw with the views, so only their whole pages can be given back.
+      size_t page = sysconf( _SC_PAGESIZE );
+      size_t from = (reinterpret_cast<size_t>(oldArrays) + page - 1) & ~(page - 1);
+      size_t to   = (reinterpret_cast<size_t>(oldArrays) + layout.bytes) & ~(page - 1);
+      if( to > from ) madvise( reinterpret_cast<void*>(from), to - from, MADV_DONTNEED );
+    }
+    m_mapping = mapping;
+    m_mappingBytes = layout.bytes;
+    return true;
+  }
+  bool isMapped()             { return m_mapping != NULL; }
+
+  // Split every line into numSectors sectors (at most 64), or with 1 stop doing so. Valid lines start out whole,
+  // dirty ones with all their sectors dirty.
+  void setNumSectors( uint32_t numSectors )
+  {
+    m_numSectors = numSectors;
+    if( numSectors <= 1 ) {
+      std::vector<uint64_t>().swap( m_sectors );
+      for( uint64_t ii = 0; ii < m_numLines; ii++) m_lines[ii].bindSectors( NULL, 1 );
+      return;
+    }
+    uint64_t allSectors = numSectors == 64 ? ~0ULL : (1ULL << numSectors) - 1;
+    m_sectors.assign( 2 * m_numLines, 0 );
+    for( uint64_t ii = 0; ii < m_numLines; ii++) {
+      if( m_state[ii] & LineValid ) m_sectors[2 * ii] = allSectors;
+      if( m_state[ii] & LineDirty ) m_sectors[2 * ii + 1] = allSectors;
+      m_lines[ii].bindSectors( &m_sectors[2 * ii], allSectors );
+    }
+  }
+  uint32_t    getNumSectors()         { return m_numSectors; }
+  // {valid, dirty} masks of a sectored line; those of all lines are adjacent
+  uint64_t*   getSectors( uint64_t lineIndex )  { return &m_sectors[2 * lineIndex]; }
+
+  uint64_t    getNumLines()           { return m_numLines; }
+  uint32_t    getNumWordsPerLine()    { return m_numWordsPerLine; }
+
+  CacheLine*  getLines()                      { return m_lines; }
+  uint64_t*   getTags( uint64_t lineIndex )   { return &m_tags[lineIndex]; }
+  uint8_t*    getState( uint64_t lineIndex )  { return &m_state[lineIndex]; }
+  uint32_t*   getData( uint64_t lineIndex )   { return &m_data[lineIndex * m_numWordsPerLine]; }
+
+private:
+  // Not copyable: the views point into this object's allocation.
+  CacheLineStorage(const CacheLineStorage&);
+  CacheLineStorage& operator=(const CacheLineStorage&);
+
+  static size_t alignUp( size_t n ) { return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+  uint64_t    m_numLines;
+  uint32_t    m_numWordsPerLine;
+  uint8_t*    m_raw;
+  CacheLine*  m_lines;
+  uint64_t*   m_tags;
+  uint8_t*    m_state;
+  uint32_t*   m_data;
+  void*       m_mapping;        // the checkpoint mapping holding tags, state and data, or NULL
+  size_t      m_mappingBytes;
+  uint32_t    m_numSectors;
+  std::vector<uint64_t> m_sectors;  // {valid, dirty} per line, if sectored
+};
+
+#endif
@@ -0,0 +1,59 @@
+// Command-line values of the cache tools (cachesim, and tlm2freesampler when it simulates one configuration).
+// All of them throw std::runtime_error on a value they do not know.
+//  - parseSize      - bytes or a count, k/m/g suffixes allowed: 32k, 1m, 0x40
+//  - parsePolicy    - lru, plru, fifo or random (see ReplacementPolicy.h)
+//  - parseIndexHash - mod, xor or prime (see CacheGeometry.h)
+//  - parsePrefetcher - none, nextline, stride or stream (see Prefetcher.h)
+
+#ifndef CacheOptions_H
+#define CacheOptions_H
+
+#include <stdint.h>
+#include <stdlib.h>     // strtoull
+#include <string>
+#include <stdexcept>
+
+#include "CacheGeometry.h"
+#include "ReplacementPolicy.h"
+#include "Prefetcher.h"
+
+inline uint64_t parseSize( const char* arg )
+{
+  char* end;
+  uint64_t value = strtoull( arg, &end, 0 );
+  switch( *end ) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+  }
+  if( end == arg || *end != '\0' ) throw std::runtime_error(std::string("bad size ") + arg);
+  return value;
+}
+
+inline ReplacementPolicy_t parsePolicy( const std::string& arg )
+{
+  if( arg == "lru" )    return ReplLRU;
+  if( arg == "plru" )   return ReplTreePLRU;
+  if( arg == "fifo" )   return ReplFIFO;
+  if( arg == "random" ) return ReplRandom;
+  throw std::runtime_error("unknown replacement policy " + arg);
+}
+
+inline CacheIndexHash_t parseIndexHash( const std::string& arg )
+{
+  if( arg == "mod" )    return IndexModulo;
+  if( arg == "xor" )    return IndexXorFold;
+  if( arg == "prime" )  return IndexPrimeModulo;
+  throw std::runtime_error("unknown index function " + arg);
+}
+
+inline Prefetcher_t parsePrefetcher( const std::string& arg )
+{
+  if( arg == "none" )     return PrefetchNone;
+  if( arg == "nextline" ) return PrefetchNextLine;
+  if( arg == "stride" )   return PrefetchStride;
+  if( arg == "stream" )   return PrefetchStream;
+  throw std::runtime_error("unknown prefetcher " + arg);
+}
+
+#endif
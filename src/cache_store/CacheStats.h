@@ -0,0 +1,211 @@
+// Statistics counters for the cache models. All plain integers bumped on the hot path; nothing is locked or
+// formatted until someone asks for them.
+//  - CacheStoreStats  - kept by a CacheStore: tag lookups and hits, fills, evictions
+//  - CacheAccessStats - kept by a cache model such as RealCache: read/write hits and misses, write-backs
+//  - PrefetchStats    - kept by a cache model with a prefetcher: issued, useful and late prefetches, pollution
+//  - MSHRStats        - kept by the MSHRs of a cache model: primary and secondary misses, stalls
+//  - CoherenceStats   - kept by a coherent cache model: upgrades, lines snoops took away, coherence misses
+//  - SnoopBusStats    - kept by a snoop bus between coherent caches: requests, snoops, cache-to-cache transfers
+//  - PageTLBStats     - kept by the translation cache of a memory model: lookups and hits, invalidations
+// Per-set access and conflict counters, for a set-pressure heatmap, are kept by the CacheStore itself
+// (see CacheStoreBase::enableSetStats).
+
+#ifndef CacheStats_H
+#define CacheStats_H
+
+#include <stdint.h>
+#include <stdlib.h>     // posix_memalign, free
+#include <stddef.h>
+#include <new>          // bad_alloc
+#include <ostream>
+
+// Aligned to a host cache line: a ShardedCacheStore keeps one per shard, and they must not false-share. Keep them in
+// a container that honours the alignment, e.g. a std::vector with a CacheLineAllocator (see below).
+struct alignas(64) CacheStoreStats
+{
+  uint64_t lookups;           // tag lookups: getCacheLine, get/setDataLine, accessLine, allocateLine, lookupMany
+  uint64_t hits;              // lookups that found a valid line
+  uint64_t fills;             // lines allocated by newCacheLine
+  uint64_t evictions;         // valid lines evicted to make room for a fill
+  uint64_t dirtyEvictions;    // evictions of dirty lines
+  uint64_t flushedLines;      // dirty lines handed over by flush()
+  uint64_t unusedPrefetches;  // evictions of prefetched lines no demand access had used
+
+  CacheStoreStats() { reset(); }
+
+  void      reset()       { lookups = hits = fills = evictions = dirtyEvictions = flushedLines = unusedPrefetches = 0; }
+  uint64_t  misses()      { return lookups - hits; }
+  double    hitRate()     { return lookups ? (double)hits / lookups : 0.0; }
+
+  CacheStoreStats& operator+=( const CacheStoreStats& other )
+  {
+    lookups += other.lookups;
+    hits += other.hits;
+    fills += other.fills;
+    evictions += other.evictions;
+    dirtyEvictions += other.dirtyEvictions;
+    flushedLines += other.flushedLines;
+    unusedPrefetches += other.unusedPrefetches;
+    return *this;
+  }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": lookups=" << lookups << " hits=" << hits << " misses=" << misses()
+       << " hitRate=" << hitRate() << " fills=" << fills << " evictions=" << evictions
+       << " dirtyEvictions=" << dirtyEvictions << " flushedLines=" << flushedLines
+       << " unusedPrefetches=" << unusedPrefetches << std::endl;
+  }
+};
+static_assert( sizeof(CacheStoreStats) % 64 == 0, "CacheStoreStats must fill whole host cache lines" );
+
+// Allocator for containers of host-line aligned types such as CacheStoreStats: before C++17, the default one
+// only aligns to alignof(max_align_t), whatever the alignas of the type.
+template <class T>
+struct CacheLineAllocator
+{
+  typedef T value_type;
+
+  CacheLineAllocator() {}
+  template <class U> CacheLineAllocator( const CacheLineAllocator<U>& ) {}
+
+  T* allocate( size_t n )
+  {
+    void* p = NULL;
+    size_t alignment = alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+    if( posix_memalign(&p, alignment, n * sizeof(T)) != 0 ) throw std::bad_alloc();
+    return static_cast<T*>( p );
+  }
+  void deallocate( T* p, size_t ) { free( p ); }
+};
+template <class T, class U> bool operator==( const CacheLineAllocator<T>&, const CacheLineAllocator<U>& ) { return true; }
+template <class T, class U> bool operator!=( const CacheLineAllocator<T>&, const CacheLineAllocator<U>& ) { return false; }
+
+struct CacheAccessStats
+{
+  uint64_t readHits;
+  uint64_t readMisses;
+  uint64_t writeHits;
+  uint64_t writeMisses;
+  uint64_t writeBacks;          // lines written to the next level / memory
+  uint64_t backInvalidations;   // lines dropped because a level below evicted them
+  uint64_t sectorMisses;        // misses on a cached line that lacked sectors the access needed (see setSectorSize)
+
+  CacheAccessStats() { reset(); }
+
+  void      reset()       { readHits = readMisses = writeHits = writeMisses = writeBacks = backInvalidations = sectorMisses = 0; }
+  uint64_t  hits()        { return readHits + writeHits; }
+  uint64_t  misses()      { return readMisses + writeMisses; }
+  uint64_t  accesses()    { return hits() + misses(); }
+  double    hitRate()     { return accesses() ? (double)hits() / accesses() : 0.0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": accesses=" << accesses() << " hitRate=" << hitRate()
+       << " readHits=" << readHits << " readMisses=" << readMisses
+       << " writeHits=" << writeHits << " writeMisses=" << writeMisses
+       << " writeBacks=" << writeBacks << " backInvalidations=" << backInvalidations
+       << " sectorMisses=" << sectorMisses << std::endl;
+  }
+};
+
+struct PrefetchStats
+{
+  uint64_t issued;      // lines filled by the prefetcher
+  uint64_t useful;      // prefetched lines that a demand access then hit
+  uint64_t late;        // useful prefetches whose data was not back yet when the demand access came
+  uint64_t dropped;     // candidates not fetched: already cached, outside memory, or no MSHR free
+  uint64_t pollution;   // demand misses on lines that a prefetch fill had evicted
+
+  PrefetchStats() { reset(); }
+
+  void      reset()       { issued = useful = late = dropped = pollution = 0; }
+  double    accuracy()    { return issued ? (double)useful / issued : 0.0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": issued=" << issued << " useful=" << useful << " accuracy=" << accuracy()
+       << " late=" << late << " dropped=" << dropped << " pollution=" << pollution << std::endl;
+  }
+};
+
+struct MSHRStats
+{
+  uint64_t primaryMisses;     // demand misses that fetched their line, each taking an MSHR
+  uint64_t secondaryMisses;   // accesses to a line whose fill was in flight, which joined it instead of fetching it again
+  uint64_t fullStalls;        // primary misses that had to wait for an MSHR to free up
+  uint64_t targetStalls;      // accesses to a line in flight whose MSHR had no target left, waiting for its fill
+
+  MSHRStats() { reset(); }
+
+  void      reset()       { primaryMisses = secondaryMisses = fullStalls = targetStalls = 0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": primaryMisses=" << primaryMisses << " secondaryMisses=" << secondaryMisses
+       << " fullStalls=" << fullStalls << " targetStalls=" << targetStalls << std::endl;
+  }
+};
+
+struct CoherenceStats
+{
+  uint64_t upgrades;          // writes to Shared lines, which had to invalidate the other copies first
+  uint64_t invalidations;     // lines lost to another cache's write
+  uint64_t downgrades;        // Exclusive or Modified lines demoted to Shared by another cache's read
+  uint64_t interventions;     // snoops answered with dirty data, which memory did not have
+  uint64_t coherenceMisses;   // demand misses on lines lost to an invalidation
+
+  CoherenceStats() { reset(); }
+
+  void      reset()       { upgrades = invalidations = downgrades = interventions = coherenceMisses = 0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": upgrades=" << upgrades << " invalidations=" << invalidations
+       << " downgrades=" << downgrades << " interventions=" << interventions
+       << " coherenceMisses=" << coherenceMisses << std::endl;
+  }
+};
+
+struct SnoopBusStats
+{
+  uint64_t reads;             // line reads for a read miss
+  uint64_t readExclusives;    // line reads for a write miss, which invalidate the other copies
+  uint64_t upgrades;          // invalidations without data: a write to a Shared line, or one overwriting a whole line
+  uint64_t writes;            // writes passed on to memory: write-backs, and dirty data a read snoop found
+  uint64_t snoops;            // snoops sent to the caches
+  uint64_t snoopHits;         // snoops that found the line
+  uint64_t cacheToCache;      // reads served with another cache's dirty data instead of memory's
+
+  SnoopBusStats() { reset(); }
+
+  void      reset()       { reads = readExclusives = upgrades = writes = snoops = snoopHits = cacheToCache = 0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": reads=" << reads << " readExclusives=" << readExclusives << " upgrades=" << upgrades
+       << " writes=" << writes << " snoops=" << snoops << " snoopHits=" << snoopHits
+       << " cacheToCache=" << cacheToCache << std::endl;
+  }
+};
+
+struct PageTLBStats
+{
+  uint64_t lookups;           // page translations asked for
+  uint64_t hits;              // translations found without walking the page table
+  uint64_t invalidations;     // translations dropped because their page was mapped anew or unmapped
+
+  PageTLBStats() { reset(); }
+
+  void      reset()       { lookups = hits = invalidations = 0; }
+  uint64_t  misses()      { return lookups - hits; }
+  double    hitRate()     { return lookups ? (double)hits / lookups : 0.0; }
+
+  void dump( std::ostream& os, const char* name )
+  {
+    os << std::dec << name << ": lookups=" << lookups << " hits=" << hits << " misses=" << misses()
+       << " hitRate=" << hitRate() << " invalidations=" << invalidations << std::endl;
+  }
+};
+
+#endif
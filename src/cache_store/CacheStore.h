@@ -4,12 +4,33 @@
 //  - setDataLine(adr,dataline* fromBuffer) - writes dataline into cache from buffer, if not in cache, caches it
 // Both return true if it was a cache hit, false if miss.
 //  - invalidate(adr) - invalidates cache entry if it exists
+// Zero-copy API; returns a CacheLineRef pointing straight at the cached line (see CacheLine.h)
+//  - accessLine(adr) - borrows the line if it is cached; ref.hit says whether it was
+//  - allocateLine(adr) - borrows the line, allocating it (possibly evicting another) if it is not cached yet
+//  - fillLine(adr) - allocateLine without counting a lookup, after an accessLine miss
+// Batched API, for trace replay
+//  - lookupMany(adrs,n,refs*) - accessLine (or allocateLine) for n addresses, overlapping their tag loads;
+//    optionally marking written lines dirty
+// Write-back; dirty lines are handed to a CacheEvictionHandler (see WriteBackQueue.h)
+//  - setEvictionHandler(handler) - called with every line that gets evicted
+//  - flush() - hands every dirty line still in the cache to the handler and marks it clean
+// Sectored lines; a valid and a dirty bit per sector, so a write need not fill the rest of its line
+//  - setSectorSize(bytes) - split lines into sectors; getSectorMask(adr,len) - the sectors some bytes touch
+// Statistics (see CacheStats.h)
+//  - getStats() - lookups, hits, fills, evictions; enableSetStats(true) adds per-set access/conflict counters
+// Checkpoints (see CacheCheckpoint.h)
+//  - saveCheckpoint(path) - tags, state, replacement metadata and data of every line, in a binary file
+//  - restoreCheckpoint(path) - loads one into a store of the same configuration, mmapping the lines
 //
-// Configurable parameters - on constructor; all powers of 2
+// Configurable parameters - on constructor
 // 	p_MemorySize;		// Size (B) of the Memory
-//	p_CacheSize;		// Size (B) of the Cache
-//	p_LineSize;			// Size (B) of a Cache Line and of a cacheable chunk of memory
-//	p_NumWays;	    // number of 'ways' per cache block
+//	p_CacheSize;		// Size (B) of the Cache; a multiple of p_LineSize * p_NumWays
+//	p_LineSize;			// Size (B) of a Cache Line and of a cacheable chunk of memory; a power of 2
+//	p_NumWays;	    // number of 'ways' per cache block; any number, e.g. 12
+//	p_ReplacementPolicy;	// which line of a full cache block gets evicted (see ReplacementPolicy.h); LRU by default
+//	p_IndexHash;	// which cache block (set) a line maps to (see CacheGeometry.h); the low bits of its line index by
+//	              	// default. With it, the number of sets need not be a power of 2.
+// CacheStoreT<LineSize,Ways,Sets> is the same store with its geometry fixed at compile time.
 
 #ifndef CacheStore_H
 #define CacheStore_H
@@ -21,10 +42,24 @@
 #include <algorithm>    // copy
 
 #include "CacheLine.h"
+#include "CacheLineStorage.h"
+#include "ReplacementPolicy.h"
+#include "TagMatch.h"
+#include "CacheGeometry.h"
+#include "WriteBackQueue.h"
+#include "CacheStats.h"
+#include "CacheCheckpoint.h"
 
 using namespace std;
 
-struct CacheStore
+// All the logic of the store, parameterized on its geometry (see CacheGeometry.h):
+//  - CacheStore                          - runtime geometry, for configurations chosen at startup
+//  - CacheStoreT<LineSize,Ways,Sets>     - constexpr geometry; shifts and masks fold into the code and
+//                                          loops over the ways can be unrolled
+// None of the API methods are virtual, so translation helpers such as getCacheBlockIndex, getCacheTag and
+// getByteIndex inline straight into the caller (e.g. RealCache::b_transport).
+template <class GEOMETRY>
+struct CacheStoreBase
 {
   // Ideas for future API enhancements:
   // abstract interface:
@@ -44,32 +79,68 @@ public:
   uint64_t	p_CacheSize;		// Size (B) of the Cache
   uint64_t	p_LineSize;			// Size (B) of a Cache Line and of a cacheable chunk of memory
   uint64_t	p_NumWays;		    // number of 'ways' per cache block
+  ReplacementPolicy_t p_ReplacementPolicy;  // how the victim within a full cache block is chosen
+  CacheIndexHash_t p_IndexHash;             // how a line's cache block is picked
 
 protected:
-  //CacheLine *m_cacheLines;
-  vector<CacheLine> m_cacheLines;
-
   uint64_t m_numMemoryLines;
   uint64_t m_numCacheLines;
   uint64_t m_numCacheBlocks;          // In my mind, a Cache Block is like a cache hash bucket in that multiple Lines of
                                       //  Memory can/will end up mapping to the same cache block.
-  uint64_t m_cacheBlockIndexMask;
-  uint64_t m_bitsForLine;
-  uint64_t m_bitShiftForCacheTag;
+  // Line size, ways, blocks and the shifts/masks derived from them.
+  GEOMETRY m_geometry;
+
+  // All tags, state and data live in one contiguous structure-of-arrays allocation (see CacheLineStorage.h).
+  // m_cacheLines points at the CacheLine views inside it, indexed by cacheBlockIndex*p_NumWays + way.
+  CacheLineStorage m_storage;
+  CacheLine*       m_cacheLines;
+
+  // Per-block replacement metadata. Told about every hit (getCacheLine) and fill (newCacheLine).
+  ReplacementPolicy* m_replacement;
+
+  // Kernel comparing a tag against all the tags of a block at once; SIMD when the CPU has it (see TagMatch.h).
+  TagMatchKernel_t m_tagMatchKernel;
+  TagMatchFn       m_tagMatch;
+
+  // Told about each dirty line leaving the cache; NULL means dirty data is simply dropped on eviction.
+  CacheEvictionHandler* m_evictionHandler;
+
+  // Counters, in partitions (normally one, see setStatsPartitions) picked by cacheBlockIndex & m_statsMask, or
+  // with m_statsRangeMultiplier by (cacheBlockIndex * m_statsRangeMultiplier) >> 32.
+  std::vector<CacheStoreStats, CacheLineAllocator<CacheStoreStats> > m_stats;
+  uint64_t                     m_statsMask;
+  uint64_t                     m_statsRangeMultiplier;
+  // Sectors (see setSectorSize); one sector of p_LineSize bytes unless sectored
+  uint64_t                     m_sectorSize;
+  uint64_t                     m_bitsForSector;
+  // Optional per-set counters: accesses, and evictions of valid lines (conflicts)
+  bool                         m_setStatsEnabled;
+  std::vector<uint64_t>        m_setAccesses;
+  std::vector<uint64_t>        m_setConflicts;
 
 public:
-  CacheStore(uint64_t memorySize=pow(2,30), uint64_t cacheSize=pow(2,20), uint64_t lineSize=pow(2,3), uint64_t numWays=pow(2,0) )
-  : p_MemorySize( memorySize )				// 1 GiB
-  , p_CacheSize(  cacheSize )				  // 1 MiB
-  , p_LineSize(   lineSize )					// 8 words by default; i.e., one Line contains 8 data words
-  , p_NumWays(    numWays  )					// 1 way by default; i.e., one Line per Cache Block
+  CacheStoreBase(uint64_t memorySize, uint64_t cacheSize, uint64_t lineSize, uint64_t numWays, ReplacementPolicy_t replacementPolicy, CacheIndexHash_t indexHash=IndexModulo)
+  : p_MemorySize( memorySize )
+  , p_CacheSize(  cacheSize )
+  , p_LineSize(   checkedLineSize(cacheSize, lineSize, numWays) )   // before anything divides by it
+  , p_NumWays(    numWays  )
+  , p_ReplacementPolicy( replacementPolicy )
+  , p_IndexHash( indexHash )
   , m_numMemoryLines(  p_MemorySize/ p_LineSize )   //
   , m_numCacheLines(   p_CacheSize / p_LineSize )   //
   , m_numCacheBlocks(  (p_CacheSize / p_LineSize)/p_NumWays)
-  , m_cacheLines( p_CacheSize / p_LineSize )        // This pre-allocates vector of CacheLine and calls  default ctor for each.
-                                                    // I like this b/c I immediately have all CacheLine instances existing and indexable.
+  , m_geometry( p_LineSize, p_NumWays, m_numCacheBlocks, p_IndexHash )
+  , m_storage( p_CacheSize / p_LineSize, p_LineSize ) // This pre-allocates all lines in one go (tags, state, data and views)
+  , m_cacheLines( m_storage.getLines() )            // I like this b/c I immediately have all CacheLine instances existing and indexable.
+  , m_replacement( createReplacementPolicy( replacementPolicy, m_numCacheBlocks, p_NumWays ) )
+  , m_evictionHandler( NULL )
+  , m_stats( 1 )
+  , m_statsMask( 0 )
+  , m_statsRangeMultiplier( 0 )
+  , m_sectorSize( p_LineSize )
+  , m_bitsForSector( m_geometry.bitsForLine() )
+  , m_setStatsEnabled( false )
   {
-    // TODO: assert that Memory, Cache, Line sizes and NumWays are all reasonable numbers
     //cout
     //<< " p_MemorySize=" <<p_MemorySize
     //<< " p_CacheSize=" <<p_CacheSize
@@ -77,24 +148,170 @@ public:
     //<< " p_NumWays=" <<p_NumWays
     //<< endl;
 
-    // How many bits needed to address a line? (We will often shift these away and ignore.)
-    m_bitsForLine = logbase2( p_LineSize );
+    setTagMatchKernel( TagMatchAuto );
+  }
 
-    // Q: So how do you calculate which Cache Block a memory line maps to? I.e., what is the hash function?
-    // A: you use the lowest N bits of the memory address (actually memory line index).
-    // Calculate how many bits are needed to distnguish NUM_BLOCKS blocks.
-    uint64_t cacheBlockIndex_NumBits = logbase2( m_numCacheBlocks );
-    m_cacheBlockIndexMask = pow(2,cacheBlockIndex_NumBits)-1; // i.e. 10 1's or 1111111111
+  virtual ~CacheStoreBase()
+  {
+    delete m_replacement;
+  }
 
-    // While the lowest bits index inside a Line and the next N bits are needed to determine the cacheBlock,
-    // the rest of the bits (highest) are used as a tag to distinguish which memoryLine is actually cached.
-    // To get the highest N bits for the cacheTag, we will just shift the memoryAddress by m_bitShiftForCacheTag.
-    m_bitShiftForCacheTag = ( cacheBlockIndex_NumBits + m_bitsForLine );
+  // Select the kernel used to probe the tags of a cache block. TagMatchAuto picks the best one this CPU supports.
+  // Throws if the CPU does not support the kernel asked for.
+  void setTagMatchKernel( TagMatchKernel_t kernel )
+  {
+    m_tagMatchKernel = resolveTagMatchKernel( kernel, p_NumWays );
+    m_tagMatch = getTagMatchFunction( m_tagMatchKernel );
+  }
+  TagMatchKernel_t getTagMatchKernel()
+  {
+    return m_tagMatchKernel;
+  }
 
-    // not needed
-    //uint64_t memoryLineIndex_NumBits = logbase2( m_numMemoryLines );
-    //uint64_t memoryAddress_NumBits = 64; // = sizeof(uint64_t) * 8 bits pre byte
+  // Write-back API
+  //  - setEvictionHandler(handler) - handler is told about every valid line that newCacheLine evicts (evictLine),
+  //    before its slot is reused. The store does not own the handler.
+  //  - flush() - hands every valid, dirty line to the handler and marks it clean; returns how many there were.
+  //    Does nothing without a handler.
+  void setEvictionHandler( CacheEvictionHandler* handler )
+  {
+    m_evictionHandler = handler;
+  }
+  CacheEvictionHandler* getEvictionHandler()
+  {
+    return m_evictionHandler;
+  }
+  uint64_t flush()
+  {
+    if( m_evictionHandler == NULL ) return 0;
+    uint64_t numWrittenBack = 0;
+    const uint8_t validDirty = LineValid | LineDirty;
+    uint8_t* state = m_storage.getState(0);
+    for( uint64_t lineIndex = 0; lineIndex < m_numCacheLines; lineIndex++) {
+      if( (state[lineIndex] & validDirty) != validDirty ) continue;
+      if( m_cacheLines[lineIndex].isWhole() ) {
+        m_evictionHandler->evictDirtyLine( getCachedLineAddress(lineIndex), m_storage.getData(lineIndex) );
+      } else {
+        m_evictionHandler->evictDirtySectors( getCachedLineAddress(lineIndex), m_storage.getData(lineIndex), m_cacheLines[lineIndex].getDirtySectors() );
+      }
+      m_cacheLines[lineIndex].setDirty(false);
+      getPartitionStats( lineIndex / m_geometry.numWays() ).flushedLines++;
+      numWrittenBack++;
+    }
+    return numWrittenBack;
+  }
 
+  // Statistics (see CacheStats.h). Counting is always on; it costs a few increments per lookup and fill.
+  //  - getStats() - the counters of the whole store
+  //  - resetStats() - zero all counters, per-set ones included
+  //  - enableSetStats(bool) - also count accesses and conflicts (evictions of valid lines) per set. Off by default.
+  //  - getSetAccesses(block), getSetConflicts(block) - per-set counters, 0 if not enabled
+  //  - dumpSetStats(os) - one "set accesses conflicts" line per set that was accessed, for a set-pressure heatmap
+  //  - setStatsPartitions(n,bySetRange) - keep n partitions of counters, so threads working on disjoint groups of
+  //    sets never update the same counter. The partition of a set is picked by the low bits of its cacheBlockIndex
+  //    (ShardedCacheStore), or with bySetRange as n (nearly) equal runs of adjacent sets (SetParallelReplay).
+  //    n must be a power of 2, at most the number of sets; getStats() sums the partitions.
+  //  - getStatsPartition(block) - the partition a set counts into
+  CacheStoreStats getStats()
+  {
+    CacheStoreStats total;
+    for( size_t ii = 0; ii < m_stats.size(); ii++) total += m_stats[ii];
+    return total;
+  }
+  void resetStats()
+  {
+    for( size_t ii = 0; ii < m_stats.size(); ii++) m_stats[ii].reset();
+    std::fill( m_setAccesses.begin(), m_setAccesses.end(), 0 );
+    std::fill( m_setConflicts.begin(), m_setConflicts.end(), 0 );
+  }
+  void enableSetStats( bool enable )
+  {
+    m_setStatsEnabled = enable;
+    if( enable && m_setAccesses.empty() ) {
+      m_setAccesses.resize( m_numCacheBlocks, 0 );
+      m_setConflicts.resize( m_numCacheBlocks, 0 );
+    }
+  }
+  bool getSetStatsEnabled()
+  {
+    return m_setStatsEnabled;
+  }
+  uint64_t getSetAccesses( uint64_t cacheBlockIndex )
+  {
+    return m_setAccesses.empty() ? 0 : m_setAccesses[cacheBlockIndex];
+  }
+  uint64_t getSetConflicts( uint64_t cacheBlockIndex )
+  {
+    return m_setConflicts.empty() ? 0 : m_setConflicts[cacheBlockIndex];
+  }
+  void dumpSetStats( std::ostream& os )
+  {
+    for( uint64_t bb = 0; bb < m_setAccesses.size(); bb++) {
+      if( m_setAccesses[bb] == 0 ) continue;
+      os << std::dec << bb << " " << m_setAccesses[bb] << " " << m_setConflicts[bb] << std::endl;
+    }
+  }
+  void setStatsPartitions( uint64_t numPartitions, bool bySetRange=false )
+  {
+    if( numPartitions == 0 || (numPartitions & (numPartitions - 1)) != 0 || numPartitions > m_numCacheBlocks )
+      throw std::runtime_error("CacheStore: the number of statistics partitions must be a power of 2, at most the number of sets.");
+    CacheStoreStats total = getStats();
+    m_stats.assign( numPartitions, CacheStoreStats() );
+    m_stats[0] = total;
+    m_statsMask = numPartitions - 1;
+    // floor(numPartitions * 2^32 / numCacheBlocks): partitions of (nearly) equal runs of sets, whatever their number
+    m_statsRangeMultiplier = bySetRange ? (numPartitions << 32) / m_numCacheBlocks : 0;
+  }
+  // The counter partition of a set.
+  uint64_t getStatsPartition( uint64_t cacheBlockIndex )
+  {
+    if( m_statsRangeMultiplier != 0 ) return (cacheBlockIndex * m_statsRangeMultiplier) >> 32;
+    return cacheBlockIndex & m_statsMask;
+  }
+
+  // Sectored lines. Each line is split into sectors with a valid and a dirty bit each (see CacheLine.h), so that a
+  // write miss can allocate its line and write just its own sectors, without first reading the line from memory.
+  //  - setSectorSize(bytes) - a power of 2, at least a word, at most the line size (the default: not sectored) and
+  //    at least 1/64th of it. Lines already cached count as whole. Lines allocated by allocateLine, fillLine, lookupMany
+  //    and setDataLine start out whole; a caller that only writes some sectors clears the rest with setValidSectors.
+  //  - getSectorSize(), getNumSectors()
+  //  - getSectorMask(adr,len) - the sectors of adr's line that the len bytes at adr touch, as a mask (bit ii for
+  //    sector ii); getWholeSectorMask(adr,len) - those they cover completely. Both 1 (or 0) if not sectored.
+  // A dirty line that is not whole goes to the eviction handler's evictDirtySectors, with only its dirty sectors.
+  void setSectorSize( uint64_t sectorSize )
+  {
+    if( sectorSize == 0 ) sectorSize = p_LineSize;
+    if( sectorSize != p_LineSize
+     && ( !constIsPow2(sectorSize) || sectorSize < sizeof(uint32_t) || sectorSize > p_LineSize || p_LineSize / sectorSize > 64 ) ) {
+      std::ostringstream oss;
+      oss << "CacheStore: sectorSize=" << sectorSize << " must be a power of 2 of at least " << sizeof(uint32_t)
+          << " bytes, at most lineSize=" << p_LineSize << " and at least 1/64th of it";
+      throw std::runtime_error(oss.str());
+    }
+    m_sectorSize = sectorSize;
+    m_bitsForSector = logbase2( sectorSize );
+    m_storage.setNumSectors( p_LineSize / sectorSize );
+  }
+  uint64_t getSectorSize()
+  {
+    return m_sectorSize;
+  }
+  uint64_t getNumSectors()
+  {
+    return p_LineSize / m_sectorSize;
+  }
+  uint64_t getSectorMask( uint64_t memoryAddress, uint64_t len )
+  {
+    if( len == 0 ) return 0;
+    uint64_t byteIndex = getByteIndex( memoryAddress );
+    return sectorRange( byteIndex >> m_bitsForSector, ((byteIndex + len - 1) >> m_bitsForSector) + 1 );
+  }
+  uint64_t getWholeSectorMask( uint64_t memoryAddress, uint64_t len )
+  {
+    uint64_t byteIndex = getByteIndex( memoryAddress );
+    uint64_t first = (byteIndex + m_sectorSize - 1) >> m_bitsForSector;
+    uint64_t end = (byteIndex + len) >> m_bitsForSector;
+    return end > first ? sectorRange( first, end ) : 0;
   }
 
   // HIgh-level API to get/set lines of data
@@ -102,7 +319,7 @@ public:
   //  - setDataLine(adr,dataline* fromBuffer) - writes dataline into cache from buffer, if not in cache, caches it
   // Both return true if it was a cache hit, false if miss.
   //  - invalidate(adr) - invalidates cache entry if it exists
-  virtual bool getDataLine( uint64_t memoryAddress, uint32_t* toBuffer )
+  bool getDataLine( uint64_t memoryAddress, uint32_t* toBuffer )
   {
     if( toBuffer == NULL ) return false;    // should throw an exception
 
@@ -110,11 +327,11 @@ public:
     if( cl == NULL ) return false;          // data is not not in cache
 
     uint32_t* fromBuffer  = cl->getData(0);
-    std::copy(fromBuffer, fromBuffer+(p_LineSize/sizeof(uint32_t)), toBuffer );
+    std::copy(fromBuffer, fromBuffer+(m_geometry.lineSize()/sizeof(uint32_t)), toBuffer );
     return true;
   }
 
-  virtual bool setDataLine( uint64_t memoryAddress, const uint32_t* fromBuffer )
+  bool setDataLine( uint64_t memoryAddress, const uint32_t* fromBuffer )
   {
     if( fromBuffer == NULL ) {}    // should throw an exception
     bool cacheHit = true;
@@ -124,109 +341,391 @@ public:
       cl = newCacheLine( memoryAddress );
       cacheHit = false;
     }
-    cl->load( getCacheTag(memoryAddress),fromBuffer ,(CacheLineSize_t)p_LineSize);
+    cl->load( getCacheTag(memoryAddress),fromBuffer ,(CacheLineSize_t)m_geometry.lineSize());
     return cacheHit;
   }
-  virtual void invalidate( uint64_t memoryAddress )
+  // Not an access: neither counted nor seen by the replacement policy.
+  void invalidate( uint64_t memoryAddress )
+  {
+    CacheLineRef ref = peekLine(memoryAddress);
+    if ( ref.isHit() ) ref.line->setValid(false);
+  }
+
+  // Checkpoints. Both throw std::runtime_error on an I/O error or a file that does not fit this store.
+  //  - saveCheckpoint(path) - writes the whole cache (tags, state, replacement metadata and data) to path
+  //  - restoreCheckpoint(path,map) - makes this store what it was when path was saved. It must have the same
+  //    configuration (sizes, ways and replacement policy). With map (the default) tags, state and data are mmapped
+  //    from the file rather than read, so no line data is copied up front: pages are read in as they are touched,
+  //    and copied on write, so the file stays as it was and can be restored again by other runs.
+  //    Statistics and the eviction handler are left alone. Any CacheLine pointer or CacheLineRef is stale after.
+  void saveCheckpoint( const char* path )
+  {
+    std::vector<uint8_t> replacementState;
+    m_replacement->saveState( replacementState );
+    CacheLineStorage::ArraysLayout layout = m_storage.getArraysLayout();
+
+    CacheCheckpointHeader header = getCheckpointHeader();
+    header.replacementBytes = replacementState.size();
+    header.arraysOffset = (sizeof(header) + replacementState.size() + CACHE_CHECKPOINT_PAGE - 1) & ~(CACHE_CHECKPOINT_PAGE - 1);
+    header.arraysBytes = layout.bytes;
+
+    std::ofstream os( path, std::ios::binary | std::ios::trunc );
+    if( !os ) throw std::runtime_error(std::string("CacheCheckpoint: cannot create ") + path);
+    writeCheckpointBytes( os, &header, sizeof(header) );
+    writeCheckpointBytes( os, replacementState.data(), replacementState.size() );
+    padCheckpointTo( os, header.arraysOffset );
+    writeCheckpointBytes( os, m_storage.getTags(0), m_numCacheLines * sizeof(uint64_t) );
+    padCheckpointTo( os, header.arraysOffset + layout.stateOffset );
+    writeCheckpointBytes( os, m_storage.getState(0), m_numCacheLines * sizeof(uint8_t) );
+    padCheckpointTo( os, header.arraysOffset + layout.dataOffset );
+    writeCheckpointBytes( os, m_storage.getData(0), (uint64_t)m_numCacheLines * m_storage.getNumWordsPerLine() * sizeof(uint32_t) );
+    padCheckpointTo( os, header.arraysOffset + layout.bytes );
+    if( header.sectorSize != 0 ) writeCheckpointBytes( os, m_storage.getSectors(0), 2 * m_numCacheLines * sizeof(uint64_t) );
+    os.close();
+    if( !os ) throw std::runtime_error(std::string("CacheCheckpoint: cannot write ") + path);
+  }
+  void restoreCheckpoint( const char* path, bool map=true )
+  {
+    CacheCheckpointFile file( path );
+    CacheCheckpointHeader header;
+    file.read( 0, &header, sizeof(header) );
+    if( memcmp( header.magic, CACHE_CHECKPOINT_MAGIC, sizeof(header.magic) ) != 0 ) file.fail("not a cache checkpoint");
+    if( header.byteOrder != CACHE_CHECKPOINT_BYTE_ORDER ) file.fail("written by a host of another byte order");
+    if( header.version != CACHE_CHECKPOINT_VERSION || header.headerBytes != sizeof(header) ) file.fail("unsupported version");
+    CacheCheckpointHeader expected = getCheckpointHeader();
+    if( header.memorySize != expected.memorySize || header.cacheSize != expected.cacheSize || header.lineSize != expected.lineSize
+     || header.numWays != expected.numWays || header.replacementPolicy != expected.replacementPolicy
+     || header.indexHash != expected.indexHash || header.sectorSize != expected.sectorSize )
+      file.fail("saved by a cache of another configuration");
+    if( header.arraysBytes != m_storage.getArraysLayout().bytes ) file.fail("corrupt");
+
+    // Everything is read before anything changes, so a failed restore leaves the store as it was.
+    std::vector<uint8_t> replacementState( header.replacementBytes );
+    file.read( sizeof(header), replacementState.data(), replacementState.size() );
+    std::vector<uint8_t> currentState;
+    m_replacement->saveState( currentState );
+    if( currentState.size() != replacementState.size() ) file.fail("corrupt");
+    // a truncated file would map, but fault when its missing pages are touched
+    uint8_t lastByte;
+    file.read( header.arraysOffset + header.arraysBytes - 1, &lastByte, 1 );
+    // the sector masks are small, and read rather than mapped
+    std::vector<uint64_t> sectors( header.sectorSize != 0 ? 2 * m_numCacheLines : 0 );
+    if( !sectors.empty() ) file.read( header.arraysOffset + header.arraysBytes, sectors.data(), sectors.size() * sizeof(uint64_t) );
+
+    if( map ) {
+      if( !m_storage.mapArrays( file.getFd(), header.arraysOffset ) ) file.fail("cannot be mapped");
+      m_cacheLines = m_storage.getLines();
+    } else {
+      CacheLineStorage::ArraysLayout layout = m_storage.getArraysLayout();
+      file.read( header.arraysOffset, m_storage.getTags(0), m_numCacheLines * sizeof(uint64_t) );
+      file.read( header.arraysOffset + layout.stateOffset, m_storage.getState(0), m_numCacheLines * sizeof(uint8_t) );
+      file.read( header.arraysOffset + layout.dataOffset, m_storage.getData(0), (uint64_t)m_numCacheLines * m_storage.getNumWordsPerLine() * sizeof(uint32_t) );
+    }
+    m_replacement->loadState( replacementState.data(), replacementState.size() );
+    if( !sectors.empty() ) std::copy( sectors.begin(), sectors.end(), m_storage.getSectors(0) );
+  }
+  bool isMappedFromCheckpoint()
+  {
+    return m_storage.isMapped();
+  }
+
+  // Zero-copy API
+  //  - accessLine(adr) - borrows the cached line without copying it; on a miss ref.hit is false and ref.data is NULL
+  //  - allocateLine(adr) - like accessLine, but on a miss allocates the line (valid, clean) and returns it with ref.hit
+  //    false; the caller is expected to fill ref.data, e.g. straight from memory.
+  // Reads and writes through ref.data touch only the words they need. After a write, call ref.markDirty().
+  // A line that was invalidated keeps its tag, but is a miss here; allocateLine revalidates it in place, and its way
+  // is reused for another line before any valid one is evicted.
+  CacheLineRef accessLine( uint64_t memoryAddress )
+  {
+    CacheLine* cl = getCacheLine( memoryAddress );
+    if( cl == NULL || !cl->getValid() ) return CacheLineRef();
+    return CacheLineRef( cl, true );
+  }
+  // Like accessLine, but neither counted nor seen by the replacement policy; for looking at the cache from the
+  // outside, e.g. back-invalidation by another cache level.
+  CacheLineRef peekLine( uint64_t memoryAddress )
   {
-    CacheLine*  cl = this->getCacheLine(memoryAddress);
-    if ( cl != NULL ) cl->setValid(false);
+    uint64_t firstLine = getCacheBlockIndex(memoryAddress) * m_geometry.numWays();
+    uint64_t way = matchWay( m_storage.getTags(firstLine), getCacheTag(memoryAddress) );
+    if( way == m_geometry.numWays() || !m_cacheLines[firstLine + way].getValid() ) return CacheLineRef();
+    return CacheLineRef( &m_cacheLines[firstLine + way], true );
+  }
+  CacheLineRef allocateLine( uint64_t memoryAddress )
+  {
+    CacheLine* cl = getCacheLine( memoryAddress );
+    if( cl != NULL && cl->getValid() ) return CacheLineRef( cl, true );
+    if( cl == NULL ) {
+      cl = newCacheLine( memoryAddress );
+      cl->setTag( getCacheTag(memoryAddress) );
+    }
+    cl->clearState();
+    cl->setValid( true );
+    return CacheLineRef( cl, false );
+  }
+  // Like allocateLine, but without counting a lookup: for a line the caller has already looked up with accessLine
+  // (a miss, then a fill), or one that is not an access of the cache at all (a prefetch, a victim from above).
+  // The fill of a line that has to be allocated is counted as usual.
+  CacheLineRef fillLine( uint64_t memoryAddress )
+  {
+    uint64_t firstLine = getCacheBlockIndex(memoryAddress) * m_geometry.numWays();
+    uint64_t way = matchWay( m_storage.getTags(firstLine), getCacheTag(memoryAddress) );
+    CacheLine* cl = ( way < m_geometry.numWays() ) ? &m_cacheLines[firstLine + way] : NULL;
+    if( cl != NULL && cl->getValid() ) return CacheLineRef( cl, true );
+    if( cl == NULL ) {
+      cl = newCacheLine( memoryAddress );
+      cl->setTag( getCacheTag(memoryAddress) );
+    }
+    cl->clearState();
+    cl->setValid( true );
+    return CacheLineRef( cl, false );
+  }
+
+  // Batched lookup: the same as calling accessLine(addrs[ii]) (or allocateLine, if allocateOnMiss) for each ii in
+  // order, with the result in out[ii]. Addresses are taken LOOKUP_BATCH at a time: first all their cache blocks and
+  // tags are computed and the blocks' tag arrays prefetched, then the lookups are resolved one after the other.
+  // Calling getCacheLine one address at a time stalls on every tag array that misses in the host cache; here the
+  // host has the whole batch of tag loads in flight at once.
+  // Resolving in order keeps the replacement state exactly as the one-at-a-time loop would leave it, and an
+  // address allocated earlier in a batch is a hit for a later one.
+  // If writes is given, the line of each address with writes[ii] set is marked dirty as soon as it is resolved;
+  // marking it through out[ii] afterwards could hit a line that a later address of the batch has evicted.
+  static const size_t LOOKUP_BATCH = 16;
+  void lookupMany( const uint64_t* memoryAddresses, size_t n, CacheLineRef* out, bool allocateOnMiss=false, const bool* writes=NULL )
+  {
+    uint64_t cacheBlockIndex[LOOKUP_BATCH];
+    uint64_t cacheTag[LOOKUP_BATCH];
+    for( size_t first = 0; first < n; first += LOOKUP_BATCH) {
+      size_t count = ( n - first < LOOKUP_BATCH ) ? n - first : LOOKUP_BATCH;
+      for( size_t ii = 0; ii < count; ii++) {
+        cacheBlockIndex[ii] = getCacheBlockIndex( memoryAddresses[first + ii] );
+        cacheTag[ii]        = getCacheTag( memoryAddresses[first + ii] );
+        const uint64_t* tags = m_storage.getTags( cacheBlockIndex[ii] * m_geometry.numWays() );
+        __builtin_prefetch( tags );
+        // blocks of more than 8 ways spill over into the next host line
+        if( m_geometry.numWays() > 8 ) __builtin_prefetch( tags + m_geometry.numWays() - 1 );
+        m_replacement->prefetch( cacheBlockIndex[ii] );
+      }
+      for( size_t ii = 0; ii < count; ii++) {
+        CacheLine* cl = lookupInBlock( cacheBlockIndex[ii], cacheTag[ii] );
+        // data comes from the slab, not through the view, so a hit only loads the packed state byte
+        if( cl != NULL && (*m_storage.getState(cl - m_cacheLines) & LineValid) ) {
+          out[first + ii] = CacheLineRef( cl, m_storage.getData(cl - m_cacheLines), true );
+        }
+        else if( !allocateOnMiss ) {
+          out[first + ii] = CacheLineRef();
+          continue;
+        }
+        else {
+          if( cl == NULL ) {
+            cl = newCacheLine( memoryAddresses[first + ii] );
+            cl->setTag( cacheTag[ii] );
+          }
+          cl->clearState();
+          cl->setValid( true );
+          out[first + ii] = CacheLineRef( cl, false );
+        }
+        if( writes != NULL && writes[first + ii] ) {
+          *m_storage.getState(cl - m_cacheLines) |= LineDirty;
+          // a trace says nothing of the bytes written, so all valid sectors are
+          if( m_storage.getNumSectors() > 1 ) m_storage.getSectors(cl - m_cacheLines)[1] = m_storage.getSectors(cl - m_cacheLines)[0];
+        }
+      }
+    }
   }
 
   // API for dealing with CacheLine objects
   //  - getCacheLine(adr) - returns NULL or CacheLine
   //  - newCacheLine(adr) - creates and returns new CacheLine
   //  - invalidate(adr) - invalidate corresponding CacheLine, if the Cache contains it
-  virtual CacheLine*  getCacheLine( uint64_t memoryAddress )
+  CacheLine*  getCacheLine( uint64_t memoryAddress )
   {
-    // Note: the cacheBlock is a chunk from an array of CacheLines. Really just a ptr into an array of CacheLines
-    CacheLine* cacheBlock = this->getCacheBlock(getCacheBlockIndex(memoryAddress));
-
     // Since multiple Memory lines will map to the same cache block (cache hash bucket),
     // we need a key/tag to easily distinguish the multiple bucket entries. We simply use
     // the rest of the bits of the memoryLineIndex:
 	  // The upper (m - k) address bits are stored as the tag of each CacheLine.
 
     //uint64_t cacheTag = memoryLineIndex | m_cacheTagMask; // kq: doesnt seem right...shift?
-    // To get the highest N bits for the cacheTag, we just shift the memoryAddress by m_bitShiftForCacheTag
+    // To get the highest N bits for the cacheTag, we just shift the memoryAddress by bitShiftForCacheTag
     uint64_t cacheTag = getCacheTag(memoryAddress);
-    // check if any of the Ways match this tag
-    for( int ii = 0; ii < p_NumWays; ii++) {
-      CacheLine* returnCacheLine = &cacheBlock[ii];
-      if( returnCacheLine->getTag() == cacheTag ) return returnCacheLine;
-    }
-    return NULL;
+    return lookupInBlock( getCacheBlockIndex(memoryAddress), cacheTag );
   }
-  virtual CacheLine*  newCacheLine( uint64_t memoryAddress )
+  CacheLine*  newCacheLine( uint64_t memoryAddress )
   {
     // Note: the cacheBlock is a chunk from an array of CacheLines. Really just a ptr into an array of CacheLines
     CacheLine* cacheBlock = this->getCacheBlock(getCacheBlockIndex(memoryAddress));
     // Now we have to evict one of the CacheLines.
     CacheLine* newLine = this->pickOrEvict(cacheBlock);
-    // don't bother re-initializing the evictLine, just setEmpty()
+    uint64_t lineIndex = newLine - m_cacheLines;
+    uint64_t cacheBlockIndex = lineIndex / m_geometry.numWays();
+    CacheStoreStats& stats = getPartitionStats( cacheBlockIndex );
+    stats.fills++;
+    if( newLine->getValid() ) {
+      stats.evictions++;
+      if( newLine->getDirty() ) stats.dirtyEvictions++;
+      if( newLine->getPrefetched() ) stats.unusedPrefetches++;
+      if( m_setStatsEnabled ) m_setConflicts[cacheBlockIndex]++;
+      // A dirty victim has data memory does not have yet: hand it over before its slot is reused.
+      if( m_evictionHandler != NULL && newLine->isWhole() ) {
+        m_evictionHandler->evictLine( getCachedLineAddress(lineIndex), m_storage.getData(lineIndex), newLine->getDirty() );
+      } else if( m_evictionHandler != NULL ) {
+        m_evictionHandler->evictLine( getCachedLineAddress(lineIndex), m_storage.getData(lineIndex), false );
+        if( newLine->getDirty() ) {
+          m_evictionHandler->evictDirtySectors( getCachedLineAddress(lineIndex), m_storage.getData(lineIndex), newLine->getDirtySectors() );
+        }
+      }
+    }
+    m_replacement->fill( cacheBlockIndex, lineIndex % m_geometry.numWays() );
+    // don't bother re-initializing the evictLine's data, just setEmpty() and forget its valid/dirty state
     newLine->setEmpty();
+    newLine->clearState();
     return newLine;
   }
-  virtual CacheLine*  pickOrEvict( CacheLine* cacheBlock )
+  CacheLine*  pickOrEvict( CacheLine* cacheBlock )
   {
-    CacheLine* returnCacheLine = NULL;
-    // If one is empty, return it.
-    for( int ii = 0; ii < p_NumWays; ii++) {
-      returnCacheLine = &cacheBlock[ii];
-      if( returnCacheLine->getEmpty()) return returnCacheLine;
+    // If one is not valid (empty, or invalidated and still tagged), return it.
+    uint64_t firstLine = cacheBlock - m_cacheLines;
+    const uint8_t* state = m_storage.getState(firstLine);
+    for( uint64_t way = 0; way < m_geometry.numWays(); way++) {
+      if( !(state[way] & LineValid) ) return &cacheBlock[way];
     }
-    // Return the oldest one
-    // TODO : do this right! LRU
-    returnCacheLine = &cacheBlock[0];
-    return cacheBlock;
+    // Otherwise the replacement policy picks the victim
+    return &cacheBlock[ m_replacement->victim( firstLine / m_geometry.numWays() ) ];
+  }
+  uint64_t    getNumCacheBlocks()
+  {
+    return m_numCacheBlocks;
   }
-  virtual CacheLine* getCacheBlock( uint64_t cacheBlockIndex )
+  CacheLine* getCacheBlock( uint64_t cacheBlockIndex )
   {
-    return &m_cacheLines[cacheBlockIndex * p_NumWays];
+    return &m_cacheLines[cacheBlockIndex * m_geometry.numWays()];
   }
-  virtual uint64_t    getCacheBlockIndex( uint64_t memoryAddress )
+  uint64_t    getCacheBlockIndex( uint64_t memoryAddress )
   {
     // which line in the memory does this address select? (imagine the memory is organized in lines)
-    uint64_t memoryLineIndex = memoryAddress >> m_bitsForLine;
+    uint64_t memoryLineIndex = memoryAddress >> m_geometry.bitsForLine();
 
     // Which cacheBlock does this memoryLine map to?
-    // Use the lowest N bits of the memoryLineIndex. We created a mask in the ctor to do this.
-    uint64_t cacheBlockIndex = memoryLineIndex & m_cacheBlockIndexMask;
-    return cacheBlockIndex;
+    // By default the lowest N bits of the memoryLineIndex; the geometry holds a mask to do this, or the index function.
+    return m_geometry.cacheBlockIndex( memoryLineIndex );
   }
-  virtual uint64_t    getCacheTag( uint64_t memoryAddress )
+  uint64_t    getCacheTag( uint64_t memoryAddress )
   {
-    // To get the highest bits for the cacheTag, we will just shift the memoryAddress by m_bitShiftForCacheTag.
-    return memoryAddress >> m_bitShiftForCacheTag;
+    // To get the highest bits for the cacheTag, we will just shift the memoryAddress by bitShiftForCacheTag.
+    return memoryAddress >> m_geometry.bitShiftForCacheTag();
   }
   // Return the index of the byte being addressed within the line.
   // This is also the offset from the beginning of the DataLine
   // Just a translation utility.
-  virtual uint64_t    getByteIndex( uint64_t memoryAddress )
+  uint64_t    getByteIndex( uint64_t memoryAddress )
   {
     // create a bit mask for the number of bits in the address needed to index the word within the line
-    // Remember:     m_bitsForLine = logbase2( p_LineSize );
+    // Remember:     bitsForLine = logbase2( lineSize );
     // So a bit mask of that many 1's can be created simply by subtracting 1 from the LineSize value
-    uint64_t bitmaskForWordIndex = p_LineSize - 1;
+    uint64_t bitmaskForWordIndex = m_geometry.lineSize() - 1;
     return (memoryAddress & bitmaskForWordIndex);
   }
   // Return the index of the word addressed within the line.
   // This is also the offset from the beginning of the DataLine
   // Just a translation utility.
-  virtual uint64_t    getWordIndex( uint64_t memoryAddress )
+  uint64_t    getWordIndex( uint64_t memoryAddress )
   {
     return (getByteIndex(memoryAddress)/sizeof(uint32_t));
   }
   // For a given word address, returns the address of the cache line that contains it
   // Just a translation utility.
-  virtual uint64_t    getLineAddress( uint64_t memoryAddress )
+  uint64_t    getLineAddress( uint64_t memoryAddress )
   {
     // zero out the lowest N bits that are needed to index the word within the line
-    // Remember:     m_bitsForLine = logbase2( p_LineSize );
-    return ((memoryAddress >> m_bitsForLine) << m_bitsForLine);
+    // Remember:     bitsForLine = logbase2( lineSize );
+    return ((memoryAddress >> m_geometry.bitsForLine()) << m_geometry.bitsForLine());
+  }
+  // The inverse of getCacheTag/getCacheBlockIndex: the memory address of the line cached in slot lineIndex
+  // (cacheBlockIndex*numWays + way). Only meaningful if that slot is not empty.
+  uint64_t    getCachedLineAddress( uint64_t lineIndex )
+  {
+    uint64_t cacheBlockIndex = lineIndex / m_geometry.numWays();
+    return m_geometry.memoryLineIndex( *m_storage.getTags(lineIndex), cacheBlockIndex ) << m_geometry.bitsForLine();
   }
 
+protected:
+  // The line size, once the sizes are known to fit together; for the ctor, which divides by it and by numWays.
+  static uint64_t checkedLineSize( uint64_t cacheSize, uint64_t lineSize, uint64_t numWays )
+  {
+    if( lineSize == 0 || numWays == 0 || cacheSize == 0 || cacheSize % (lineSize * numWays) != 0 ) {
+      std::ostringstream oss;
+      oss << "CacheStore: cacheSize=" << cacheSize << " is not a multiple of lineSize=" << lineSize
+          << " * numWays=" << numWays;
+      throw std::runtime_error(oss.str());
+    }
+    return lineSize;
+  }
+
+  // What a checkpoint of this store says about its configuration.
+  CacheCheckpointHeader getCheckpointHeader()
+  {
+    CacheCheckpointHeader header;
+    memcpy( header.magic, CACHE_CHECKPOINT_MAGIC, sizeof(header.magic) );
+    header.version = CACHE_CHECKPOINT_VERSION;
+    header.headerBytes = sizeof(header);
+    header.byteOrder = CACHE_CHECKPOINT_BYTE_ORDER;
+    header.memorySize = p_MemorySize;
+    header.cacheSize = p_CacheSize;
+    header.lineSize = p_LineSize;
+    header.numWays = p_NumWays;
+    header.replacementPolicy = p_ReplacementPolicy;
+    header.indexHash = p_IndexHash;
+    header.sectorSize = m_sectorSize == p_LineSize ? 0 : m_sectorSize;
+    return header;
+  }
+
+  // Sectors first..end-1, as a mask.
+  static uint64_t sectorRange( uint64_t first, uint64_t end )
+  {
+    return ( end - first >= 64 ? ~0ULL : (1ULL << (end - first)) - 1 ) << first;
+  }
+
+  // The counter partition of a set (see setStatsPartitions).
+  CacheStoreStats& getPartitionStats( uint64_t cacheBlockIndex )
+  {
+    return m_stats[getStatsPartition(cacheBlockIndex)];
+  }
 
+  // The line of the block holding cacheTag (and a touch for the replacement policy), or NULL.
+  CacheLine*  lookupInBlock( uint64_t cacheBlockIndex, uint64_t cacheTag )
+  {
+    // The cacheBlock is a run of numWays adjacent lines; we probe its tags straight from the tag array.
+    uint64_t firstLine = cacheBlockIndex * m_geometry.numWays();
+    // check if any of the Ways match this tag
+    uint64_t way = matchWay( m_storage.getTags(firstLine), cacheTag );
+    CacheStoreStats& stats = getPartitionStats( cacheBlockIndex );
+    stats.lookups++;
+    if( m_setStatsEnabled ) m_setAccesses[cacheBlockIndex]++;
+    if( way == m_geometry.numWays() ) return NULL;
+    if( *m_storage.getState(firstLine + way) & LineValid ) stats.hits++;
+    m_replacement->touch( cacheBlockIndex, way );
+    return &m_cacheLines[firstLine + way];
+  }
+
+  // Way of the block whose tag equals cacheTag, or numWays if none does.
+  // The scalar kernel is inlined here, so with a constexpr geometry its loop can be unrolled.
+  uint64_t    matchWay( const uint64_t* tags, uint64_t cacheTag )
+  {
+    if( m_tagMatchKernel == TagMatchScalar ) {
+      for( uint64_t ii = 0; ii < m_geometry.numWays(); ii++) {
+        if( tags[ii] == cacheTag ) return ii;
+      }
+      return m_geometry.numWays();
+    }
+    return m_tagMatch( tags, m_geometry.numWays(), cacheTag );
+  }
+
+private:
+  // Not copyable: owns its storage and replacement policy.
+  CacheStoreBase(const CacheStoreBase&);
+  CacheStoreBase& operator=(const CacheStoreBase&);
+
+public:
 
   // TODO: determine any value in what I did here?
 /*
@@ -325,6 +824,27 @@ protected:
 
 };
 
+// The runtime-configured store: geometry chosen at startup, e.g. from a Top constructor.
+struct CacheStore : public CacheStoreBase<CacheGeometry>
+{
+  CacheStore(uint64_t memorySize=pow(2,30), uint64_t cacheSize=pow(2,20), uint64_t lineSize=pow(2,3), uint64_t numWays=pow(2,0), ReplacementPolicy_t replacementPolicy=ReplLRU, CacheIndexHash_t indexHash=IndexModulo )
+  : CacheStoreBase<CacheGeometry>( memorySize,  // 1 GiB
+                                   cacheSize,   // 1 MiB
+                                   lineSize,    // 8 words by default; i.e., one Line contains 8 data words
+                                   numWays,     // 1 way by default; i.e., one Line per Cache Block
+                                   replacementPolicy,
+                                   indexHash )  // low bits of the line index by default
+  {}
+};
 
+// The compile-time specialized store. Takes the same ctor arguments as CacheStore (so it can be dropped into
+// RealCacheT) but they must agree with the template parameters; LineSize is in bytes, Sets is the number of blocks.
+template <uint64_t LineSize, uint64_t Ways, uint64_t Sets>
+struct CacheStoreT : public CacheStoreBase< FixedCacheGeometry<LineSize,Ways,Sets> >
+{
+  CacheStoreT(uint64_t memorySize=pow(2,30), uint64_t cacheSize=LineSize*Ways*Sets, uint64_t lineSize=LineSize, uint64_t numWays=Ways, ReplacementPolicy_t replacementPolicy=ReplLRU )
+  : CacheStoreBase< FixedCacheGeometry<LineSize,Ways,Sets> >( memorySize, cacheSize, lineSize, numWays, replacementPolicy )
+  {}
+};
 
 #endif
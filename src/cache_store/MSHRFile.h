@@ -0,0 +1,130 @@
+// Miss status holding registers (MSHRs) of a cache level (see RealCacheT::setMSHRs): the line fills it has in
+// flight, and the accesses that wait for them instead of fetching the line again.
+//  - numEntries - how many fills can be in flight at once; a primary miss with all of them busy stalls until the
+//                 first of them completes
+//  - numTargets - how many accesses one fill can serve, the primary miss included; an access to a line in flight
+//                 whose entry has no target left stalls until the fill completes (it would be replayed then)
+// A fill is in flight from its issue until its data is back, at its ready time. Entries are retired lazily, once an
+// access comes along at or after their ready time. TIME is anything ordered, e.g. sc_time.
+// Times are taken in the order the accesses come in: with temporal decoupling, an initiator running behind the
+// others may find a fill retired that it would still have seen in flight.
+//
+// API
+//  - merge(lineAdr,now,ready) - a secondary miss: if the line's fill is in flight at now, the access joins it and
+//    ready is when its data is back
+//  - issue(now) - a primary miss: when an MSHR is free for its fill; now, unless all of them are busy
+//  - tryIssue(now) - for a prefetch, which never waits: is an MSHR free at now?
+//  - allocate(lineAdr,ready,demand) - the fill that issue/tryIssue made room for, in flight until ready
+//  - getStats() - primary and secondary misses, stalls (see MSHRStats in CacheStats.h)
+
+#ifndef MSHRFile_H
+#define MSHRFile_H
+
+#include <stdint.h>
+#include <vector>
+#include <stdexcept>
+
+#include "CacheStats.h"
+
+template <class TIME>
+class MSHRFileT
+{
+public:
+  struct Entry
+  {
+    uint64_t      lineAddress;
+    TIME          ready;          // when its data is back
+    unsigned int  targets;        // accesses it serves, the primary miss included
+  };
+
+  // No entries: MSHRs are not modelled, every fill is on its own.
+  MSHRFileT( unsigned int numEntries=0, unsigned int numTargets=1 )
+  {
+    configure( numEntries, numTargets );
+  }
+  void configure( unsigned int numEntries, unsigned int numTargets )
+  {
+    if( numEntries > 0 && numTargets == 0 )
+      throw std::runtime_error("MSHRFile: an MSHR needs at least one target, for its primary miss.");
+    m_numEntries = numEntries;
+    m_numTargets = numTargets;
+    m_entries.clear();
+    m_entries.reserve( numEntries );
+  }
+  bool          enabled()         { return m_numEntries != 0; }
+  unsigned int  getNumEntries()   { return m_numEntries; }
+  unsigned int  getNumTargets()   { return m_numTargets; }
+  MSHRStats&    getStats()        { return m_stats; }
+
+  // The fills still in flight at now.
+  size_t inFlight( TIME now )
+  {
+    retire( now );
+    return m_entries.size();
+  }
+
+  bool merge( uint64_t lineAddress, TIME now, TIME& ready )
+  {
+    retire( now );
+    for( size_t ii = 0; ii < m_entries.size(); ii++) {
+      if( m_entries[ii].lineAddress != lineAddress ) continue;
+      if( m_entries[ii].targets < m_numTargets ) {
+        m_entries[ii].targets++;
+        m_stats.secondaryMisses++;
+      } else {
+        m_stats.targetStalls++;
+      }
+      ready = m_entries[ii].ready;
+      return true;
+    }
+    return false;
+  }
+
+  TIME issue( TIME now )
+  {
+    retire( now );
+    if( m_entries.size() < m_numEntries ) return now;
+    m_stats.fullStalls++;
+    TIME first = m_entries[0].ready;
+    for( size_t ii = 1; ii < m_entries.size(); ii++) {
+      if( m_entries[ii].ready < first ) first = m_entries[ii].ready;
+    }
+    retire( first );
+    return first;
+  }
+  bool tryIssue( TIME now )
+  {
+    retire( now );
+    return m_entries.size() < m_numEntries;
+  }
+
+  // demand: a primary miss, rather than a prefetch
+  void allocate( uint64_t lineAddress, TIME ready, bool demand=true )
+  {
+    Entry entry;
+    entry.lineAddress = lineAddress;
+    entry.ready = ready;
+    entry.targets = demand ? 1 : 0;
+    m_entries.push_back( entry );
+    if( demand ) m_stats.primaryMisses++;
+  }
+
+private:
+  // Drop the entries whose data is back by now.
+  void retire( TIME now )
+  {
+    size_t kept = 0;
+    for( size_t ii = 0; ii < m_entries.size(); ii++) {
+      if( !(m_entries[ii].ready > now) ) continue;
+      m_entries[kept++] = m_entries[ii];
+    }
+    m_entries.resize( kept );
+  }
+
+  unsigned int        m_numEntries;
+  unsigned int        m_numTargets;
+  std::vector<Entry>  m_entries;      // in flight, at most m_numEntries
+  MSHRStats           m_stats;
+};
+
+#endif
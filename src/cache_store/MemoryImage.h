@@ -0,0 +1,262 @@
+// Program and data images for the memory models (SparseMemory, MappedMemory, SimplestMemory loadImage). No SystemC
+// needed. A MemoryImage reads an image file into the segments it puts in memory, for the memory to copy or, where
+// page alignment allows, adopt or map straight from the file.
+//
+// Formats (see ImageFormat_t); detectImageFormat picks one from the file name and its first bytes:
+//  - ImageRaw      - the bytes of the file, as one segment at loadAddress (any other file)
+//  - ImageIntelHex - Intel HEX records: data, end of file, extended segment and linear addresses; one segment per
+//                    run of contiguous data (*.hex, *.ihex, *.ihx)
+//  - ImageELF      - the PT_LOAD segments of a 32- or 64-bit ELF file of the host's byte order, at their physical
+//                    addresses; a segment's memory past its file data (.bss) is zero (files starting with \x7fELF)
+// ELF and Intel HEX segments are placed at their own addresses plus loadAddress.
+//
+// The file is mmapped, privately and writable, and raw and ELF segments point straight into the mapping: a memory
+// may take whole pages of them as its own without copying, and writes to those pages then stay in the process (the
+// kernel copies a page on its first write). The mapping lasts as long as the MemoryImage, so a memory that adopted
+// pages keeps the image (see SparseMemory::loadImage). Intel HEX is parsed into buffers of its own.
+//
+// API
+//  - getSegments() - address, data, fileSize, memSize and fileOffset (for mmap; -1 if the data is not in the file)
+//  - getFd()       - the file, to map segments from
+//  - contains(p)   - does p point into the mapping of the file?
+//  - getEntry()    - the ELF entry point, or the start address of Intel HEX (0 if none)
+
+#ifndef MemoryImage_H
+#define MemoryImage_H
+
+#include <stdint.h>
+#include <string.h>     // memcmp, memchr
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <fcntl.h>      // open
+#include <unistd.h>     // read, close
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // fstat
+#include <elf.h>
+
+enum ImageFormat_t { ImageRaw, ImageIntelHex, ImageELF };
+
+inline ImageFormat_t detectImageFormat( const std::string& path )
+{
+  const char* hexSuffixes[] = { ".hex", ".ihex", ".ihx" };
+  for( size_t ii = 0; ii < sizeof(hexSuffixes) / sizeof(hexSuffixes[0]); ii++) {
+    size_t n = strlen( hexSuffixes[ii] );
+    if( path.size() > n && path.compare(path.size() - n, n, hexSuffixes[ii]) == 0 ) return ImageIntelHex;
+  }
+  unsigned char magic[SELFMAG] = { 0 };
+  int fd = open( path.c_str(), O_RDONLY );
+  if( fd < 0 ) throw std::runtime_error("MemoryImage: cannot open " + path);
+  ssize_t n = read( fd, magic, SELFMAG );
+  close( fd );
+  return n == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0 ? ImageELF : ImageRaw;
+}
+
+class MemoryImage
+{
+public:
+  struct Segment
+  {
+    uint64_t              address;      // byte address in the simulated memory
+    const unsigned char*  data;         // fileSize bytes
+    uint64_t              fileSize;
+    uint64_t              memSize;      // fileSize or more: the rest is zero
+    int64_t               fileOffset;   // where data is in the file; -1 if it is not
+  };
+
+  MemoryImage( const std::string& path, ImageFormat_t format, uint64_t loadAddress=0 )
+  : m_path( path )
+  , m_fd( -1 )
+  , m_mapping( NULL )
+  , m_mappingBytes( 0 )
+  , m_entry( 0 )
+  {
+    m_fd = open( path.c_str(), O_RDONLY );
+    if( m_fd < 0 ) throw std::runtime_error("MemoryImage: cannot open " + path);
+    struct stat st;
+    if( fstat(m_fd, &st) != 0 ) fail("cannot stat");
+    m_mappingBytes = st.st_size;
+    if( m_mappingBytes > 0 ) {
+      m_mapping = mmap( NULL, m_mappingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_fd, 0 );
+      if( m_mapping == MAP_FAILED ) {
+        m_mapping = NULL;
+        fail("cannot map");
+      }
+    }
+    try {
+      switch( format ) {
+        case ImageRaw:      addSegment( loadAddress, 0, m_mappingBytes, m_mappingBytes ); break;
+        case ImageIntelHex: parseIntelHex( loadAddress ); break;
+        case ImageELF:      parseELF( loadAddress ); break;
+      }
+    }
+    catch( ... ) {
+      unmap();
+      throw;
+    }
+  }
+  ~MemoryImage()
+  {
+    unmap();
+  }
+
+  const std::vector<Segment>& getSegments() const { return m_segments; }
+  int       getFd() const       { return m_fd; }
+  uint64_t  getEntry() const    { return m_entry; }
+
+  bool contains( const void* p ) const
+  {
+    const unsigned char* byte = static_cast<const unsigned char*>( p );
+    const unsigned char* first = static_cast<const unsigned char*>( m_mapping );
+    return m_mapping != NULL && byte >= first && byte < first + m_mappingBytes;
+  }
+
+private:
+  MemoryImage(const MemoryImage&);
+  MemoryImage& operator=(const MemoryImage&);
+
+  void fail( const std::string& what )
+  {
+    unmap();
+    throw std::runtime_error("MemoryImage: " + what + " " + m_path);
+  }
+  void unmap()
+  {
+    if( m_mapping != NULL ) munmap( m_mapping, m_mappingBytes );
+    if( m_fd >= 0 ) close( m_fd );
+    m_mapping = NULL;
+    m_fd = -1;
+  }
+
+  const unsigned char* bytes() const { return static_cast<const unsigned char*>( m_mapping ); }
+
+  // a segment of the file's own bytes
+  void addSegment( uint64_t address, uint64_t fileOffset, uint64_t fileSize, uint64_t memSize )
+  {
+    if( fileOffset > m_mappingBytes || fileSize > m_mappingBytes - fileOffset ) fail("segment past the end of");
+    Segment segment;
+    segment.address = address;
+    segment.data = bytes() + fileOffset;
+    segment.fileSize = fileSize;
+    segment.memSize = memSize;
+    segment.fileOffset = fileOffset;
+    m_segments.push_back( segment );
+  }
+
+  void parseELF( uint64_t loadAddress )
+  {
+    if( m_mappingBytes < EI_NIDENT || memcmp(bytes(), ELFMAG, SELFMAG) != 0 ) fail("not an ELF file:");
+    const unsigned char hostData = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ? ELFDATA2LSB : ELFDATA2MSB;
+    if( bytes()[EI_DATA] != hostData ) fail("ELF of the other byte order:");
+    if( bytes()[EI_CLASS] == ELFCLASS64 ) parseELFSegments<Elf64_Ehdr, Elf64_Phdr>( loadAddress );
+    else if( bytes()[EI_CLASS] == ELFCLASS32 ) parseELFSegments<Elf32_Ehdr, Elf32_Phdr>( loadAddress );
+    else fail("unknown ELF class:");
+  }
+
+  template <class EHDR, class PHDR>
+  void parseELFSegments( uint64_t loadAddress )
+  {
+    if( m_mappingBytes < sizeof(EHDR) ) fail("truncated ELF header:");
+    EHDR header;
+    memcpy( &header, bytes(), sizeof(header) );
+    m_entry = header.e_entry;
+    if( header.e_phnum > 0 && header.e_phentsize < sizeof(PHDR) ) fail("bad ELF program headers:");
+    if( header.e_phoff > m_mappingBytes || (uint64_t)header.e_phnum * header.e_phentsize > m_mappingBytes - header.e_phoff ) {
+      fail("truncated ELF program headers:");
+    }
+    for( unsigned int ii = 0; ii < header.e_phnum; ii++) {
+      PHDR program;
+      memcpy( &program, bytes() + header.e_phoff + (uint64_t)ii * header.e_phentsize, sizeof(program) );
+      if( program.p_type != PT_LOAD || program.p_memsz == 0 ) continue;
+      if( program.p_filesz > program.p_memsz ) fail("ELF segment larger in the file than in memory:");
+      addSegment( loadAddress + program.p_paddr, program.p_offset, program.p_filesz, program.p_memsz );
+    }
+  }
+
+  void parseIntelHex( uint64_t loadAddress )
+  {
+    const char* pos = reinterpret_cast<const char*>( bytes() );
+    const char* end = pos + m_mappingBytes;
+    uint64_t base = 0;    // from extended segment or linear address records
+    unsigned int lineNumber = 0;
+    bool done = false;
+    while( pos < end && !done ) {
+      const char* eol = static_cast<const char*>( memchr(pos, '\n', end - pos) );
+      if( eol == NULL ) eol = end;
+      const char* line = pos;
+      const char* lineEnd = eol;
+      pos = eol + (eol < end ? 1 : 0);
+      lineNumber++;
+      while( lineEnd > line && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ') ) lineEnd--;
+      if( line == lineEnd ) continue;
+      if( *line != ':' || (lineEnd - line) % 2 != 1 || lineEnd - line < 11 ) hexError( lineNumber );
+
+      // the record's bytes: count, address (2), type, data, checksum
+      std::vector<unsigned char> record( (lineEnd - line) / 2 );
+      unsigned char sum = 0;
+      for( size_t ii = 0; ii < record.size(); ii++) {
+        int high = hexDigit( line[1 + 2 * ii] ), low = hexDigit( line[2 + 2 * ii] );
+        if( high < 0 || low < 0 ) hexError( lineNumber );
+        record[ii] = high << 4 | low;
+        sum += record[ii];
+      }
+      unsigned int count = record[0];
+      if( record.size() != count + 5 || sum != 0 ) hexError( lineNumber );
+      uint64_t offset = record[1] << 8 | record[2];
+      const unsigned char* data = &record[4];
+      if( (record[3] == 0x02 || record[3] == 0x04) && count != 2 ) hexError( lineNumber );
+      if( (record[3] == 0x03 || record[3] == 0x05) && count != 4 ) hexError( lineNumber );
+      switch( record[3] ) {
+        case 0x00: addHexData( loadAddress + base + offset, data, count ); break;
+        case 0x01: done = true; break;
+        case 0x02: base = (uint64_t)(data[0] << 8 | data[1]) << 4; break;
+        case 0x03: m_entry = (uint64_t)(data[0] << 8 | data[1]) << 4 | (data[2] << 8 | data[3]); break;
+        case 0x04: base = (uint64_t)(data[0] << 8 | data[1]) << 16; break;
+        case 0x05: m_entry = (uint64_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]; break;
+        default:   hexError( lineNumber );
+      }
+    }
+    // the segments point into the runs now that they are done growing
+    for( size_t ii = 0; ii < m_runs.size(); ii++) {
+      Segment segment;
+      segment.address = m_runAddresses[ii];
+      segment.data = m_runs[ii].empty() ? NULL : &m_runs[ii][0];
+      segment.fileSize = segment.memSize = m_runs[ii].size();
+      segment.fileOffset = -1;
+      m_segments.push_back( segment );
+    }
+  }
+
+  // Data record: extends the run it continues, else starts a new one
+  void addHexData( uint64_t address, const unsigned char* data, unsigned int count )
+  {
+    if( m_runs.empty() || m_runAddresses.back() + m_runs.back().size() != address ) {
+      m_runAddresses.push_back( address );
+      m_runs.push_back( std::vector<unsigned char>() );
+    }
+    m_runs.back().insert( m_runs.back().end(), data, data + count );
+  }
+
+  static int hexDigit( char c )
+  {
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+  }
+  void hexError( unsigned int lineNumber )
+  {
+    fail("bad Intel HEX record at line " + std::to_string(lineNumber) + " of");
+  }
+
+  std::string   m_path;
+  int           m_fd;
+  void*         m_mapping;
+  uint64_t      m_mappingBytes;
+  uint64_t      m_entry;
+  std::vector<Segment>  m_segments;
+  std::vector<uint64_t> m_runAddresses;               // Intel HEX data, one run per segment
+  std::vector< std::vector<unsigned char> > m_runs;
+};
+
+#endif
@@ -0,0 +1,187 @@
+// Radix page table: maps page numbers to pages the way a hardware MMU walk does, for the memory models (see
+// SparseMemory). LEVELS levels of LEVEL_BITS bits each cover MAX_PAGES page numbers: with 4 KiB pages that is the
+// whole 64-bit byte address space. A lookup is LEVELS dependent loads, no hashing.
+// Interior nodes are allocated on the first insert below them, and never freed until the table is.
+// The table does not own the pages: whoever inserts them frees them (e.g. through forEach before the table goes).
+// PAGE is the type the pages are made of, e.g. uint32_t for pages of words.
+//
+// API
+//  - find(pageID)     - the page, or NULL if none was inserted
+//  - insert(pageID,page) - maps pageID to page, replacing what it was mapped to
+//  - forEach(f)       - f(pageID,page) for every page, in increasing order of pageID
+//  - size()           - the number of pages
+//
+// PageTLBT is a small direct-mapped cache of recent translations, for the memory model to check before walking its
+// page table; a page number's entry is pageID % ENTRIES. Whoever maps or unmaps a page must invalidate its
+// translation (SparseMemory::mapPage does).
+//  - find(pageID)      - the page if its translation is cached, else NULL (then walk, and fill)
+//  - fill(pageID,page) - caches the translation
+//  - invalidate(pageID) / flush() - drops the translation of one page / of all of them
+//  - getStats()        - lookups, hits and invalidations (see PageTLBStats in CacheStats.h)
+
+#ifndef PageTable_H
+#define PageTable_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdexcept>
+
+#include "CacheStats.h"
+
+template <class PAGE>
+class PageTableT
+{
+public:
+  enum { LEVELS = 4, LEVEL_BITS = 13, FANOUT = 1 << LEVEL_BITS };   // a node is 64 KiB of pointers
+  static const uint64_t MAX_PAGES = 1ULL << (LEVELS * LEVEL_BITS);
+
+  PageTableT()
+  : m_root( new Node() )
+  , m_size( 0 )
+  {
+  }
+  ~PageTableT()
+  {
+    freeNode( m_root, 0 );
+  }
+
+  PAGE* find( uint64_t pageID ) const
+  {
+    const Node* node = m_root;
+    for( int level = 0; level < LEVELS - 1; level++) {
+      node = static_cast<const Node*>( node->entries[index(pageID, level)] );
+      if( node == NULL ) return NULL;
+    }
+    return static_cast<PAGE*>( node->entries[index(pageID, LEVELS - 1)] );
+  }
+
+  void insert( uint64_t pageID, PAGE* page )
+  {
+    if( pageID >= MAX_PAGES ) throw std::runtime_error("PageTable: page number out of range.");
+    Node* node = m_root;
+    for( int level = 0; level < LEVELS - 1; level++) {
+      void*& entry = node->entries[index(pageID, level)];
+      if( entry == NULL ) entry = new Node();
+      node = static_cast<Node*>( entry );
+    }
+    void*& entry = node->entries[index(pageID, LEVELS - 1)];
+    if( entry == NULL && page != NULL ) m_size++;
+    if( entry != NULL && page == NULL ) m_size--;
+    entry = page;
+  }
+
+  template <class FUNCTION>
+  void forEach( FUNCTION f ) const
+  {
+    forEachIn( m_root, 0, 0, f );
+  }
+
+  size_t size() const
+  {
+    return m_size;
+  }
+
+private:
+  PageTableT(const PageTableT&);
+  PageTableT& operator=(const PageTableT&);
+
+  struct Node
+  {
+    void* entries[FANOUT];
+    Node() : entries() {}
+  };
+
+  static size_t index( uint64_t pageID, int level )
+  {
+    return (pageID >> ((LEVELS - 1 - level) * LEVEL_BITS)) & (FANOUT - 1);
+  }
+
+  template <class FUNCTION>
+  static void forEachIn( const Node* node, int level, uint64_t prefix, FUNCTION& f )
+  {
+    for( size_t ii = 0; ii < FANOUT; ii++) {
+      if( node->entries[ii] == NULL ) continue;
+      uint64_t pageID = (prefix << LEVEL_BITS) | ii;
+      if( level == LEVELS - 1 ) f( pageID, static_cast<PAGE*>(node->entries[ii]) );
+      else                      forEachIn( static_cast<const Node*>(node->entries[ii]), level + 1, pageID, f );
+    }
+  }
+
+  static void freeNode( Node* node, int level )
+  {
+    if( level < LEVELS - 1 ) {
+      for( size_t ii = 0; ii < FANOUT; ii++) {
+        if( node->entries[ii] != NULL ) freeNode( static_cast<Node*>(node->entries[ii]), level + 1 );
+      }
+    }
+    delete node;
+  }
+
+  Node*   m_root;
+  size_t  m_size;
+};
+
+template <class PAGE, unsigned int ENTRIES=16>
+class PageTLBT
+{
+public:
+  PageTLBT()
+  {
+    static_assert( (ENTRIES & (ENTRIES - 1)) == 0, "PageTLBT: ENTRIES must be a power of 2" );
+  }
+
+  PAGE* find( uint64_t pageID )
+  {
+    m_stats.lookups++;
+    const Entry& entry = m_entries[pageID & (ENTRIES - 1)];
+    if( entry.pageID != pageID ) return NULL;
+    m_stats.hits++;
+    return entry.page;
+  }
+
+  void fill( uint64_t pageID, PAGE* page )
+  {
+    Entry& entry = m_entries[pageID & (ENTRIES - 1)];
+    entry.pageID = pageID;
+    entry.page = page;
+  }
+
+  void invalidate( uint64_t pageID )
+  {
+    Entry& entry = m_entries[pageID & (ENTRIES - 1)];
+    if( entry.pageID != pageID ) return;
+    entry.pageID = INVALID;
+    entry.page = NULL;
+    m_stats.invalidations++;
+  }
+
+  void flush()
+  {
+    for( unsigned int ii = 0; ii < ENTRIES; ii++) {
+      if( m_entries[ii].pageID != INVALID ) m_stats.invalidations++;
+      m_entries[ii].pageID = INVALID;
+      m_entries[ii].page = NULL;
+    }
+  }
+
+  PageTLBStats& getStats()
+  {
+    return m_stats;
+  }
+
+private:
+  // no page number is this large (see PageTableT::MAX_PAGES)
+  static const uint64_t INVALID = ~0ULL;
+
+  struct Entry
+  {
+    uint64_t  pageID;
+    PAGE*     page;
+    Entry() : pageID( INVALID ), page( NULL ) {}
+  };
+
+  Entry         m_entries[ENTRIES];
+  PageTLBStats  m_stats;
+};
+
+#endif
@@ -0,0 +1,166 @@
+// Hardware prefetcher models for a cache level (see RealCacheT::setPrefetcher).
+// A prefetcher watches the demand miss stream of a cache, at line granularity, and is told about
+//  - train(lineAddress,candidates) - a demand miss, or the first demand hit on a line it prefetched (so a
+//                                    prefetcher that is ahead of its stream stays ahead)
+// and appends the addresses of the lines it wants fetched to candidates. The cache drops candidates it already
+// holds, so a prefetcher does not need to remember what it has issued.
+// Every prefetcher has
+//  - degree   - how many lines it asks for per trigger
+//  - distance - how far ahead of the triggering line the first of them is, in lines (or strides); 1 is the next one
+//
+// Available prefetchers (see Prefetcher_t):
+//  - PrefetchNone     - no prefetcher; createPrefetcher returns NULL
+//  - PrefetchNextLine - the lines following every miss
+//  - PrefetchStride   - one stride detector over the whole miss stream (a TLM target sees no PC to key it by):
+//                       once two consecutive misses are the same stride apart, it prefetches along that stride
+//  - PrefetchStream   - a small table of stream buffers. A miss within a window of lines of a stream's head, in the
+//                       stream's direction, advances it and prefetches ahead of it; any other miss replaces the
+//                       least recently used stream. A new stream learns its direction from its second miss.
+
+#ifndef Prefetcher_H
+#define Prefetcher_H
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>    // max
+#include <stdexcept>
+
+enum Prefetcher_t { PrefetchNone, PrefetchNextLine, PrefetchStride, PrefetchStream };
+
+class Prefetcher
+{
+public:
+  Prefetcher( uint64_t lineSize, unsigned int degree, unsigned int distance )
+  : m_lineSize( lineSize )
+  , m_degree( degree )
+  , m_distance( distance )
+  {
+    if( lineSize == 0 || degree == 0 ) throw std::runtime_error("Prefetcher: lineSize and degree must not be 0.");
+  }
+  virtual ~Prefetcher() {}
+  virtual Prefetcher_t getType() = 0;
+  virtual void  train( uint64_t lineAddress, std::vector<uint64_t>& candidates ) = 0;
+
+  unsigned int  getDegree()     { return m_degree; }
+  unsigned int  getDistance()   { return m_distance; }
+
+protected:
+  // degree lines, starting distance steps (of step bytes) from lineAddress. Stops at address 0.
+  void issue( uint64_t lineAddress, int64_t step, std::vector<uint64_t>& candidates )
+  {
+    for( unsigned int ii = 0; ii < m_degree; ii++) {
+      int64_t offset = step * (int64_t)(m_distance + ii);
+      if( offset < 0 && (uint64_t)(-offset) > lineAddress ) break;
+      candidates.push_back( lineAddress + offset );
+    }
+  }
+
+  uint64_t      m_lineSize;
+  unsigned int  m_degree;
+  unsigned int  m_distance;
+};
+
+class NextLinePrefetcher : public Prefetcher
+{
+public:
+  NextLinePrefetcher( uint64_t lineSize, unsigned int degree, unsigned int distance )
+  : Prefetcher( lineSize, degree, distance )
+  {}
+  virtual Prefetcher_t getType() { return PrefetchNextLine; }
+  virtual void train( uint64_t lineAddress, std::vector<uint64_t>& candidates )
+  {
+    issue( lineAddress, (int64_t)m_lineSize, candidates );
+  }
+};
+
+// Remembers the last miss and the stride that led to it.
+class StridePrefetcher : public Prefetcher
+{
+public:
+  StridePrefetcher( uint64_t lineSize, unsigned int degree, unsigned int distance )
+  : Prefetcher( lineSize, degree, distance )
+  , m_lastAddress( 0 )
+  , m_lastStride( 0 )
+  , m_trained( false )
+  {}
+  virtual Prefetcher_t getType() { return PrefetchStride; }
+  virtual void train( uint64_t lineAddress, std::vector<uint64_t>& candidates )
+  {
+    int64_t stride = (int64_t)(lineAddress - m_lastAddress);
+    if( m_trained && stride != 0 && stride == m_lastStride ) issue( lineAddress, stride, candidates );
+    m_lastStride = stride;
+    m_lastAddress = lineAddress;
+    m_trained = true;
+  }
+protected:
+  uint64_t  m_lastAddress;
+  int64_t   m_lastStride;
+  bool      m_trained;      // m_lastAddress holds a real miss
+};
+
+class StreamPrefetcher : public Prefetcher
+{
+public:
+  StreamPrefetcher( uint64_t lineSize, unsigned int degree, unsigned int distance, unsigned int numStreams=8 )
+  : Prefetcher( lineSize, degree, distance )
+  , m_window( std::max(degree + distance, 4u) )
+  , m_streams( numStreams ? numStreams : 1 )
+  , m_clock( 0 )
+  {}
+  virtual Prefetcher_t getType() { return PrefetchStream; }
+  virtual void train( uint64_t lineAddress, std::vector<uint64_t>& candidates )
+  {
+    m_clock++;
+    size_t lru = 0;
+    for( size_t ii = 0; ii < m_streams.size(); ii++) {
+      Stream& s = m_streams[ii];
+      if( s.lastUse < m_streams[lru].lastUse ) lru = ii;
+      if( s.lastUse == 0 ) continue;
+      // distance from the head in lines, positive in the stream's direction
+      int64_t delta = ((int64_t)(lineAddress - s.head)) / (int64_t)m_lineSize;
+      if( delta == 0 ) {
+        s.lastUse = m_clock;
+        return;
+      }
+      if( s.direction == 0 ) {
+        if( delta < -(int64_t)m_window || delta > (int64_t)m_window ) continue;
+        s.direction = delta > 0 ? 1 : -1;
+      } else if( delta * s.direction <= 0 || delta * s.direction > (int64_t)m_window ) {
+        continue;
+      }
+      s.head = lineAddress;
+      s.lastUse = m_clock;
+      issue( lineAddress, s.direction * (int64_t)m_lineSize, candidates );
+      return;
+    }
+    // no stream claims the miss: it starts a new one
+    m_streams[lru].head = lineAddress;
+    m_streams[lru].direction = 0;
+    m_streams[lru].lastUse = m_clock;
+  }
+protected:
+  struct Stream
+  {
+    uint64_t  head;         // the last line of the stream that was demanded
+    int64_t   direction;    // +1, -1, or 0 while the stream has seen one miss only
+    uint64_t  lastUse;      // m_clock of the last miss that hit the stream; 0 for an unused entry
+    Stream() : head(0), direction(0), lastUse(0) {}
+  };
+  uint64_t              m_window;     // how many lines past its head a miss may be and still belong to a stream
+  std::vector<Stream>   m_streams;
+  uint64_t              m_clock;
+};
+
+// Returns NULL for PrefetchNone.
+inline Prefetcher* createPrefetcher( Prefetcher_t type, uint64_t lineSize, unsigned int degree=1, unsigned int distance=1 )
+{
+  switch( type ) {
+    case PrefetchNone:      return NULL;
+    case PrefetchNextLine:  return new NextLinePrefetcher( lineSize, degree, distance );
+    case PrefetchStride:    return new StridePrefetcher( lineSize, degree, distance );
+    case PrefetchStream:    return new StreamPrefetcher( lineSize, degree, distance );
+  }
+  throw std::runtime_error("createPrefetcher: unknown prefetcher.");
+}
+
+#endif
@@ -0,0 +1,281 @@
+// Replacement policies for CacheStore.
+// A policy keeps compact per-block (per-set) metadata and is told about every
+//  - touch(block,way) - a hit on a line
+//  - fill(block,way)  - a line newly allocated into a way
+// and is asked for
+//  - victim(block)    - the way to evict when a block has no empty way left.
+// All victim selections are O(1) except tree-PLRU which is O(log numWays).
+// For checkpoints, saveState/loadState copy the metadata out and back in as raw bytes.
+//
+// Available policies (see ReplacementPolicy_t):
+//  - ReplLRU      - true LRU, a doubly linked recency list per block (2 bytes per way)
+//  - ReplTreePLRU - tree pseudo-LRU, numWays-1 bits per block; numWays must be a power of 2 <= 64
+//  - ReplFIFO     - oldest fill is evicted, a round-robin pointer per block
+//  - ReplRandom   - a random way, from a small xorshift generator per block
+
+#ifndef ReplacementPolicy_H
+#define ReplacementPolicy_H
+
+#include <stdint.h>
+#include <string.h>     // memcpy
+#include <vector>
+#include <stdexcept>
+
+enum ReplacementPolicy_t { ReplLRU, ReplTreePLRU, ReplFIFO, ReplRandom };
+
+struct ReplacementPolicy
+{
+  virtual ~ReplacementPolicy() {}
+  virtual ReplacementPolicy_t getType() = 0;
+  virtual void      touch( uint64_t cacheBlockIndex, uint64_t way ) = 0;
+  virtual void      fill( uint64_t cacheBlockIndex, uint64_t way ) = 0;
+  virtual uint64_t  victim( uint64_t cacheBlockIndex ) = 0;
+  // Hint that touch/fill/victim will soon be called for this block (see CacheStore::lookupMany).
+  virtual void      prefetch( uint64_t cacheBlockIndex ) {}
+  // The metadata as raw bytes (see CacheCheckpoint.h). loadState returns false, and leaves the metadata alone,
+  // unless len is exactly what saveState of a policy of the same type and geometry writes.
+  virtual void      saveState( std::vector<uint8_t>& out ) = 0;
+  virtual bool      loadState( const uint8_t* in, size_t len ) = 0;
+
+protected:
+  template <class T>
+  static void appendState( std::vector<uint8_t>& out, const std::vector<T>& v )
+  {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>( v.data() );
+    out.insert( out.end(), p, p + v.size() * sizeof(T) );
+  }
+  template <class T>
+  static const uint8_t* takeState( const uint8_t* in, std::vector<T>& v )
+  {
+    memcpy( v.data(), in, v.size() * sizeof(T) );
+    return in + v.size() * sizeof(T);
+  }
+};
+
+// True LRU. Each block keeps its ways in a doubly linked list ordered from MRU (head) to LRU (tail).
+// A touch moves the way to the head, the victim is the tail.
+class LRUReplacementPolicy : public ReplacementPolicy
+{
+public:
+  LRUReplacementPolicy( uint64_t numCacheBlocks, uint64_t numWays )
+  : m_numWays( numWays )
+  , m_next( numCacheBlocks * numWays )
+  , m_prev( numCacheBlocks * numWays )
+  , m_head( numCacheBlocks )
+  , m_tail( numCacheBlocks )
+  {
+    if( numWays > 256 ) throw std::runtime_error("LRUReplacementPolicy: at most 256 ways are supported.");
+    // Initially way 0 is the LRU and numWays-1 the MRU, so an untouched block evicts ways in order.
+    for( uint64_t bb = 0; bb < numCacheBlocks; bb++) {
+      uint64_t base = bb * m_numWays;
+      for( uint64_t ww = 0; ww < m_numWays; ww++) {
+        m_next[base + ww] = (uint8_t)(ww - 1);    // towards the LRU end
+        m_prev[base + ww] = (uint8_t)(ww + 1);    // towards the MRU end
+      }
+      m_head[bb] = (uint8_t)(m_numWays - 1);
+      m_tail[bb] = 0;
+    }
+  }
+  virtual ReplacementPolicy_t getType() { return ReplLRU; }
+  virtual void touch( uint64_t cacheBlockIndex, uint64_t way )
+  {
+    uint8_t head = m_head[cacheBlockIndex];
+    if( head == way ) return;
+    uint64_t base = cacheBlockIndex * m_numWays;
+    // unlink
+    uint8_t next = m_next[base + way];
+    uint8_t prev = m_prev[base + way];
+    m_next[base + prev] = next;
+    if( m_tail[cacheBlockIndex] == way ) m_tail[cacheBlockIndex] = prev;
+    else                                 m_prev[base + next] = prev;
+    // insert at the head
+    m_next[base + way] = head;
+    m_prev[base + head] = (uint8_t)way;
+    m_head[cacheBlockIndex] = (uint8_t)way;
+  }
+  virtual void fill( uint64_t cacheBlockIndex, uint64_t way )
+  {
+    touch( cacheBlockIndex, way );
+  }
+  virtual uint64_t victim( uint64_t cacheBlockIndex )
+  {
+    return m_tail[cacheBlockIndex];
+  }
+  virtual void prefetch( uint64_t cacheBlockIndex )
+  {
+    __builtin_prefetch( &m_head[cacheBlockIndex] );
+    __builtin_prefetch( &m_tail[cacheBlockIndex] );
+    __builtin_prefetch( &m_next[cacheBlockIndex * m_numWays] );
+    __builtin_prefetch( &m_prev[cacheBlockIndex * m_numWays] );
+  }
+  virtual void saveState( std::vector<uint8_t>& out )
+  {
+    appendState( out, m_next );
+    appendState( out, m_prev );
+    appendState( out, m_head );
+    appendState( out, m_tail );
+  }
+  virtual bool loadState( const uint8_t* in, size_t len )
+  {
+    if( len != m_next.size() + m_prev.size() + m_head.size() + m_tail.size() ) return false;
+    in = takeState( in, m_next );
+    in = takeState( in, m_prev );
+    in = takeState( in, m_head );
+    takeState( in, m_tail );
+    return true;
+  }
+protected:
+  uint64_t              m_numWays;
+  std::vector<uint8_t>  m_next;
+  std::vector<uint8_t>  m_prev;
+  std::vector<uint8_t>  m_head;
+  std::vector<uint8_t>  m_tail;
+};
+
+// Tree pseudo-LRU. The ways are the leaves of a binary tree whose numWays-1 internal nodes each hold
+// one bit pointing at the half that was used least recently. Nodes are numbered heap style (root=1,
+// children of n are 2n and 2n+1), so bit n of the block's word is node n.
+class TreePLRUReplacementPolicy : public ReplacementPolicy
+{
+public:
+  TreePLRUReplacementPolicy( uint64_t numCacheBlocks, uint64_t numWays )
+  : m_numWays( numWays )
+  , m_bits( numCacheBlocks, 0 )
+  {
+    if( numWays > 64 || (numWays & (numWays - 1)) != 0 )
+      throw std::runtime_error("TreePLRUReplacementPolicy: numWays must be a power of 2, at most 64.");
+  }
+  virtual ReplacementPolicy_t getType() { return ReplTreePLRU; }
+  virtual void touch( uint64_t cacheBlockIndex, uint64_t way )
+  {
+    uint64_t bits = m_bits[cacheBlockIndex];
+    // Walk from the leaf to the root, pointing every node away from the touched way.
+    for( uint64_t node = m_numWays + way; node > 1; node >>= 1) {
+      uint64_t parent = node >> 1;
+      if( node & 1 ) bits &= ~(1ULL << parent);   // came from the right, so LRU is left (0)
+      else           bits |=  (1ULL << parent);   // came from the left,  so LRU is right (1)
+    }
+    m_bits[cacheBlockIndex] = bits;
+  }
+  virtual void fill( uint64_t cacheBlockIndex, uint64_t way )
+  {
+    touch( cacheBlockIndex, way );
+  }
+  virtual uint64_t victim( uint64_t cacheBlockIndex )
+  {
+    uint64_t bits = m_bits[cacheBlockIndex];
+    uint64_t node = 1;
+    while( node < m_numWays ) {
+      node = (node << 1) | ((bits >> node) & 1);
+    }
+    return node - m_numWays;
+  }
+  virtual void prefetch( uint64_t cacheBlockIndex )
+  {
+    __builtin_prefetch( &m_bits[cacheBlockIndex] );
+  }
+  virtual void saveState( std::vector<uint8_t>& out )
+  {
+    appendState( out, m_bits );
+  }
+  virtual bool loadState( const uint8_t* in, size_t len )
+  {
+    if( len != m_bits.size() * sizeof(uint64_t) ) return false;
+    takeState( in, m_bits );
+    return true;
+  }
+protected:
+  uint64_t              m_numWays;
+  std::vector<uint64_t> m_bits;
+};
+
+// FIFO. A per-block pointer to the oldest fill; it moves on when that way is (re)filled.
+class FIFOReplacementPolicy : public ReplacementPolicy
+{
+public:
+  FIFOReplacementPolicy( uint64_t numCacheBlocks, uint64_t numWays )
+  : m_numWays( numWays )
+  , m_next( numCacheBlocks, 0 )
+  {
+    if( numWays > 65536 ) throw std::runtime_error("FIFOReplacementPolicy: at most 65536 ways are supported.");
+  }
+  virtual ReplacementPolicy_t getType() { return ReplFIFO; }
+  virtual void touch( uint64_t cacheBlockIndex, uint64_t way ) {}
+  virtual void fill( uint64_t cacheBlockIndex, uint64_t way )
+  {
+    if( m_next[cacheBlockIndex] != way ) return;
+    uint64_t next = way + 1;
+    m_next[cacheBlockIndex] = (uint16_t)( next == m_numWays ? 0 : next );
+  }
+  virtual uint64_t victim( uint64_t cacheBlockIndex )
+  {
+    return m_next[cacheBlockIndex];
+  }
+  virtual void saveState( std::vector<uint8_t>& out )
+  {
+    appendState( out, m_next );
+  }
+  virtual bool loadState( const uint8_t* in, size_t len )
+  {
+    if( len != m_next.size() * sizeof(uint16_t) ) return false;
+    takeState( in, m_next );
+    return true;
+  }
+protected:
+  uint64_t              m_numWays;
+  std::vector<uint16_t> m_next;
+};
+
+// Random. Each block has its own xorshift32 state, so the victims chosen in one block do not depend on
+// accesses to any other block.
+class RandomReplacementPolicy : public ReplacementPolicy
+{
+public:
+  RandomReplacementPolicy( uint64_t numCacheBlocks, uint64_t numWays )
+  : m_numWays( numWays )
+  , m_state( numCacheBlocks )
+  {
+    for( uint64_t bb = 0; bb < numCacheBlocks; bb++) {
+      m_state[bb] = (uint32_t)(bb * 2654435761u) | 1;   // any non-zero seed will do
+    }
+  }
+  virtual ReplacementPolicy_t getType() { return ReplRandom; }
+  virtual void touch( uint64_t cacheBlockIndex, uint64_t way ) {}
+  virtual void fill( uint64_t cacheBlockIndex, uint64_t way ) {}
+  virtual uint64_t victim( uint64_t cacheBlockIndex )
+  {
+    uint32_t x = m_state[cacheBlockIndex];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m_state[cacheBlockIndex] = x;
+    // Scale into [0,numWays) with a multiply instead of a divide.
+    return ((uint64_t)x * m_numWays) >> 32;
+  }
+  virtual void saveState( std::vector<uint8_t>& out )
+  {
+    appendState( out, m_state );
+  }
+  virtual bool loadState( const uint8_t* in, size_t len )
+  {
+    if( len != m_state.size() * sizeof(uint32_t) ) return false;
+    takeState( in, m_state );
+    return true;
+  }
+protected:
+  uint64_t              m_numWays;
+  std::vector<uint32_t> m_state;
+};
+
+inline ReplacementPolicy* createReplacementPolicy( ReplacementPolicy_t type, uint64_t numCacheBlocks, uint64_t numWays )
+{
+  switch( type ) {
+    case ReplLRU:       return new LRUReplacementPolicy( numCacheBlocks, numWays );
+    case ReplTreePLRU:  return new TreePLRUReplacementPolicy( numCacheBlocks, numWays );
+    case ReplFIFO:      return new FIFOReplacementPolicy( numCacheBlocks, numWays );
+    case ReplRandom:    return new RandomReplacementPolicy( numCacheBlocks, numWays );
+  }
+  throw std::runtime_error("createReplacementPolicy: unknown replacement policy.");
+}
+
+#endif
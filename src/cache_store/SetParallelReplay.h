@@ -0,0 +1,137 @@
+// Trace replay against one CacheStore on several host threads, with exactly the results of a serial replay.
+//
+// Sets never share state: tags, line state, data and replacement metadata are all kept per block. So the sets are
+// split into numThreads equal runs of adjacent sets, and each thread replays, in trace order, the accesses that map
+// to its own run, on its own slice of the store and without any locking. Every set sees the same accesses in the
+// same order as in a serial replay, so every access hits or misses the same way and the store ends up the same.
+// Runs of adjacent sets (rather than interleaved ones, as ShardedCacheStore uses) keep the threads' tags, state and
+// replacement metadata in different host cache lines.
+//
+// A replay(adrs,n) call works in two phases, each on all threads:
+//  - binning: thread t splits the t-th chunk of the trace into one queue of trace positions per partition
+//  - simulation: thread p takes the queues of partition p, chunk after chunk, and feeds them to lookupMany
+// Counters are kept in one partition per thread (see CacheStoreBase::setStatsPartitions), so they add up exactly.
+//
+// API
+//  - SetParallelReplayT(store,numThreads) - numThreads must be a power of 2; halved while there are fewer sets
+//  - replay(adrs,n,writes,hits) - allocates on every miss like lookupMany(adrs,n,refs,true,writes); hits[ii], if
+//    hits is given, tells whether access ii hit. Call it for consecutive pieces of a long trace.
+// The store must not be used by anything else during a replay. An eviction handler set on it is called from all
+// threads, possibly at once, so it must be thread-safe itself.
+
+#ifndef SetParallelReplay_H
+#define SetParallelReplay_H
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>    // min
+#include <thread>
+#include <stdexcept>
+
+#include "CacheStore.h"
+
+template <class CACHESTORE>
+class SetParallelReplayT
+{
+public:
+  SetParallelReplayT( CACHESTORE& store, unsigned int numThreads )
+  : m_store( store )
+  {
+    if( numThreads == 0 || (numThreads & (numThreads - 1)) != 0 )
+      throw std::runtime_error("SetParallelReplay: the number of threads must be a power of 2.");
+    while( numThreads > m_store.getNumCacheBlocks() ) numThreads /= 2;
+    m_numThreads = numThreads;
+    m_queues.resize( numThreads * numThreads );
+    // The threads' partitions of the sets are those of the counters
+    m_store.setStatsPartitions( numThreads, true );
+  }
+
+  unsigned int getNumThreads()  { return m_numThreads; }
+  unsigned int getPartition( uint64_t memoryAddress )
+  {
+    return m_store.getStatsPartition( m_store.getCacheBlockIndex(memoryAddress) );
+  }
+
+  void replay( const uint64_t* memoryAddresses, size_t n, const bool* writes=NULL, bool* hits=NULL )
+  {
+    if( m_numThreads == 1 ) {
+      CacheLineRef refs[REPLAY_BATCH];
+      for( size_t first = 0; first < n; first += REPLAY_BATCH) {
+        size_t count = std::min( n - first, (size_t)REPLAY_BATCH );
+        m_store.lookupMany( memoryAddresses + first, count, refs, true, writes ? writes + first : NULL );
+        for( size_t ii = 0; hits != NULL && ii < count; ii++) hits[first + ii] = refs[ii].isHit();
+      }
+      return;
+    }
+    std::vector<std::thread> threads;
+    for( unsigned int tt = 0; tt < m_numThreads; tt++) {
+      threads.push_back( std::thread( &SetParallelReplayT::bin, this, memoryAddresses, n, tt ) );
+    }
+    for( unsigned int tt = 0; tt < m_numThreads; tt++) threads[tt].join();
+    threads.clear();
+    for( unsigned int tt = 0; tt < m_numThreads; tt++) {
+      threads.push_back( std::thread( &SetParallelReplayT::simulate, this, memoryAddresses, writes, hits, tt ) );
+    }
+    for( unsigned int tt = 0; tt < m_numThreads; tt++) threads[tt].join();
+  }
+
+private:
+  SetParallelReplayT(const SetParallelReplayT&);
+  SetParallelReplayT& operator=(const SetParallelReplayT&);
+
+  static const size_t REPLAY_BATCH = 256;     // accesses handed to lookupMany at a time
+
+  // The queue of trace positions that chunk `chunk` has for partition `partition`.
+  std::vector<size_t>& queue( unsigned int chunk, unsigned int partition )
+  {
+    return m_queues[chunk * m_numThreads + partition];
+  }
+
+  void bin( const uint64_t* memoryAddresses, size_t n, unsigned int chunk )
+  {
+    size_t first = n * chunk / m_numThreads;
+    size_t last  = n * (chunk + 1) / m_numThreads;
+    for( unsigned int pp = 0; pp < m_numThreads; pp++) queue(chunk, pp).clear();
+    for( size_t ii = first; ii < last; ii++) {
+      queue(chunk, getPartition(memoryAddresses[ii])).push_back( ii );
+    }
+  }
+
+  // Replays the accesses of partition `partition`, chunk by chunk.
+  void simulate( const uint64_t* memoryAddresses, const bool* writes, bool* hits, unsigned int partition )
+  {
+    uint64_t     adrs[REPLAY_BATCH];
+    bool         writeFlags[REPLAY_BATCH];
+    size_t       positions[REPLAY_BATCH];
+    CacheLineRef refs[REPLAY_BATCH];
+    size_t count = 0;
+    for( unsigned int chunk = 0; chunk < m_numThreads; chunk++) {
+      const std::vector<size_t>& q = queue(chunk, partition);
+      for( size_t ii = 0; ii < q.size(); ii++) {
+        size_t pos = q[ii];
+        positions[count] = pos;
+        adrs[count] = memoryAddresses[pos];
+        writeFlags[count] = writes != NULL && writes[pos];
+        if( ++count == REPLAY_BATCH ) {
+          lookupBatch( adrs, writeFlags, positions, refs, count, hits );
+          count = 0;
+        }
+      }
+    }
+    if( count > 0 ) lookupBatch( adrs, writeFlags, positions, refs, count, hits );
+  }
+  void lookupBatch( const uint64_t* adrs, const bool* writeFlags, const size_t* positions, CacheLineRef* refs, size_t count, bool* hits )
+  {
+    m_store.lookupMany( adrs, count, refs, true, writeFlags );
+    if( hits == NULL ) return;
+    for( size_t ii = 0; ii < count; ii++) hits[positions[ii]] = refs[ii].isHit();
+  }
+
+  CACHESTORE&                       m_store;
+  unsigned int                      m_numThreads;
+  std::vector< std::vector<size_t> > m_queues;          // numThreads x numThreads, by chunk then partition
+};
+
+typedef SetParallelReplayT<CacheStore> SetParallelReplay;
+
+#endif
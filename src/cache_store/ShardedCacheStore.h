@@ -0,0 +1,155 @@
+// A CacheStore that several host threads can drive at once, e.g. cores of a trace replaying against one
+// shared LLC model.
+//
+// The cache blocks (sets) are split into shards by the low bits of their cacheBlockIndex, and each shard has its
+// own spinlock. Every call locks the one shard its address maps to, does its work on the wrapped store and unlocks,
+// so threads only contend when they hit the same shard. This is safe because everything a lookup or fill touches
+// (tags, state, data and replacement metadata) is kept per block.
+// A seqlock for read hits would not help much here: with LRU or tree-PLRU every hit updates the replacement state.
+//
+// No CacheLineRef escapes a call: data is copied in and out under the lock, or a functor is run on the line
+// while the shard is locked (withLine).
+// Per block, the results are exactly those of the single-threaded store fed the same per-block order of accesses.
+//
+// API
+//  - access(adr,allocateOnMiss)  - hit or miss, allocating on a miss if asked (trace replay)
+//  - read(adr,buffer,len)        - copies len bytes out of a cached line; false on a miss
+//  - write(adr,buffer,len)       - copies len bytes into a cached line and marks it dirty; false on a miss
+//  - fill(adr,line)              - setDataLine
+//  - invalidate(adr)
+//  - withLine(adr,allocateOnMiss,f) - f(CacheLineRef&) with the shard locked
+//  - accessMany(adrs,n,hits,allocateOnMiss) - access for n addresses
+//  - getStats()                  - the wrapped store's counters, summed over the shards
+// A CacheEvictionHandler set on the wrapped store is called with the victim's shard locked, possibly from several
+// threads at once, so it must be thread-safe itself.
+
+#ifndef ShardedCacheStore_H
+#define ShardedCacheStore_H
+
+#include <stdint.h>
+#include <string.h>     // memcpy
+#include <vector>
+#include <atomic>
+#include <thread>       // yield
+#include <stdexcept>
+
+#include "CacheStore.h"
+
+// Test-and-test-and-set spinlock, padded to a host cache line so neighbouring shards do not false-share.
+struct CacheShardLock
+{
+  std::atomic<bool> m_locked;
+  char              m_pad[64 - sizeof(std::atomic<bool>)];
+
+  CacheShardLock() : m_locked(false) {}
+  CacheShardLock(const CacheShardLock&) : m_locked(false) {}   // for std::vector; locks are never copied while held
+
+  void lock()
+  {
+    for( unsigned int spins = 0; ; spins++) {
+      if( !m_locked.exchange(true, std::memory_order_acquire) ) return;
+      while( m_locked.load(std::memory_order_relaxed) ) {
+        if( ++spins > 1000 ) { std::this_thread::yield(); spins = 0; }
+      }
+    }
+  }
+  void unlock()
+  {
+    m_locked.store(false, std::memory_order_release);
+  }
+};
+
+template <class CACHESTORE>
+class ShardedCacheStoreT
+{
+public:
+  ShardedCacheStoreT(uint64_t memorySize=pow(2,30), uint64_t cacheSize=pow(2,20), uint64_t lineSize=pow(2,3), uint64_t numWays=pow(2,0), ReplacementPolicy_t replacementPolicy=ReplLRU, uint64_t numShards=64 )
+  : m_store( memorySize, cacheSize, lineSize, numWays, replacementPolicy )
+  {
+    uint64_t numCacheBlocks = (cacheSize / lineSize) / numWays;
+    if( numShards == 0 || (numShards & (numShards - 1)) != 0 )
+      throw std::runtime_error("ShardedCacheStore: the number of shards must be a power of 2.");
+    // More shards than blocks would only leave shards empty
+    while( numShards > numCacheBlocks ) numShards /= 2;
+    m_shardMask = numShards - 1;
+    m_locks.resize( numShards );
+    // One counter partition per shard, so counting needs no more than the shard lock
+    m_store.setStatsPartitions( numShards );
+  }
+
+  uint64_t    getNumShards()              { return m_locks.size(); }
+  uint64_t    getShard( uint64_t memoryAddress )  { return m_store.getCacheBlockIndex(memoryAddress) & m_shardMask; }
+  // The wrapped store. Only for use while no other thread is calling into this one (e.g. setup, flush, checks).
+  CACHESTORE& getStore()                  { return m_store; }
+  // Only exact while no other thread is calling into this store.
+  CacheStoreStats getStats()              { return m_store.getStats(); }
+
+  bool access( uint64_t memoryAddress, bool allocateOnMiss=false )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    CacheLineRef ref = allocateOnMiss ? m_store.allocateLine(memoryAddress) : m_store.accessLine(memoryAddress);
+    return ref.isHit();
+  }
+  // len bytes at memoryAddress, all within one line
+  bool read( uint64_t memoryAddress, void* toBuffer, unsigned int len )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    CacheLineRef ref = m_store.accessLine(memoryAddress);
+    if( !ref.isHit() ) return false;
+    memcpy( toBuffer, ref.bytes() + m_store.getByteIndex(memoryAddress), len );
+    return true;
+  }
+  bool write( uint64_t memoryAddress, const void* fromBuffer, unsigned int len )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    CacheLineRef ref = m_store.accessLine(memoryAddress);
+    if( !ref.isHit() ) return false;
+    memcpy( ref.bytes() + m_store.getByteIndex(memoryAddress), fromBuffer, len );
+    ref.markDirty();
+    return true;
+  }
+  bool fill( uint64_t memoryAddress, const uint32_t* fromBuffer )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    return m_store.setDataLine( memoryAddress, fromBuffer );
+  }
+  void invalidate( uint64_t memoryAddress )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    m_store.invalidate( memoryAddress );
+  }
+  // Runs f(CacheLineRef&) on the line with its shard locked; f must not call back into this store.
+  template <class FUNCTOR>
+  bool withLine( uint64_t memoryAddress, bool allocateOnMiss, FUNCTOR f )
+  {
+    ShardGuard guard( *this, memoryAddress );
+    CacheLineRef ref = allocateOnMiss ? m_store.allocateLine(memoryAddress) : m_store.accessLine(memoryAddress);
+    f( ref );
+    return ref.isHit();
+  }
+  void accessMany( const uint64_t* memoryAddresses, size_t n, bool* hits, bool allocateOnMiss=false )
+  {
+    for( size_t ii = 0; ii < n; ii++) hits[ii] = access( memoryAddresses[ii], allocateOnMiss );
+  }
+
+private:
+  // Holds the lock of the shard an address maps to for the lifetime of the guard.
+  struct ShardGuard
+  {
+    CacheShardLock& m_lock;
+    ShardGuard( ShardedCacheStoreT& store, uint64_t memoryAddress )
+    : m_lock( store.m_locks[store.getShard(memoryAddress)] )
+    {
+      m_lock.lock();
+    }
+    ~ShardGuard() { m_lock.unlock(); }
+  };
+
+  CACHESTORE                  m_store;
+  uint64_t                    m_shardMask;
+  std::vector<CacheShardLock> m_locks;
+};
+
+typedef ShardedCacheStoreT<CacheStore> ShardedCacheStore;
+
+#endif
@@ -0,0 +1,157 @@
+// Single-pass LRU stack-distance (Mattson) analysis of an access trace.
+// The stack distance of an access is the number of distinct lines of its set accessed since the previous access
+// to its line. An LRU cache of W ways (with the same line size and number of sets) hits exactly the accesses whose
+// distance is below W, so one pass over the trace gives the misses of every associativity, i.e. of every cache
+// size sets * W * lineSize, instead of one replay per size. With one set this is the fully associative cache.
+//
+// API
+//  - StackDistance(lineSize,numSets) - lineSize and numSets must be powers of 2; sets are picked as a CacheStore
+//                                      does, by the low bits of the line index
+//  - access(adr)         - records an access; returns its stack distance, or STACK_DISTANCE_COLD for the first
+//                          access to a line
+//  - accessMany(adrs,n)  - access for n addresses
+//  - getHistogram()      - how many accesses had each distance (cold ones not included)
+//  - getMisses(ways) / getMissRatio(ways) - what an LRU cache of that many ways per set would have missed
+//  - dumpMissRatioCurve(os,maxWays) - "cacheSize ways misses missRatio" for 1, 2, 4 .. maxWays ways
+//
+// Each set keeps a Fenwick (binary indexed) tree over its own access clock, with a 1 at the time of the latest
+// access to each of its lines. The distance of an access is then the number of 1s between the line's previous
+// access and now: O(log n) per access. When a set's clock reaches the end of its tree the live entries are
+// renumbered in order (and the tree doubled if more than half of it is live), so memory stays proportional
+// to the number of distinct lines.
+
+#ifndef StackDistance_H
+#define StackDistance_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <stdexcept>
+
+static const uint64_t STACK_DISTANCE_COLD = ~0ULL;
+
+class StackDistance
+{
+public:
+  StackDistance( uint64_t lineSize, uint64_t numSets=1 )
+  : m_lineShift( 0 )
+  , m_setMask( numSets - 1 )
+  , m_sets( numSets )
+  , m_accesses( 0 )
+  , m_coldMisses( 0 )
+  {
+    if( lineSize == 0 || (lineSize & (lineSize - 1)) || numSets == 0 || (numSets & (numSets - 1)) )
+      throw std::runtime_error("StackDistance: lineSize and numSets must be powers of 2.");
+    while( (1ULL << m_lineShift) < lineSize ) m_lineShift++;
+  }
+
+  uint64_t access( uint64_t memoryAddress )
+  {
+    uint64_t line = memoryAddress >> m_lineShift;
+    Set& set = m_sets[line & m_setMask];
+    m_accesses++;
+    if( set.clock == set.lines.size() ) compact( set );
+    uint64_t now = set.clock++;
+
+    std::pair<std::unordered_map<uint64_t,uint64_t>::iterator, bool> found = m_lastAccess.insert( std::make_pair(line, now) );
+    uint64_t distance = STACK_DISTANCE_COLD;
+    if( found.second ) {
+      m_coldMisses++;
+    } else {
+      uint64_t last = found.first->second;
+      distance = set.prefixSum( now ) - set.prefixSum( last + 1 );
+      set.add( last, -1 );
+      set.lines[last] = NO_LINE;
+      found.first->second = now;
+      if( distance >= m_histogram.size() ) m_histogram.resize( distance + 1 );
+      m_histogram[distance]++;
+    }
+    set.add( now, 1 );
+    set.lines[now] = line;
+    return distance;
+  }
+  void accessMany( const uint64_t* memoryAddresses, size_t n )
+  {
+    for( size_t ii = 0; ii < n; ii++) access( memoryAddresses[ii] );
+  }
+
+  uint64_t getAccesses()    { return m_accesses; }
+  uint64_t getColdMisses()  { return m_coldMisses; }
+  uint64_t getNumSets()     { return m_sets.size(); }
+  const std::vector<uint64_t>& getHistogram() { return m_histogram; }
+
+  uint64_t getMisses( uint64_t ways )
+  {
+    uint64_t misses = m_coldMisses;
+    for( uint64_t dd = ways; dd < m_histogram.size(); dd++) misses += m_histogram[dd];
+    return misses;
+  }
+  double getMissRatio( uint64_t ways )
+  {
+    return m_accesses ? (double)getMisses(ways) / m_accesses : 0.0;
+  }
+
+  void dumpMissRatioCurve( std::ostream& os, uint64_t maxWays )
+  {
+    os << std::dec << "cacheSize ways misses missRatio" << std::endl;
+    for( uint64_t ways = 1; ways <= maxWays; ways *= 2) {
+      os << ((ways * m_sets.size()) << m_lineShift) << " " << ways << " " << getMisses(ways) << " " << getMissRatio(ways) << std::endl;
+    }
+  }
+
+private:
+  static const uint64_t NO_LINE = ~0ULL;
+
+  // The Fenwick tree of one set, over its clock; lines[t] is the line accessed at time t if that is still its
+  // latest access, NO_LINE otherwise.
+  struct Set
+  {
+    std::vector<int32_t>  tree;     // 1-based
+    std::vector<uint64_t> lines;
+    uint64_t              clock;
+    Set() : tree( 1 + INITIAL_TIMES, 0 ), lines( INITIAL_TIMES, uint64_t(NO_LINE) ), clock( 0 ) {}
+
+    void add( uint64_t time, int32_t delta )
+    {
+      for( uint64_t ii = time + 1; ii < tree.size(); ii += ii & (0 - ii)) tree[ii] += delta;
+    }
+    // marks at times [0,time)
+    uint64_t prefixSum( uint64_t time )
+    {
+      int64_t sum = 0;
+      for( uint64_t ii = time; ii > 0; ii -= ii & (0 - ii)) sum += tree[ii];
+      return sum;
+    }
+  };
+  static const uint64_t INITIAL_TIMES = 16;
+
+  // Renumbers the set's live entries 0,1,.. in the order of their accesses and rebuilds its tree.
+  void compact( Set& set )
+  {
+    uint64_t live = 0;
+    for( uint64_t tt = 0; tt < set.clock; tt++) {
+      if( set.lines[tt] == NO_LINE ) continue;
+      set.lines[live] = set.lines[tt];
+      m_lastAccess[set.lines[tt]] = live;
+      live++;
+    }
+    uint64_t size = set.lines.size();
+    if( 2 * live > size ) size *= 2;
+    set.lines.resize( live );
+    set.lines.resize( size, uint64_t(NO_LINE) );
+    set.tree.assign( size + 1, 0 );
+    for( uint64_t tt = 0; tt < live; tt++) set.add( tt, 1 );
+    set.clock = live;
+  }
+
+  unsigned int                          m_lineShift;
+  uint64_t                              m_setMask;
+  std::vector<Set>                      m_sets;
+  std::unordered_map<uint64_t,uint64_t> m_lastAccess;   // line index -> time of its latest access, on its set's clock
+  std::vector<uint64_t>                 m_histogram;
+  uint64_t                              m_accesses;
+  uint64_t                              m_coldMisses;
+};
+
+#endif
@@ -0,0 +1,296 @@
+// Design-space exploration: runs one simulation per point of a grid of parameters, each in a process of its own,
+// as many at a time as there are host cores, and collects what they print into one table (see sweep.cpp).
+//
+// A point is one value from each axis of the grid. The simulation of a point is the sweep's command with, for every
+// axis, the axis's option and the point's value appended: e.g. "tlm2freesampler -n 1m" with axes -c and -w runs
+// "tlm2freesampler -n 1m -c 32k -w 8". The points are numbered with the last axis varying fastest.
+// Each run is a separate process because the SystemC kernel can only be elaborated once per process; it also keeps
+// the runs from sharing anything but the host.
+//
+// Results are read from the run's standard output, from lines of the form printed by the statistics' dump():
+// "name: key=value key=value ...". Each becomes a column "name.key" of the table; any other line is skipped.
+// Columns appear in the order they are first seen, going through the points in order, so the table does not depend
+// on which run finished first.
+//
+// API
+//  - addAxis(option,values) - e.g. addAxis("-w", {"1","2","4","8"})
+//  - run(command,numJobs)   - all the points, numJobs at a time (0: one per host core); returns how many failed
+//  - writeCSV(os) / writeJSON(os) - one row per point: its number, exit status, axis values and results
+//  - parseResults(output,results) - the "name.key" = value pairs in a run's output
+
+#ifndef SweepRunner_H
+#define SweepRunner_H
+
+#include <stdint.h>
+#include <stdio.h>      // snprintf
+#include <errno.h>
+#include <fcntl.h>      // O_CLOEXEC
+#include <unistd.h>     // pipe2, fork, execvp
+#include <sys/wait.h>   // waitpid
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>      // pair
+#include <algorithm>    // max
+#include <sstream>
+#include <ostream>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+
+class SweepRunner
+{
+public:
+  typedef std::vector< std::pair<std::string, std::string> > Fields;
+
+  struct Axis
+  {
+    std::string               option;     // e.g. "-w"
+    std::vector<std::string>  values;
+  };
+  struct Point
+  {
+    std::vector<std::string>  values;     // one per axis
+    int                       status;     // exit status of its run; 128+signal if it was killed, 127 if it did not start
+    Fields                    results;
+  };
+
+  void addAxis( const std::string& option, const std::vector<std::string>& values )
+  {
+    if( values.empty() ) throw std::runtime_error("SweepRunner: axis " + option + " has no values.");
+    Axis axis;
+    axis.option = option;
+    axis.values = values;
+    m_axes.push_back( axis );
+  }
+  const std::vector<Axis>&  getAxes()     { return m_axes; }
+  const std::vector<Point>& getPoints()   { return m_points; }
+
+  size_t numPoints()
+  {
+    size_t n = 1;
+    for( size_t ii = 0; ii < m_axes.size(); ii++) n *= m_axes[ii].values.size();
+    return n;
+  }
+  // The values of point index, one per axis; the last axis varies fastest.
+  std::vector<std::string> pointValues( size_t index )
+  {
+    std::vector<std::string> values( m_axes.size() );
+    for( size_t ii = m_axes.size(); ii-- > 0; ) {
+      values[ii] = m_axes[ii].values[index % m_axes[ii].values.size()];
+      index /= m_axes[ii].values.size();
+    }
+    return values;
+  }
+
+  size_t run( const std::vector<std::string>& command, unsigned int numJobs=0 )
+  {
+    if( command.empty() ) throw std::runtime_error("SweepRunner: no command to run.");
+    if( numJobs == 0 ) numJobs = std::max( std::thread::hardware_concurrency(), 1U );
+    m_points.assign( numPoints(), Point() );
+    std::atomic<size_t> next( 0 );
+    std::vector<std::thread> workers;
+    for( unsigned int jj = 0; jj < numJobs && jj < m_points.size(); jj++) {
+      workers.push_back( std::thread( &SweepRunner::work, this, std::cref(command), std::ref(next) ) );
+    }
+    for( size_t jj = 0; jj < workers.size(); jj++) workers[jj].join();
+    size_t failed = 0;
+    for( size_t ii = 0; ii < m_points.size(); ii++) if( m_points[ii].status != 0 ) failed++;
+    return failed;
+  }
+
+  // The columns of the table past the point number, status and axes: every result key, in order of appearance.
+  std::vector<std::string> resultColumns()
+  {
+    std::vector<std::string> columns;
+    std::map<std::string, bool> seen;
+    for( size_t ii = 0; ii < m_points.size(); ii++) {
+      for( size_t kk = 0; kk < m_points[ii].results.size(); kk++) {
+        const std::string& key = m_points[ii].results[kk].first;
+        if( seen.insert( std::make_pair(key, true) ).second ) columns.push_back( key );
+      }
+    }
+    return columns;
+  }
+
+  void writeCSV( std::ostream& os )
+  {
+    std::vector<std::string> columns = resultColumns();
+    os << "point,status";
+    for( size_t aa = 0; aa < m_axes.size(); aa++) os << "," << csvField( axisName(aa) );
+    for( size_t cc = 0; cc < columns.size(); cc++) os << "," << csvField( columns[cc] );
+    os << "\n";
+    for( size_t ii = 0; ii < m_points.size(); ii++) {
+      os << ii << "," << m_points[ii].status;
+      for( size_t aa = 0; aa < m_axes.size(); aa++) os << "," << csvField( m_points[ii].values[aa] );
+      for( size_t cc = 0; cc < columns.size(); cc++) {
+        const std::string* value = find( m_points[ii].results, columns[cc] );
+        os << "," << (value ? csvField(*value) : std::string());
+      }
+      os << "\n";
+    }
+  }
+
+  // An array of one object per point; values that read as numbers are written as numbers.
+  void writeJSON( std::ostream& os )
+  {
+    os << "[\n";
+    for( size_t ii = 0; ii < m_points.size(); ii++) {
+      os << "  {\"point\": " << ii << ", \"status\": " << m_points[ii].status;
+      for( size_t aa = 0; aa < m_axes.size(); aa++) {
+        os << ", " << jsonString( axisName(aa) ) << ": " << jsonValue( m_points[ii].values[aa] );
+      }
+      for( size_t kk = 0; kk < m_points[ii].results.size(); kk++) {
+        os << ", " << jsonString( m_points[ii].results[kk].first ) << ": " << jsonValue( m_points[ii].results[kk].second );
+      }
+      os << "}" << (ii + 1 < m_points.size() ? "," : "") << "\n";
+    }
+    os << "]\n";
+  }
+
+  static void parseResults( const std::string& output, Fields& results )
+  {
+    std::istringstream lines( output );
+    std::string line;
+    while( std::getline( lines, line ) ) {
+      size_t colon = line.find( ": " );
+      if( colon == std::string::npos || colon == 0 || line.find(' ') < colon ) continue;
+      std::string name = line.substr( 0, colon );
+      std::istringstream tokens( line.substr( colon + 2 ) );
+      Fields fields;
+      std::string token;
+      bool ok = true;
+      while( ok && tokens >> token ) {
+        size_t equals = token.find( '=' );
+        ok = equals != std::string::npos && equals > 0;
+        if( ok ) fields.push_back( std::make_pair( name + "." + token.substr(0, equals), token.substr(equals + 1) ) );
+      }
+      if( ok && !fields.empty() ) results.insert( results.end(), fields.begin(), fields.end() );
+    }
+  }
+
+  // Run args (args[0] looked up in PATH) with its standard output into output. Returns its exit status, 128+signal
+  // if it was killed, 127 if it could not be started.
+  static int runProcess( const std::vector<std::string>& args, std::string& output )
+  {
+    std::vector<char*> argv;
+    for( size_t ii = 0; ii < args.size(); ii++) argv.push_back( const_cast<char*>(args[ii].c_str()) );
+    argv.push_back( NULL );
+    // close-on-exec, so that runs started at the same time from other threads do not hold this pipe open
+    int fds[2];
+    if( pipe2( fds, O_CLOEXEC ) != 0 ) return 127;
+    pid_t pid = fork();
+    if( pid < 0 ) {
+      close( fds[0] );
+      close( fds[1] );
+      return 127;
+    }
+    if( pid == 0 ) {
+      dup2( fds[1], STDOUT_FILENO );
+      execvp( argv[0], &argv[0] );
+      _exit( 127 );
+    }
+    close( fds[1] );
+    char buffer[4096];
+    for( ;; ) {
+      ssize_t n = read( fds[0], buffer, sizeof(buffer) );
+      if( n > 0 ) output.append( buffer, n );
+      else if( n == 0 || errno != EINTR ) break;
+    }
+    close( fds[0] );
+    int status = 0;
+    while( waitpid( pid, &status, 0 ) < 0 && errno == EINTR ) {}
+    if( WIFEXITED(status) ) return WEXITSTATUS(status);
+    if( WIFSIGNALED(status) ) return 128 + WTERMSIG(status);
+    return 127;
+  }
+
+private:
+  // One host thread: takes the next point to run until there are none left.
+  void work( const std::vector<std::string>& command, std::atomic<size_t>& next )
+  {
+    for( size_t index; (index = next++) < m_points.size(); ) {
+      Point& point = m_points[index];
+      point.values = pointValues( index );
+      std::vector<std::string> args( command );
+      for( size_t aa = 0; aa < m_axes.size(); aa++) {
+        args.push_back( m_axes[aa].option );
+        args.push_back( point.values[aa] );
+      }
+      std::string output;
+      point.status = runProcess( args, output );
+      parseResults( output, point.results );
+    }
+  }
+
+  // The column of an axis: its option without the dashes
+  std::string axisName( size_t axis )
+  {
+    const std::string& option = m_axes[axis].option;
+    size_t first = option.find_first_not_of( '-' );
+    return first == std::string::npos ? option : option.substr( first );
+  }
+
+  static const std::string* find( const Fields& fields, const std::string& key )
+  {
+    for( size_t ii = 0; ii < fields.size(); ii++) if( fields[ii].first == key ) return &fields[ii].second;
+    return NULL;
+  }
+  static std::string csvField( const std::string& value )
+  {
+    if( value.find_first_of( ",\"\n" ) == std::string::npos ) return value;
+    std::string quoted = "\"";
+    for( size_t ii = 0; ii < value.size(); ii++) {
+      if( value[ii] == '"' ) quoted += '"';
+      quoted += value[ii];
+    }
+    return quoted + "\"";
+  }
+  static std::string jsonString( const std::string& value )
+  {
+    std::string quoted = "\"";
+    for( size_t ii = 0; ii < value.size(); ii++) {
+      char c = value[ii];
+      if( c == '"' || c == '\\' ) quoted += '\\';
+      if( (unsigned char)c < 0x20 ) {
+        char escape[8];
+        snprintf( escape, sizeof(escape), "\\u%04x", c );
+        quoted += escape;
+        continue;
+      }
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+  static std::string jsonValue( const std::string& value )
+  {
+    return isJSONNumber( value ) ? value : jsonString( value );
+  }
+  // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  static bool isJSONNumber( const std::string& value )
+  {
+    size_t ii = 0;
+    if( ii < value.size() && value[ii] == '-' ) ii++;
+    if( ii < value.size() && value[ii] == '0' ) ii++;
+    else if( !skipDigits( value, ii ) ) return false;
+    if( ii < value.size() && value[ii] == '.' && !skipDigits( value, ++ii ) ) return false;
+    if( ii < value.size() && (value[ii] == 'e' || value[ii] == 'E') ) {
+      ii++;
+      if( ii < value.size() && (value[ii] == '+' || value[ii] == '-') ) ii++;
+      if( !skipDigits( value, ii ) ) return false;
+    }
+    return ii == value.size();
+  }
+  // Moves pos past the digits at pos; false if there are none.
+  static bool skipDigits( const std::string& value, size_t& pos )
+  {
+    size_t first = pos;
+    while( pos < value.size() && value[pos] >= '0' && value[pos] <= '9' ) pos++;
+    return pos > first;
+  }
+
+  std::vector<Axis>   m_axes;
+  std::vector<Point>  m_points;
+};
+
+#endif
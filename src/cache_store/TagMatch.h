@@ -0,0 +1,133 @@
+// Tag-match kernels used by CacheStore to probe all the ways of a cache block at once.
+// A kernel compares one tag against numWays adjacent tags (see CacheLineStorage.h) and returns
+// the way of the first match, or numWays if nothing matches.
+//
+// Kernels (see TagMatchKernel_t):
+//  - TagMatchScalar - portable loop, always available
+//  - TagMatchSSE41  - 2 tags per compare  (_mm_cmpeq_epi64 + movemask)
+//  - TagMatchAVX2   - 4 tags per compare  (_mm256_cmpeq_epi64 + movemask)
+//  - TagMatchAVX512 - 8 tags per compare  (_mm512_cmpeq_epi64_mask, masked load for the tail)
+// The SIMD kernels are compiled with per-function target attributes, so no special compiler flags
+// are needed; which ones may actually run is decided at runtime from the CPU features.
+// TagMatchAuto picks the widest supported kernel (and the scalar one for blocks of fewer than 4 ways,
+// where a vector compare buys nothing).
+
+#ifndef TagMatch_H
+#define TagMatch_H
+
+#include <stdint.h>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TAGMATCH_X86 1
+#include <immintrin.h>
+#endif
+
+enum TagMatchKernel_t { TagMatchAuto, TagMatchScalar, TagMatchSSE41, TagMatchAVX2, TagMatchAVX512 };
+
+typedef uint64_t (*TagMatchFn)( const uint64_t* tags, uint64_t numWays, uint64_t tag );
+
+inline uint64_t tagMatchScalar( const uint64_t* tags, uint64_t numWays, uint64_t tag )
+{
+  for( uint64_t ii = 0; ii < numWays; ii++) {
+    if( tags[ii] == tag ) return ii;
+  }
+  return numWays;
+}
+
+#ifdef TAGMATCH_X86
+
+__attribute__((target("sse4.1")))
+inline uint64_t tagMatchSSE41( const uint64_t* tags, uint64_t numWays, uint64_t tag )
+{
+  const __m128i probe = _mm_set1_epi64x( (long long)tag );
+  uint64_t ii = 0;
+  for( ; ii + 2 <= numWays; ii += 2) {
+    __m128i t = _mm_loadu_si128( reinterpret_cast<const __m128i*>(&tags[ii]) );
+    int mask = _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpeq_epi64(t, probe) ) );
+    if( mask ) return ii + __builtin_ctz(mask);
+  }
+  for( ; ii < numWays; ii++) {
+    if( tags[ii] == tag ) return ii;
+  }
+  return numWays;
+}
+
+__attribute__((target("avx2")))
+inline uint64_t tagMatchAVX2( const uint64_t* tags, uint64_t numWays, uint64_t tag )
+{
+  const __m256i probe = _mm256_set1_epi64x( (long long)tag );
+  uint64_t ii = 0;
+  for( ; ii + 8 <= numWays; ii += 8) {
+    __m256i t0 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(&tags[ii]) );
+    __m256i t1 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(&tags[ii + 4]) );
+    int mask = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpeq_epi64(t0, probe) ) )
+             | _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpeq_epi64(t1, probe) ) ) << 4;
+    if( mask ) return ii + __builtin_ctz(mask);
+  }
+  for( ; ii + 4 <= numWays; ii += 4) {
+    __m256i t = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(&tags[ii]) );
+    int mask = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpeq_epi64(t, probe) ) );
+    if( mask ) return ii + __builtin_ctz(mask);
+  }
+  for( ; ii < numWays; ii++) {
+    if( tags[ii] == tag ) return ii;
+  }
+  return numWays;
+}
+
+__attribute__((target("avx512f")))
+inline uint64_t tagMatchAVX512( const uint64_t* tags, uint64_t numWays, uint64_t tag )
+{
+  const __m512i probe = _mm512_set1_epi64( (long long)tag );
+  for( uint64_t ii = 0; ii < numWays; ii += 8) {
+    uint64_t left = numWays - ii;
+    __mmask8 lanes = left >= 8 ? (__mmask8)0xFF : (__mmask8)((1u << left) - 1);
+    __m512i t = _mm512_maskz_loadu_epi64( lanes, &tags[ii] );
+    __mmask8 mask = _mm512_mask_cmpeq_epi64_mask( lanes, t, probe );
+    if( mask ) return ii + __builtin_ctz(mask);
+  }
+  return numWays;
+}
+
+#endif // TAGMATCH_X86
+
+inline bool isTagMatchKernelSupported( TagMatchKernel_t kernel )
+{
+  switch( kernel ) {
+    case TagMatchAuto:
+    case TagMatchScalar:  return true;
+#ifdef TAGMATCH_X86
+    case TagMatchSSE41:   return __builtin_cpu_supports("sse4.1");
+    case TagMatchAVX2:    return __builtin_cpu_supports("avx2");
+    case TagMatchAVX512:  return __builtin_cpu_supports("avx512f");
+#endif
+    default:              return false;
+  }
+}
+
+// Resolve TagMatchAuto into the kernel that will actually be used for blocks of numWays ways.
+inline TagMatchKernel_t resolveTagMatchKernel( TagMatchKernel_t kernel, uint64_t numWays )
+{
+  if( kernel != TagMatchAuto ) return kernel;
+  if( numWays < 4 ) return TagMatchScalar;
+  if( isTagMatchKernelSupported(TagMatchAVX512) && numWays >= 8 ) return TagMatchAVX512;
+  if( isTagMatchKernelSupported(TagMatchAVX2) ) return TagMatchAVX2;
+  if( isTagMatchKernelSupported(TagMatchSSE41) ) return TagMatchSSE41;
+  return TagMatchScalar;
+}
+
+inline TagMatchFn getTagMatchFunction( TagMatchKernel_t kernel )
+{
+  if( !isTagMatchKernelSupported(kernel) ) throw std::runtime_error("getTagMatchFunction: kernel not supported on this CPU.");
+  switch( kernel ) {
+#ifdef TAGMATCH_X86
+    case TagMatchSSE41:   return tagMatchSSE41;
+    case TagMatchAVX2:    return tagMatchAVX2;
+    case TagMatchAVX512:  return tagMatchAVX512;
+#endif
+    default:              return tagMatchScalar;
+  }
+}
+
+#endif
@@ -0,0 +1,192 @@
+// Memory access traces for the trace-driven tools (see cachesim.cpp). No SystemC needed.
+// A TraceReader hands out the accesses of a trace in batches:
+//  - next(adrs,writes,max) - up to max accesses into adrs/writes; returns how many, 0 once the trace is done
+//
+// Formats (see TraceFormat_t); traceFormatFromPath picks one from the file name:
+//  - TraceBinary - 8-byte records in host byte order: the byte address, with bit 63 set for a write (*.bin)
+//  - TraceText   - one access per line, "[type] address" with the address in hex (0x optional). The type is R or W,
+//                  or a dinero label: 0 read, 1 write, 2 instruction fetch (a read). Without a type, the access is
+//                  a read. Empty lines and lines starting with # are skipped. (any other name)
+// A file is mmapped and read straight from the mapping; "-" reads stdin through a buffer.
+
+#ifndef TraceReader_H
+#define TraceReader_H
+
+#include <stdint.h>
+#include <string.h>     // memmove, memcpy
+#include <string>
+#include <vector>
+#include <algorithm>    // min
+#include <stdexcept>
+#include <fcntl.h>      // open
+#include <unistd.h>     // read, close
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // fstat
+
+enum TraceFormat_t { TraceBinary, TraceText };
+
+static const uint64_t TRACE_WRITE_BIT = 1ULL << 63;
+
+inline TraceFormat_t traceFormatFromPath( const std::string& path )
+{
+  if( path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0 ) return TraceBinary;
+  return TraceText;
+}
+
+class TraceReader
+{
+public:
+  TraceReader( const std::string& path, TraceFormat_t format )
+  : m_path( path )
+  , m_format( format )
+  , m_fd( -1 )
+  , m_mapping( NULL )
+  , m_mappingBytes( 0 )
+  , m_pos( NULL )
+  , m_end( NULL )
+  , m_eof( false )
+  , m_lineNumber( 0 )
+  {
+    if( path == "-" ) {
+      m_fd = 0;
+      m_buffer.resize( BUFFER_BYTES );
+      m_pos = m_end = &m_buffer[0];
+      return;
+    }
+    m_fd = open( path.c_str(), O_RDONLY );
+    if( m_fd < 0 ) throw std::runtime_error("TraceReader: cannot open " + path);
+    struct stat st;
+    if( fstat(m_fd, &st) != 0 ) throw std::runtime_error("TraceReader: cannot stat " + path);
+    m_eof = true;
+    m_mappingBytes = st.st_size;
+    if( m_mappingBytes == 0 ) return;
+    m_mapping = mmap( NULL, m_mappingBytes, PROT_READ, MAP_PRIVATE, m_fd, 0 );
+    if( m_mapping == MAP_FAILED ) throw std::runtime_error("TraceReader: cannot map " + path);
+    madvise( m_mapping, m_mappingBytes, MADV_SEQUENTIAL );
+    m_pos = reinterpret_cast<const char*>( m_mapping );
+    m_end = m_pos + m_mappingBytes;
+  }
+  ~TraceReader()
+  {
+    if( m_mapping != NULL ) munmap( m_mapping, m_mappingBytes );
+    if( m_fd > 0 ) close( m_fd );
+  }
+
+  size_t next( uint64_t* adrs, bool* writes, size_t max )
+  {
+    return m_format == TraceBinary ? nextBinary( adrs, writes, max ) : nextText( adrs, writes, max );
+  }
+
+private:
+  TraceReader(const TraceReader&);
+  TraceReader& operator=(const TraceReader&);
+
+  static const size_t BUFFER_BYTES = 1 << 20;
+
+  size_t nextBinary( uint64_t* adrs, bool* writes, size_t max )
+  {
+    size_t count = 0;
+    while( count < max ) {
+      if( m_end - m_pos < (ptrdiff_t)sizeof(uint64_t) && !refill() ) break;
+      size_t n = std::min( max - count, (size_t)(m_end - m_pos) / sizeof(uint64_t) );
+      for( size_t ii = 0; ii < n; ii++, m_pos += sizeof(uint64_t)) {
+        uint64_t record;
+        memcpy( &record, m_pos, sizeof(record) );
+        adrs[count + ii]   = record & ~TRACE_WRITE_BIT;
+        writes[count + ii] = (record & TRACE_WRITE_BIT) != 0;
+      }
+      count += n;
+    }
+    return count;
+  }
+
+  size_t nextText( uint64_t* adrs, bool* writes, size_t max )
+  {
+    size_t count = 0;
+    while( count < max ) {
+      if( m_pos == m_end && !refill() ) break;
+      const char* eol = static_cast<const char*>( memchr(m_pos, '\n', m_end - m_pos) );
+      if( eol == NULL ) {
+        // the last line may be incomplete: get more unless there is no more
+        if( refill() ) continue;
+        eol = m_end;
+      }
+      m_lineNumber++;
+      if( parseLine( m_pos, eol, adrs[count], writes[count] ) ) count++;
+      m_pos = eol < m_end ? eol + 1 : eol;
+    }
+    return count;
+  }
+
+  // false for a line without an access
+  bool parseLine( const char* p, const char* end, uint64_t& adr, bool& write )
+  {
+    p = skipSpace( p, end );
+    if( p == end || *p == '#' ) return false;
+    const char* first = p;
+    while( p < end && !isSpace(*p) ) p++;
+    const char* second = skipSpace( p, end );
+    write = false;
+    if( second < end ) {
+      char type = *first;
+      if( p - first != 1 || !(type == 'R' || type == 'r' || type == 'W' || type == 'w' || (type >= '0' && type <= '2')) )
+        fail("bad access type");
+      write = (type == 'W' || type == 'w' || type == '1');
+      first = second;
+    }
+    if( end - first > 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X') ) first += 2;
+    adr = 0;
+    const char* digits = first;
+    for( ; first < end && !isSpace(*first); first++) {
+      char c = *first;
+      unsigned int digit;
+      if(      c >= '0' && c <= '9' ) digit = c - '0';
+      else if( c >= 'a' && c <= 'f' ) digit = c - 'a' + 10;
+      else if( c >= 'A' && c <= 'F' ) digit = c - 'A' + 10;
+      else fail("bad address");
+      adr = (adr << 4) | digit;
+    }
+    if( first == digits ) fail("missing address");
+    return true;
+  }
+
+  static bool isSpace( char c ) { return c == ' ' || c == '\t' || c == '\r'; }
+  static const char* skipSpace( const char* p, const char* end )
+  {
+    while( p < end && isSpace(*p) ) p++;
+    return p;
+  }
+
+  // stdin only: keep the unread bytes and read more after them. false if nothing more came.
+  bool refill()
+  {
+    if( m_eof ) return false;
+    size_t left = m_end - m_pos;
+    memmove( &m_buffer[0], m_pos, left );
+    if( left == m_buffer.size() ) m_buffer.resize( 2 * m_buffer.size() );   // a line longer than the buffer
+    ssize_t n = ::read( m_fd, &m_buffer[left], m_buffer.size() - left );
+    if( n <= 0 ) m_eof = true;
+    m_pos = &m_buffer[0];
+    m_end = m_pos + left + (n > 0 ? n : 0);
+    return n > 0;
+  }
+
+  void fail( const char* why )
+  {
+    std::string where = m_path + ":" + std::to_string(m_lineNumber);
+    throw std::runtime_error("TraceReader: " + where + ": " + why);
+  }
+
+  std::string       m_path;
+  TraceFormat_t     m_format;
+  int               m_fd;
+  void*             m_mapping;
+  size_t            m_mappingBytes;
+  std::vector<char> m_buffer;       // stdin only
+  const char*       m_pos;          // next unread byte
+  const char*       m_end;
+  bool              m_eof;          // nothing more to read beyond m_end
+  uint64_t          m_lineNumber;
+};
+
+#endif
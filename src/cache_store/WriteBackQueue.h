@@ -0,0 +1,190 @@
+// Write-back support for CacheStore.
+//  - CacheEvictionHandler - told about every dirty line that leaves the cache: evicted by newCacheLine
+//                           (and so by setDataLine, allocateLine and lookupMany) or written back by flush().
+//                           Handlers that also care about clean victims (e.g. an inclusive cache level that
+//                           back-invalidates the levels above it) override evictLine. A sectored store hands
+//                           over dirty lines that are not whole through evictDirtySectors instead.
+//  - WriteBackQueue       - a CacheEvictionHandler that keeps a copy of each dirty line until its owner
+//                           (e.g. RealCache) drains it to memory, typically several lines at a time.
+// The victim's data has to be copied out: its slot in the store is refilled as soon as the eviction returns.
+// A queue told the sector size (setSectorSize) takes partial lines too: each entry has a mask of the sectors that
+// memory should get, all of them for a whole line.
+
+#ifndef WriteBackQueue_H
+#define WriteBackQueue_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>    // copy
+#include <stdexcept>
+
+struct CacheEvictionHandler
+{
+  virtual ~CacheEvictionHandler() {}
+  // lineAddress is the memory address of the first byte of the line; data holds the whole line.
+  virtual void evictDirtyLine( uint64_t lineAddress, const uint32_t* data ) = 0;
+  // Every valid line evicted by newCacheLine, clean or dirty. The victim's slot is only reused once this
+  // returns, so a handler may update data in place (and report it dirty) before passing it on.
+  // A sectored store passes a victim that is not whole here with dirty false, and then its dirty sectors, if any,
+  // to evictDirtySectors.
+  virtual void evictLine( uint64_t lineAddress, uint32_t* data, bool dirty )
+  {
+    if( dirty ) evictDirtyLine( lineAddress, data );
+  }
+  // Instead of evictDirtyLine, for a line of a sectored store (see CacheStoreBase::setSectorSize) that is not whole:
+  // only the sectors in dirtySectors (bit ii for sector ii) hold data for memory, the rest of data is garbage.
+  virtual void evictDirtySectors( uint64_t lineAddress, const uint32_t* data, uint64_t dirtySectors )
+  {
+    throw std::runtime_error("CacheEvictionHandler: this handler does not take partly valid (sectored) lines.");
+  }
+};
+
+// FIFO of dirty lines waiting to be written to memory. Entries live in a ring of line-sized slots that
+// only grows (doubling) if more lines are pending than it has room for, so steady state never allocates.
+class WriteBackQueue : public CacheEvictionHandler
+{
+public:
+  WriteBackQueue( uint64_t lineSize, size_t capacity=8 )
+  : m_numWordsPerLine( (lineSize + sizeof(uint32_t) - 1) / sizeof(uint32_t) )
+  , m_numWordsPerSector( m_numWordsPerLine )
+  , m_allSectors( 1 )
+  , m_head(0)
+  , m_count(0)
+  {
+    reserve( capacity ? capacity : 1 );
+  }
+
+  // Sectors of this many bytes, as the store's (see CacheStoreBase::setSectorSize). Only while the queue is empty.
+  void setSectorSize( uint64_t sectorSize )
+  {
+    m_numWordsPerSector = (uint32_t)( sectorSize / sizeof(uint32_t) );
+    uint32_t numSectors = m_numWordsPerLine / m_numWordsPerSector;
+    m_allSectors = numSectors >= 64 ? ~0ULL : (1ULL << numSectors) - 1;
+  }
+
+  virtual void evictDirtyLine( uint64_t lineAddress, const uint32_t* data )
+  {
+    size_t slot = push( lineAddress );
+    m_sectors[slot] = m_allSectors;
+    std::copy( data, data + m_numWordsPerLine, &m_data[slot * m_numWordsPerLine] );
+  }
+  // The sectors are merged into the newest pending write of the line, if there is one: they are newer than all of
+  // it. So a partial entry is always the only one of its line.
+  virtual void evictDirtySectors( uint64_t lineAddress, const uint32_t* data, uint64_t dirtySectors )
+  {
+    uint32_t* pending = find( lineAddress );
+    size_t slot;
+    if( pending != NULL ) {
+      slot = (pending - &m_data[0]) / m_numWordsPerLine;
+    } else {
+      slot = push( lineAddress );
+      m_sectors[slot] = 0;
+    }
+    m_sectors[slot] |= dirtySectors;
+    for( uint32_t ss = 0; dirtySectors != 0; ss++, dirtySectors >>= 1) {
+      if( (dirtySectors & 1) == 0 ) continue;
+      const uint32_t* from = data + ss * m_numWordsPerSector;
+      std::copy( from, from + m_numWordsPerSector, &m_data[slot * m_numWordsPerLine + ss * m_numWordsPerSector] );
+    }
+  }
+
+  size_t      size()      { return m_count; }
+  bool        empty()     { return m_count == 0; }
+  uint32_t    getNumWordsPerLine()  { return m_numWordsPerLine; }
+
+  // The oldest pending line. Only valid while the queue is not empty.
+  uint64_t    frontAddress()  { return m_addresses[m_head]; }
+  uint32_t*   frontData()     { return &m_data[m_head * m_numWordsPerLine]; }
+  // the sectors of it memory should get; all of them unless it came from evictDirtySectors
+  uint64_t    frontSectors()  { return m_sectors[m_head]; }
+  bool        frontIsWhole()  { return m_sectors[m_head] == m_allSectors; }
+  void        pop()
+  {
+    m_head = (m_head + 1) % m_addresses.size();
+    m_count--;
+  }
+
+  // Is a write of this line still pending? Memory does not have its latest data until it is drained.
+  bool contains( uint64_t lineAddress )
+  {
+    for( size_t ii = 0; ii < m_count; ii++) {
+      if( m_addresses[(m_head + ii) % m_addresses.size()] == lineAddress ) return true;
+    }
+    return false;
+  }
+
+  // The data of the newest pending write of this line, or NULL. With sectors, which of them it holds; a partial
+  // write is the only pending one of its line.
+  uint32_t* find( uint64_t lineAddress, uint64_t* sectors=NULL )
+  {
+    for( size_t ii = m_count; ii > 0; ii--) {
+      size_t slot = (m_head + ii - 1) % m_addresses.size();
+      if( m_addresses[slot] != lineAddress ) continue;
+      if( sectors != NULL ) *sectors = m_sectors[slot];
+      return &m_data[slot * m_numWordsPerLine];
+    }
+    return NULL;
+  }
+
+  // Drop the pending writes of this line, e.g. because the cache took a newer copy of the whole line back.
+  // The other entries keep their order. Returns how many were dropped.
+  size_t cancel( uint64_t lineAddress )
+  {
+    size_t kept = 0;
+    for( size_t ii = 0; ii < m_count; ii++) {
+      size_t from = (m_head + ii) % m_addresses.size();
+      if( m_addresses[from] == lineAddress ) continue;
+      size_t to = (m_head + kept) % m_addresses.size();
+      if( to != from ) {
+        m_addresses[to] = m_addresses[from];
+        m_sectors[to] = m_sectors[from];
+        std::copy( &m_data[from * m_numWordsPerLine], &m_data[from * m_numWordsPerLine] + m_numWordsPerLine, &m_data[to * m_numWordsPerLine] );
+      }
+      kept++;
+    }
+    size_t dropped = m_count - kept;
+    m_count = kept;
+    return dropped;
+  }
+
+private:
+  // A new entry at the back of the queue for the line; returns its slot.
+  size_t push( uint64_t lineAddress )
+  {
+    if( m_count == m_addresses.size() ) reserve( 2 * m_addresses.size() );
+    size_t slot = (m_head + m_count) % m_addresses.size();
+    m_addresses[slot] = lineAddress;
+    m_count++;
+    return slot;
+  }
+
+  // Re-lay the pending entries out from slot 0 in a ring of the new capacity.
+  void reserve( size_t capacity )
+  {
+    std::vector<uint64_t> addresses( capacity );
+    std::vector<uint64_t> sectors( capacity );
+    std::vector<uint32_t> data( capacity * m_numWordsPerLine );
+    for( size_t ii = 0; ii < m_count; ii++) {
+      size_t slot = (m_head + ii) % m_addresses.size();
+      addresses[ii] = m_addresses[slot];
+      sectors[ii] = m_sectors[slot];
+      std::copy( &m_data[slot * m_numWordsPerLine], &m_data[slot * m_numWordsPerLine] + m_numWordsPerLine, &data[ii * m_numWordsPerLine] );
+    }
+    m_addresses.swap( addresses );
+    m_sectors.swap( sectors );
+    m_data.swap( data );
+    m_head = 0;
+  }
+
+  uint32_t              m_numWordsPerLine;
+  uint32_t              m_numWordsPerSector;
+  uint64_t              m_allSectors;
+  std::vector<uint64_t> m_addresses;    // one per slot
+  std::vector<uint64_t> m_sectors;      // one per slot: the sectors memory should get
+  std::vector<uint32_t> m_data;         // m_numWordsPerLine words per slot
+  size_t                m_head;         // slot of the oldest entry
+  size_t                m_count;
+};
+
+#endif
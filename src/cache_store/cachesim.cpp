@@ -0,0 +1,156 @@
+// Trace-driven cache simulator: streams a memory access trace through a CacheStore, no SystemC kernel involved.
+// Only the tags and replacement state matter here; there is no memory behind the cache and no timing.
+//
+// usage: cachesim [options] trace      (trace "-" reads stdin; see TraceReader.h for the formats)
+//        cachesim [options] -n N       (N random accesses generated in memory instead, to measure the simulator)
+//  -c size     cache size in bytes, k/m/g suffixes allowed (default 32k)
+//  -l size     line size in bytes (default 64)
+//  -w ways     associativity (default 8)
+//  -r policy   lru, plru, fifo or random (default lru)
+//  -i index    set index function: mod, xor or prime (default mod; see CacheGeometry.h)
+//  -f format   bin or text (default: bin for *.bin, otherwise text)
+//  -p size     footprint of the -n accesses (default 1m); a quarter of them are writes
+//  -t threads  replay on this many host threads, a power of 2 (default 1; see SetParallelReplay.h). The results
+//              are exactly those of one thread.
+//  -s          also print the per-set access/conflict counters
+//  -m ways     also print the LRU miss-ratio curve for 1, 2, 4 .. ways ways per set, with the same line size and
+//              number of sets, from the same single pass (see StackDistance.h); with -i mod only
+// Prints the store's counters and the simulation rate in accesses per second.
+//
+// The trace is read in batches, and each batch goes through CacheStore::lookupMany, which overlaps the tag loads
+// of consecutive addresses. Written lines are marked dirty, so dirtyEvictions is the number of write-backs.
+// With several threads the batches are larger, so that binning them by set and starting the threads pays off.
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include "CacheStore.h"
+#include "CacheOptions.h"
+#include "TraceReader.h"
+#include "StackDistance.h"
+#include "SetParallelReplay.h"
+
+using namespace std;
+
+static const size_t CACHESIM_BATCH = 4096;             // accesses read from the trace at a time
+static const size_t CACHESIM_PARALLEL_BATCH = 1 << 20;  // the same, with more than one thread
+
+static void usage()
+{
+  cerr << "usage: cachesim [-c size] [-l size] [-w ways] [-r lru|plru|fifo|random] [-i mod|xor|prime] [-f bin|text] [-t threads] [-s] [-m ways] trace" << endl;
+  cerr << "       cachesim [-c size] [-l size] [-w ways] [-r lru|plru|fifo|random] [-i mod|xor|prime] [-p size] [-t threads] [-s] [-m ways] -n accesses" << endl;
+  exit(2);
+}
+
+int main( int argc, char* argv[] )
+{
+  uint64_t cacheSize = 32 << 10;
+  uint64_t lineSize  = 64;
+  uint64_t numWays   = 8;
+  ReplacementPolicy_t policy = ReplLRU;
+  CacheIndexHash_t indexHash = IndexModulo;
+  string   format;
+  uint64_t numRandom = 0;
+  uint64_t footprint = 1 << 20;
+  bool     setStats  = false;
+  uint64_t curveWays = 0;
+  uint64_t numThreads = 1;
+  string   tracePath;
+
+  try {
+    for( int ii = 1; ii < argc; ii++) {
+      string arg = argv[ii];
+      if( arg == "-s" ) { setStats = true; continue; }
+      if( arg.size() != 2 || arg[0] != '-' ) {
+        if( !tracePath.empty() ) usage();
+        tracePath = arg;
+        continue;
+      }
+      if( ii + 1 >= argc ) usage();
+      const char* value = argv[++ii];
+      switch( arg[1] ) {
+        case 'c': cacheSize = parseSize(value); break;
+        case 'l': lineSize  = parseSize(value); break;
+        case 'w': numWays   = parseSize(value); break;
+        case 'r': policy    = parsePolicy(value); break;
+        case 'i': indexHash = parseIndexHash(value); break;
+        case 'f': format    = value; break;
+        case 'n': numRandom = parseSize(value); break;
+        case 'p': footprint = parseSize(value); break;
+        case 'm': curveWays = parseSize(value); break;
+        case 't': numThreads = parseSize(value); break;
+        default:  usage();
+      }
+    }
+    if( tracePath.empty() == (numRandom == 0) ) usage();
+    if( curveWays && indexHash != IndexModulo )
+      throw runtime_error("-m models the default index function only");
+
+    // The whole 48-bit address space: trace addresses are not limited to a simulated memory.
+    CacheStore store( 1ULL << 48, cacheSize, lineSize, numWays, policy, indexHash );
+    store.enableSetStats( setStats );
+    StackDistance* curve = curveWays ? new StackDistance( lineSize, cacheSize / (lineSize * numWays) ) : NULL;
+
+    SetParallelReplay parallel( store, numThreads );
+    size_t batch = numThreads > 1 ? CACHESIM_PARALLEL_BATCH : CACHESIM_BATCH;
+
+    vector<uint64_t>      adrs( batch );
+    vector<char>          writes( batch );      // not vector<bool>: lookupMany wants a bool array
+    bool* writeFlags = reinterpret_cast<bool*>( &writes[0] );
+    uint64_t accesses = 0;
+    chrono::steady_clock::time_point start;
+
+    if( numRandom > 0 ) {
+      // Generate everything first so only the simulation is timed.
+      vector<uint64_t> trace( numRandom );
+      vector<char>     traceWrites( numRandom );
+      mt19937_64 rng( 1 );
+      uint64_t footprintLines = max( footprint / lineSize, (uint64_t)1 );
+      for( uint64_t ii = 0; ii < numRandom; ii++) {
+        uint64_t r = rng();
+        trace[ii] = (r % footprintLines) * lineSize;
+        traceWrites[ii] = (r >> 62) == 0;
+      }
+      start = chrono::steady_clock::now();
+      for( uint64_t first = 0; first < numRandom; first += batch) {
+        size_t n = min( (uint64_t)batch, numRandom - first );
+        parallel.replay( &trace[first], n, reinterpret_cast<bool*>(&traceWrites[first]) );
+        if( curve ) curve->accessMany( &trace[first], n );
+      }
+      accesses = numRandom;
+    } else {
+      TraceFormat_t traceFormat = format.empty() ? traceFormatFromPath(tracePath)
+                                : format == "bin" ? TraceBinary
+                                : format == "text" ? TraceText
+                                : throw runtime_error("unknown trace format " + format);
+      TraceReader trace( tracePath, traceFormat );
+      start = chrono::steady_clock::now();
+      for( size_t n; (n = trace.next(&adrs[0], writeFlags, batch)) > 0; ) {
+        parallel.replay( &adrs[0], n, writeFlags );
+        if( curve ) curve->accessMany( &adrs[0], n );
+        accesses += n;
+      }
+    }
+    double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+    cout << "cache " << cacheSize << " bytes, " << lineSize << "-byte lines, " << numWays << " ways, "
+         << parallel.getNumThreads() << " thread(s)" << endl;
+    store.getStats().dump( cout, "cachesim" );
+    if( setStats ) store.dumpSetStats( cout );
+    cout << accesses << " accesses in " << seconds << " s, "
+         << (seconds > 0 ? accesses / seconds / 1e6 : 0) << " M accesses/s" << endl;
+    if( curve ) {
+      curve->dumpMissRatioCurve( cout, curveWays );
+      delete curve;
+    }
+  }
+  catch( const exception& e ) {
+    cerr << "cachesim: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+// Design-space exploration driver: runs a simulator once per point of a grid of cache parameters, each run in a
+// process of its own and as many at a time as there are host cores, and writes all their results as one table.
+// See SweepRunner.h for how points are run and results collected.
+//
+// usage: sweep [options] -- command [args...]
+//  -c sizes    cache sizes, passed as -c (e.g. 16k,32k,64k)
+//  -w ways     associativities, passed as -w
+//  -l sizes    line sizes, passed as -l
+//  -r policies replacement policies, passed as -r
+//  -a flag=values  any other axis, passed as flag: e.g. -a -i=mod,xor
+//  -j jobs     runs at a time (default: one per host core)
+//  -o file     write the table there instead of to stdout; as JSON if it ends in .json, else as CSV
+//  -J          write JSON (to stdout, or whatever -o names)
+// Values are comma-separated. The command is the simulator with its workload, e.g.
+//   sweep -c 16k,32k,64k -w 1,2,4,8 -l 32,64 -r lru,plru -- ./tlm2freesampler -n 1m -p 256k
+//   sweep -c 16k,32k -w 2,4 -- ./cachesim trace.bin
+// and each point appends its own "-c 32k -w 4 ..." to it. Prints the number of points, how many failed and the
+// wall time to stderr; exits 1 if any run failed.
+
+#include <stdint.h>
+#include <stdlib.h>     // atoi, exit
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+#include "SweepRunner.h"
+
+using namespace std;
+
+static void usage()
+{
+  cerr << "usage: sweep [-c sizes] [-w ways] [-l sizes] [-r policies] [-a flag=values] [-j jobs] [-o file] [-J] -- command [args...]" << endl;
+  exit(2);
+}
+
+static vector<string> splitValues( const string& arg )
+{
+  vector<string> values;
+  size_t first = 0;
+  for( size_t comma; (comma = arg.find(',', first)) != string::npos; first = comma + 1) {
+    values.push_back( arg.substr(first, comma - first) );
+  }
+  values.push_back( arg.substr(first) );
+  return values;
+}
+
+int main( int argc, char* argv[] )
+{
+  SweepRunner sweep;
+  unsigned int numJobs = 0;
+  string   outPath;
+  bool     json = false;
+  vector<string> command;
+
+  try {
+    int ii = 1;
+    for( ; ii < argc; ii++) {
+      string arg = argv[ii];
+      if( arg == "--" ) { ii++; break; }
+      if( arg == "-J" ) { json = true; continue; }
+      if( arg.size() != 2 || arg[0] != '-' || ii + 1 >= argc ) usage();
+      string value = argv[++ii];
+      switch( arg[1] ) {
+        case 'c': case 'w': case 'l': case 'r':
+          sweep.addAxis( arg, splitValues(value) );
+          break;
+        case 'a': {
+          size_t equals = value.find('=');
+          if( equals == string::npos || equals == 0 ) usage();
+          sweep.addAxis( value.substr(0, equals), splitValues(value.substr(equals + 1)) );
+          break;
+        }
+        case 'j': numJobs = atoi( value.c_str() ); break;
+        case 'o': outPath = value; break;
+        default:  usage();
+      }
+    }
+    for( ; ii < argc; ii++) command.push_back( argv[ii] );
+    if( command.empty() ) usage();
+    if( outPath.size() > 5 && outPath.compare(outPath.size() - 5, 5, ".json") == 0 ) json = true;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t failed = sweep.run( command, numJobs );
+    double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    cerr << "sweep: " << sweep.numPoints() << " points, " << failed << " failed, in " << seconds << " s" << endl;
+
+    ofstream file;
+    if( !outPath.empty() ) {
+      file.open( outPath.c_str(), ios::trunc );
+      if( !file ) throw runtime_error("cannot write " + outPath);
+    }
+    ostream& os = outPath.empty() ? cout : file;
+    if( json ) sweep.writeJSON( os );
+    else       sweep.writeCSV( os );
+    return failed ? 1 : 0;
+  }
+  catch( const exception& e ) {
+    cerr << "sweep: " << e.what() << endl;
+    return 1;
+  }
+}
@@ -33,6 +33,21 @@ TEST_CASE( "Basic CacheLine initialization", "[CacheLine]" ) {
         REQUIRE( *(cl.getData(4)) == 4 );
         REQUIRE( *(cl.getData(7)) == 7 );
     }
+    SECTION( "MESI state follows the valid, dirty and exclusive flags" ) {
+        REQUIRE( cl.getCoherenceState() == CoherenceInvalid );
+        cl.load( 1111, data1, LineSize8 );
+        REQUIRE( cl.getCoherenceState() == CoherenceShared );
+        cl.setExclusive( true );
+        REQUIRE( cl.getCoherenceState() == CoherenceExclusive );
+        cl.setDirty( true );
+        REQUIRE( cl.getCoherenceState() == CoherenceModified );
+        cl.setDirty( false );
+        cl.setExclusive( false );
+        REQUIRE( cl.getCoherenceState() == CoherenceShared );
+        cl.clearState();
+        REQUIRE( cl.getExclusive() == false );
+        REQUIRE( cl.getCoherenceState() == CoherenceInvalid );
+    }
   }
 
 // Experimneting with JSON as a way to mock class instances.
@@ -70,6 +70,745 @@ TEST_CASE( "Basic CacheStore initialization", "[CacheStore]" ) {
     }
 }
 
+TEST_CASE( "CacheStore contiguous line storage", "[CacheStore]" ) {
+
+    // 8 blocks of 2 ways, 8B (2 word) lines
+    CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+
+    SECTION( "line data is one slab indexed by line number" ) {
+      uint32_t* first = cs.getCacheBlock(0)->getData(0);
+      REQUIRE( cs.getCacheBlock(0)[1].getData(0) == first + 2 );
+      REQUIRE( cs.getCacheBlock(1)->getData(0) == first + 4 );
+      REQUIRE( cs.getCacheBlock(7)[1].getData(0) == first + 30 );
+    }
+    SECTION( "all lines start empty and invalid" ) {
+      for( int ii = 0; ii < 16; ii++ ) {
+        REQUIRE( cs.getCacheBlock(0)[ii].getEmpty() == true );
+        REQUIRE( cs.getCacheBlock(0)[ii].getValid() == false );
+      }
+    }
+    SECTION( "a line written through the store is visible through its CacheLine" ) {
+      uint32_t dmydata[2] = {42,43} ;
+      cs.setDataLine(0x8, dmydata);
+      CacheLine* cl = cs.getCacheLine(0x8);
+      REQUIRE( cl == cs.getCacheBlock(1) );
+      REQUIRE( cl->getValid() == true );
+      REQUIRE( *cl->getData(1) == 43 );
+      // a load() through the view never writes past its own slot
+      uint32_t bigdata[8] = {1,2,3,4,5,6,7,8} ;
+      cl->load( cl->getTag(), bigdata, LineSize8 );
+      REQUIRE( *cs.getCacheBlock(1)[1].getData(0) == 0 );
+    }
+}
+
+TEST_CASE( "CacheStore tag match kernels", "[CacheStore]" ) {
+
+    TagMatchKernel_t kernels[4] = { TagMatchScalar, TagMatchSSE41, TagMatchAVX2, TagMatchAVX512 };
+
+    SECTION( "every supported kernel agrees with the scalar loop" ) {
+      uint64_t tags[40];
+      for( int kk = 0; kk < 4; kk++ ) {
+        if( !isTagMatchKernelSupported(kernels[kk]) ) continue;
+        TagMatchFn fn = getTagMatchFunction(kernels[kk]);
+        for( uint64_t numWays = 1; numWays <= 40; numWays++ ) {
+          for( uint64_t ii = 0; ii < 40; ii++ ) tags[ii] = ii * 3;
+          tags[numWays-1] = CacheLine::EMPTY;
+          // every way that is present, one past the end, and a tag in no way at all
+          for( uint64_t ww = 0; ww < numWays; ww++ ) {
+            REQUIRE( fn(tags, numWays, tags[ww]) == tagMatchScalar(tags, numWays, tags[ww]) );
+          }
+          REQUIRE( fn(tags, numWays, numWays * 3) == tagMatchScalar(tags, numWays, numWays * 3) );
+          REQUIRE( fn(tags, numWays, 1) == numWays );
+          // duplicates report the first way
+          tags[numWays/2] = 7777;
+          tags[numWays-1] = 7777;
+          REQUIRE( fn(tags, numWays, 7777) == numWays/2 );
+        }
+      }
+    }
+    SECTION( "auto picks scalar for narrow blocks and something supported otherwise" ) {
+      CacheStore cs2(pow(2,10),pow(2,7),LineSize8,2);
+      REQUIRE( cs2.getTagMatchKernel() == TagMatchScalar );
+      CacheStore cs16(pow(2,16),pow(2,10),LineSize8,16);
+      REQUIRE( cs16.getTagMatchKernel() != TagMatchAuto );
+      REQUIRE( isTagMatchKernelSupported(cs16.getTagMatchKernel()) );
+    }
+    SECTION( "SIMD and scalar lookups give the same getCacheLine results" ) {
+      // 4 blocks of 16 ways; fill every block completely, then probe hits and misses with each kernel
+      CacheStore cs(pow(2,16),pow(2,9),LineSize8,16);
+      uint32_t dmydata[2] = {0,1} ;
+      for( uint64_t adr = 0; adr < 64 * 8; adr += 8 ) cs.setDataLine(adr, dmydata);
+      for( int kk = 0; kk < 4; kk++ ) {
+        if( !isTagMatchKernelSupported(kernels[kk]) ) continue;
+        cs.setTagMatchKernel(kernels[kk]);
+        REQUIRE( cs.getTagMatchKernel() == kernels[kk] );
+        for( uint64_t adr = 0; adr < 64 * 8; adr += 8 ) {
+          CacheLine* cl = cs.getCacheLine(adr);
+          REQUIRE( cl != NULL );
+          REQUIRE( cl->getTag() == cs.getCacheTag(adr) );
+          REQUIRE( cl == cs.getCacheBlock(cs.getCacheBlockIndex(adr)) + (adr / 32) );
+        }
+        REQUIRE( cs.getCacheLine(64 * 8) == NULL );
+      }
+    }
+}
+
+TEST_CASE( "CacheStoreT compile-time geometry", "[CacheStore]" ) {
+
+    // Same geometry as the "Basic CacheStore initialization" test: 128B of 8B lines, 2 ways, 8 blocks.
+    typedef CacheStoreT<LineSize8,2,8> FixedStore;
+    static_assert( FixedCacheGeometry<LineSize8,2,8>::bitsForLine() == 3, "bitsForLine" );
+    static_assert( FixedCacheGeometry<LineSize8,2,8>::cacheBlockIndexMask() == 7, "cacheBlockIndexMask" );
+    static_assert( FixedCacheGeometry<LineSize8,2,8>::bitShiftForCacheTag() == 6, "bitShiftForCacheTag" );
+
+    FixedStore cst(pow(2,10));
+    CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+
+    SECTION( "ctor arguments must agree with the template parameters" ) {
+      REQUIRE( cst.p_CacheSize == pow(2,7) );
+      REQUIRE( cst.p_LineSize == 8 );
+      REQUIRE( cst.p_NumWays == 2 );
+      REQUIRE_NOTHROW( FixedStore(pow(2,10),pow(2,7),LineSize8,2) );
+      REQUIRE_THROWS( FixedStore(pow(2,10),pow(2,8),LineSize8,2) );
+      REQUIRE_THROWS( FixedStore(pow(2,10),pow(2,7),LineSize16,1) );
+    }
+    SECTION( "address translation matches the runtime CacheStore" ) {
+      for( uint64_t adr = 0; adr < 0x2000; adr += 3 ) {
+        REQUIRE( cst.getCacheBlockIndex(adr) == cs.getCacheBlockIndex(adr) );
+        REQUIRE( cst.getCacheTag(adr) == cs.getCacheTag(adr) );
+        REQUIRE( cst.getByteIndex(adr) == cs.getByteIndex(adr) );
+        REQUIRE( cst.getWordIndex(adr) == cs.getWordIndex(adr) );
+        REQUIRE( cst.getLineAddress(adr) == cs.getLineAddress(adr) );
+      }
+    }
+    SECTION( "hits, misses and evictions match the runtime CacheStore" ) {
+      uint32_t dmydata[2] = {0,1} ;
+      uint32_t out1[2], out2[2];
+      for( uint64_t ii = 0; ii < 500; ii++ ) {
+        uint64_t adr = (ii * 0x48 + (ii >> 3) * 0x100) & 0x3FF;
+        dmydata[0] = (uint32_t)ii;
+        if( ii % 3 == 0 ) REQUIRE( cst.setDataLine(adr, dmydata) == cs.setDataLine(adr, dmydata) );
+        REQUIRE( cst.getDataLine(adr, out1) == cs.getDataLine(adr, out2) );
+      }
+    }
+}
+
+TEST_CASE( "CacheStore index functions and set counts", "[CacheStore]" ) {
+
+    SECTION( "FastModulo agrees with the % operator" ) {
+      uint64_t divisors[] = { 1, 2, 3, 7, 61, 24576, 393215, (1ULL << 32) + 15, 0xFFFFFFFFFFFFFFC5ULL };
+      uint64_t a = 0x9E3779B97F4A7C15ULL;
+      for( int dd = 0; dd < 9; dd++ ) {
+        FastModulo m(divisors[dd]);
+        for( int ii = 0; ii < 1000; ii++ ) {
+          a = a * 6364136223846793005ULL + 1442695040888963407ULL;
+          REQUIRE( m.mod(a) == a % divisors[dd] );
+          REQUIRE( m.mod(ii) == ii % divisors[dd] );
+        }
+        REQUIRE( m.mod(~0ULL) == ~0ULL % divisors[dd] );
+      }
+      REQUIRE( largestPrimeAtMost(64) == 61 );
+      REQUIRE( largestPrimeAtMost(2) == 2 );
+    }
+    SECTION( "sizes that do not fit together are refused" ) {
+      REQUIRE_THROWS( CacheStore(pow(2,20),3000,LineSize16,4) );        // not a multiple of line * ways
+      REQUIRE_THROWS( CacheStore(pow(2,20),24*1024,24,4) );             // line size not a power of 2
+      REQUIRE_THROWS( CacheStore(pow(2,20),pow(2,10),0,4) );            // no line size, no ways: refused, not divided by
+      REQUIRE_THROWS( CacheStore(pow(2,20),pow(2,10),LineSize16,0) );
+    }
+    SECTION( "12 ways and a set count that is not a power of 2" ) {
+      // 24 KiB of 64-byte lines, 12 ways: 32 sets; 24 KiB in 16 ways: 24 sets
+      CacheStore twelve(pow(2,30),24*1024,LineSize64,12);
+      REQUIRE( twelve.getNumCacheBlocks() == 32 );
+      CacheStore cs(pow(2,30),24*1024,LineSize64,16);
+      REQUIRE( cs.getNumCacheBlocks() == 24 );
+      REQUIRE( cs.getCacheBlockIndex(5 * 64) == 5 );
+      REQUIRE( cs.getCacheBlockIndex(29 * 64) == 5 );
+      // the tag is the whole line index, so the cached address can be recovered
+      REQUIRE( cs.getCacheTag(29 * 64 + 12) == 29 );
+      uint32_t line[16] = {0};
+      for( uint64_t ll = 0; ll < 24 * 16; ll++ ) {
+        line[0] = (uint32_t)ll;
+        REQUIRE( cs.setDataLine(ll * 64 * 7, line) == false );
+      }
+      for( uint64_t ll = 0; ll < 24 * 16; ll++ ) {
+        REQUIRE( cs.getDataLine(ll * 64 * 7, line) == true );    // 7 lines apart: every set gets 16 of them
+        REQUIRE( line[0] == ll );
+        CacheLine* cl = cs.getCacheLine(ll * 64 * 7);
+        REQUIRE( cs.getCachedLineAddress(cl - cs.getCacheBlock(0)) == ll * 64 * 7 );
+      }
+    }
+    SECTION( "XOR-fold and prime-modulo spread a power-of-2 stride that modulo piles into one set" ) {
+      // 64 sets of 4 ways, 16-byte lines; 32 lines 64 lines apart
+      CacheIndexHash_t hashes[] = { IndexModulo, IndexXorFold, IndexPrimeModulo };
+      uint64_t misses[3];
+      for( int hh = 0; hh < 3; hh++ ) {
+        CacheStore cs(pow(2,30),64*4*16,LineSize16,4,ReplLRU,hashes[hh]);
+        for( int pass = 0; pass < 2; pass++ ) {
+          for( uint64_t kk = 0; kk < 32; kk++ ) cs.allocateLine( kk * 64 * 16 );
+        }
+        misses[hh] = cs.getStats().misses();
+        // whatever the index function, a line is found again under its own address
+        for( uint64_t kk = 0; kk < 64; kk++ ) {
+          CacheLineRef ref = cs.allocateLine( kk * 1040 );
+          REQUIRE( cs.getCachedLineAddress(ref.line - cs.getCacheBlock(0)) == kk * 1040 );
+          REQUIRE( cs.getCacheBlockIndex(kk * 1040) < 64 );
+        }
+      }
+      REQUIRE( misses[0] == 64 );
+      REQUIRE( misses[1] == 32 );
+      REQUIRE( misses[2] == 32 );
+    }
+}
+
+TEST_CASE( "CacheStore zero-copy line access", "[CacheStore]" ) {
+
+    CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+    uint32_t dmydata[2] = {10,11} ;
+    uint32_t dataout[2] = {0,0} ;
+
+    SECTION( "accessLine borrows the cached line without copying" ) {
+      CacheLineRef miss = cs.accessLine(0x10);
+      REQUIRE( miss.isHit() == false );
+      REQUIRE( miss.data == NULL );
+
+      cs.setDataLine(0x10, dmydata);
+      CacheLineRef hit = cs.accessLine(0x14);
+      REQUIRE( hit.isHit() == true );
+      REQUIRE( hit.line == cs.getCacheLine(0x10) );
+      REQUIRE( hit.data == cs.getCacheLine(0x10)->getData(0) );
+      REQUIRE( hit.data[1] == 11 );
+    }
+    SECTION( "a write through the ref touches only its word and can be marked dirty" ) {
+      cs.setDataLine(0x10, dmydata);
+      CacheLineRef ref = cs.accessLine(0x14);
+      REQUIRE( ref.line->getDirty() == false );
+      uint32_t word = 99;
+      memcpy( ref.bytes() + cs.getByteIndex(0x14), &word, sizeof(word) );
+      ref.markDirty();
+      REQUIRE( ref.line->getDirty() == true );
+      REQUIRE( cs.getDataLine(0x10, dataout) == true );
+      REQUIRE( dataout[0] == 10 );
+      REQUIRE( dataout[1] == 99 );
+    }
+    SECTION( "allocateLine allocates a valid clean line on a miss and borrows it on a hit" ) {
+      CacheLineRef ref = cs.allocateLine(0x18);
+      REQUIRE( ref.isHit() == false );
+      REQUIRE( ref.data != NULL );
+      REQUIRE( ref.line->getValid() == true );
+      REQUIRE( ref.line->getDirty() == false );
+      REQUIRE( ref.line->getTag() == cs.getCacheTag(0x18) );
+      ref.data[0] = 5;
+      ref.data[1] = 6;
+      REQUIRE( cs.getDataLine(0x18, dataout) == true );
+      REQUIRE( dataout[1] == 6 );
+      CacheLineRef again = cs.allocateLine(0x1C);
+      REQUIRE( again.isHit() == true );
+      REQUIRE( again.line == ref.line );
+    }
+    SECTION( "a reused line does not inherit the dirty state of the line it replaced" ) {
+      // 0x00, 0x40, 0x80 all map to block 0 of 2 ways
+      cs.allocateLine(0x00).markDirty();
+      cs.allocateLine(0x40).markDirty();
+      CacheLineRef ref = cs.allocateLine(0x80);
+      REQUIRE( ref.isHit() == false );
+      REQUIRE( ref.line->getDirty() == false );
+    }
+}
+
+TEST_CASE( "CacheStore batched lookup", "[CacheStore]" ) {
+
+    // Two stores fed the same trace, one address at a time and in batches, must agree on every
+    // hit/miss, on the line returned, and on the replacement state left behind.
+    const size_t N = 1000;
+    std::vector<uint64_t> trace(N);
+    uint32_t seed = 12345;
+    for( size_t ii = 0; ii < N; ii++ ) {
+      seed = seed * 1103515245u + 12345u;
+      trace[ii] = (seed >> 8) & 0x3FFC;       // 16 KiB of memory, 4B aligned
+    }
+    std::vector<CacheLineRef> refs(N);
+
+    SECTION( "lookupMany matches accessLine" ) {
+      CacheStore one(pow(2,14),pow(2,10),LineSize16,4);
+      CacheStore many(pow(2,14),pow(2,10),LineSize16,4);
+      uint32_t dmydata[4] = {1,2,3,4} ;
+      for( size_t ii = 0; ii < N; ii += 3 ) {
+        one.setDataLine(trace[ii], dmydata);
+        many.setDataLine(trace[ii], dmydata);
+      }
+      many.lookupMany( &trace[0], N, &refs[0] );
+      for( size_t ii = 0; ii < N; ii++ ) {
+        CacheLineRef ref = one.accessLine( trace[ii] );
+        REQUIRE( refs[ii].isHit() == ref.isHit() );
+        if( ref.isHit() ) REQUIRE( refs[ii].line->getTag() == ref.line->getTag() );
+        else              REQUIRE( refs[ii].data == NULL );
+      }
+    }
+    SECTION( "lookupMany with allocateOnMiss matches allocateLine" ) {
+      CacheStore one(pow(2,14),pow(2,10),LineSize16,4);
+      CacheStore many(pow(2,14),pow(2,10),LineSize16,4);
+      many.lookupMany( &trace[0], N, &refs[0], true );
+      int hits = 0;
+      for( size_t ii = 0; ii < N; ii++ ) {
+        CacheLineRef ref = one.allocateLine( trace[ii] );
+        REQUIRE( refs[ii].isHit() == ref.isHit() );
+        REQUIRE( refs[ii].data != NULL );   // (a later address in the trace may have reused the line since)
+        hits += ref.isHit();
+      }
+      REQUIRE( hits > 0 );
+      // same lines left cached, so the replacement policies made the same choices
+      for( size_t ii = 0; ii < N; ii++ ) {
+        REQUIRE( (one.getCacheLine(trace[ii]) != NULL) == (many.getCacheLine(trace[ii]) != NULL) );
+      }
+    }
+    SECTION( "a batch that is not a multiple of the prefetch batch, and an empty one" ) {
+      CacheStore cs(pow(2,14),pow(2,10),LineSize16,4);
+      cs.lookupMany( &trace[0], 0, &refs[0], true );
+      cs.lookupMany( &trace[0], 17, &refs[0], true );
+      for( size_t ii = 0; ii < 17; ii++ ) {
+        REQUIRE( refs[ii].line->getTag() == cs.getCacheTag(trace[ii]) );
+        REQUIRE( refs[ii].data == refs[ii].line->getData(0) );
+      }
+    }
+    SECTION( "writes mark lines dirty as they are resolved, so a victim later in the batch is written back" ) {
+      // 0x0, 0x40 and 0x80 all map to block 0 of 2 ways
+      CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+      WriteBackQueue wbq(LineSize8, 2);
+      cs.setEvictionHandler(&wbq);
+      uint64_t adrs[]   = { 0x0,  0x40,  0x80,  0x8  };
+      bool     writes[] = { true, false, false, true };
+      cs.lookupMany( adrs, 4, &refs[0], true, writes );
+      REQUIRE( wbq.size() == 1 );
+      REQUIRE( wbq.frontAddress() == 0x0 );
+      REQUIRE( refs[3].line->getDirty() );
+      REQUIRE( !refs[2].line->getDirty() );
+      REQUIRE( cs.getStats().dirtyEvictions == 1 );
+    }
+}
+
+TEST_CASE( "CacheStore write-back of dirty lines", "[CacheStore]" ) {
+
+    // 8 blocks of 2 ways, 8B (2 word) lines; 0x0, 0x40, 0x80 all map to block 0
+    CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+    WriteBackQueue wbq(LineSize8, 2);
+    cs.setEvictionHandler(&wbq);
+
+    SECTION( "getCachedLineAddress inverts getCacheTag/getCacheBlockIndex" ) {
+      CacheLineRef ref = cs.allocateLine(0x3C8);
+      REQUIRE( cs.getCachedLineAddress(ref.line - cs.getCacheBlock(0)) == 0x3C8 );
+    }
+    SECTION( "only a dirty victim is handed to the handler" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      a.data[0] = 7; a.data[1] = 8;
+      a.markDirty();
+      cs.allocateLine(0x40);                // clean
+      cs.allocateLine(0x80);                // evicts 0x0 (LRU)
+      REQUIRE( wbq.size() == 1 );
+      REQUIRE( wbq.frontAddress() == 0x0 );
+      REQUIRE( wbq.frontData()[0] == 7 );
+      REQUIRE( wbq.frontData()[1] == 8 );
+      cs.allocateLine(0xC0);                // evicts clean 0x40
+      REQUIRE( wbq.size() == 1 );
+      wbq.pop();
+      REQUIRE( wbq.empty() );
+    }
+    SECTION( "the victim's data is copied out before the new line fills its slot" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      a.data[0] = 7;
+      a.markDirty();
+      cs.allocateLine(0x40);
+      CacheLineRef c = cs.allocateLine(0x80);
+      REQUIRE( c.data == a.data );
+      REQUIRE( c.line->getDirty() == false );
+      c.data[0] = 99;
+      REQUIRE( wbq.frontData()[0] == 7 );
+    }
+    SECTION( "flush hands over every dirty line and leaves them cached, but clean" ) {
+      uint64_t adrs[3] = {0x0, 0x8, 0x48};
+      for( int ii = 0; ii < 3; ii++ ) {
+        CacheLineRef ref = cs.allocateLine(adrs[ii]);
+        ref.data[1] = ii;
+        ref.markDirty();
+      }
+      cs.allocateLine(0x10);                // clean
+      REQUIRE( cs.flush() == 3 );
+      REQUIRE( wbq.size() == 3 );           // grew past its initial capacity of 2
+      REQUIRE( wbq.contains(0x0) );
+      REQUIRE( wbq.contains(0x8) );
+      REQUIRE( wbq.contains(0x48) );
+      REQUIRE( wbq.contains(0x10) == false );
+      for( int ii = 0; ii < 3; ii++ ) {
+        CacheLineRef ref = cs.accessLine(adrs[ii]);
+        REQUIRE( ref.isHit() );
+        REQUIRE( ref.line->getDirty() == false );
+      }
+      REQUIRE( cs.flush() == 0 );
+    }
+    SECTION( "an invalidated line is a miss, and allocateLine revalidates it in place" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      a.markDirty();
+      cs.invalidate(0x0);
+      REQUIRE( cs.accessLine(0x0).isHit() == false );
+      CacheLineRef b = cs.allocateLine(0x0);
+      REQUIRE( b.isHit() == false );
+      REQUIRE( b.line == a.line );
+      REQUIRE( b.line->getDirty() == false );
+      REQUIRE( wbq.empty() );               // nothing was evicted
+    }
+    SECTION( "the way of an invalidated line is reused before a valid line is evicted" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      cs.allocateLine(0x40).markDirty();
+      cs.invalidate(0x0);
+      CacheLineRef c = cs.allocateLine(0x80);
+      REQUIRE( c.line == a.line );
+      REQUIRE( cs.accessLine(0x40).isHit() );
+      REQUIRE( cs.getStats().evictions == 0 );
+      REQUIRE( wbq.empty() );
+    }
+    SECTION( "without a handler dirty data is dropped" ) {
+      cs.setEvictionHandler(NULL);
+      cs.allocateLine(0x0).markDirty();
+      REQUIRE( cs.flush() == 0 );
+      cs.allocateLine(0x40);
+      cs.allocateLine(0x80);
+      REQUIRE( wbq.empty() );
+    }
+}
+
+TEST_CASE( "WriteBackQueue", "[CacheStore]" ) {
+
+    WriteBackQueue wbq(LineSize16, 2);
+    uint32_t line[4] = {0,1,2,3};
+
+    SECTION( "is a FIFO that keeps its order when it grows" ) {
+      wbq.evictDirtyLine(0x10, line);
+      wbq.evictDirtyLine(0x20, line);
+      wbq.pop();
+      line[0] = 30;
+      wbq.evictDirtyLine(0x30, line);       // wraps around the ring
+      line[0] = 40;
+      wbq.evictDirtyLine(0x40, line);       // grows
+      REQUIRE( wbq.size() == 3 );
+      uint64_t expAdr[3]  = {0x20, 0x30, 0x40};
+      uint32_t expData[3] = {0, 30, 40};
+      for( int ii = 0; ii < 3; ii++ ) {
+        REQUIRE( wbq.frontAddress() == expAdr[ii] );
+        REQUIRE( wbq.frontData()[0] == expData[ii] );
+        REQUIRE( wbq.frontData()[3] == 3 );
+        wbq.pop();
+      }
+      REQUIRE( wbq.empty() );
+    }
+    SECTION( "cancel drops a line's pending writes, find returns the newest" ) {
+      wbq.evictDirtyLine(0x10, line);
+      line[0] = 20;
+      wbq.evictDirtyLine(0x20, line);
+      line[0] = 11;
+      wbq.evictDirtyLine(0x10, line);
+      REQUIRE( wbq.find(0x10)[0] == 11 );
+      REQUIRE( wbq.find(0x30) == NULL );
+      REQUIRE( wbq.cancel(0x10) == 2 );
+      REQUIRE( wbq.cancel(0x10) == 0 );
+      REQUIRE( wbq.size() == 1 );
+      REQUIRE( wbq.frontAddress() == 0x20 );
+      REQUIRE( wbq.frontData()[0] == 20 );
+    }
+    SECTION( "partial lines keep their sector masks and merge into the newest write of their line" ) {
+      wbq.setSectorSize(4);                 // a sector per word
+      wbq.evictDirtySectors(0x10, line, 0x2);
+      REQUIRE( wbq.frontIsWhole() == false );
+      REQUIRE( wbq.frontSectors() == 0x2 );
+      REQUIRE( wbq.frontData()[1] == 1 );
+      line[3] = 33;
+      wbq.evictDirtySectors(0x10, line, 0x8);
+      REQUIRE( wbq.size() == 1 );
+      REQUIRE( wbq.frontSectors() == 0xA );
+      REQUIRE( wbq.frontData()[3] == 33 );
+      wbq.evictDirtyLine(0x20, line);
+      REQUIRE( wbq.find(0x20) != NULL );
+      uint64_t sectors = 0;
+      REQUIRE( wbq.find(0x10, &sectors)[1] == 1 );
+      REQUIRE( sectors == 0xA );
+      wbq.pop();
+      REQUIRE( wbq.frontIsWhole() );
+      REQUIRE( wbq.frontSectors() == 0xF );
+    }
+}
+
+TEST_CASE( "CacheStore sectored lines", "[CacheStore]" ) {
+
+    // 8 blocks of 2 ways, 16B lines of 4 word sectors; 0x0, 0x80, 0x100 all map to block 0
+    CacheStore cs(pow(2,12),pow(2,8),LineSize16,2);
+    WriteBackQueue wbq(LineSize16, 2);
+    cs.setEvictionHandler(&wbq);
+    cs.setSectorSize(4);
+    wbq.setSectorSize(4);
+
+    SECTION( "sector sizes and masks" ) {
+      REQUIRE( cs.getNumSectors() == 4 );
+      REQUIRE( cs.getSectorMask(0x104, 4) == 0x2 );
+      REQUIRE( cs.getSectorMask(0x106, 4) == 0x6 );
+      REQUIRE( cs.getWholeSectorMask(0x106, 4) == 0 );
+      REQUIRE( cs.getWholeSectorMask(0x102, 12) == 0x6 );
+      REQUIRE( cs.getSectorMask(0x100, 16) == 0xF );
+      REQUIRE( cs.getWholeSectorMask(0x100, 16) == 0xF );
+      REQUIRE( cs.getSectorMask(0x100, 0) == 0 );
+      REQUIRE_THROWS( cs.setSectorSize(2) );
+      REQUIRE_THROWS( cs.setSectorSize(6) );
+      REQUIRE_THROWS( cs.setSectorSize(32) );
+      CacheStore big(pow(2,16),pow(2,12),LineSize1024,1);
+      REQUIRE_THROWS( big.setSectorSize(8) );  // 128 sectors
+      big.setSectorSize(16);
+      REQUIRE( big.getSectorMask(0x3F0, 16) == 1ULL << 63 );
+      REQUIRE( big.getSectorMask(0x0, 1024) == ~0ULL );
+    }
+    SECTION( "a line allocated whole, then dirtied a sector at a time" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      REQUIRE( a.line->isWhole() );
+      REQUIRE( a.line->getDirtySectors() == 0 );
+      a.markDirty(cs.getSectorMask(0x8, 4));
+      REQUIRE( a.line->getDirtySectors() == 0x4 );
+      a.markDirty();                        // the whole line
+      REQUIRE( a.line->getDirtySectors() == 0xF );
+      REQUIRE( cs.flush() == 1 );
+      REQUIRE( wbq.frontIsWhole() );
+      REQUIRE( a.line->getDirtySectors() == 0 );
+      a.markDirty(0x1);                     // a clean line starts a new dirty mask
+      REQUIRE( a.line->getDirtySectors() == 0x1 );
+    }
+    SECTION( "a partial line only hands its dirty sectors to the handler, on eviction or flush" ) {
+      CacheLineRef a = cs.allocateLine(0x0);
+      a.line->setValidSectors(0);
+      a.data[1] = 11;
+      a.markDirty(0x2);
+      REQUIRE( a.line->getValid() );
+      REQUIRE( a.line->getValidSectors() == 0x2 );
+      REQUIRE( a.line->isWhole() == false );
+      cs.allocateLine(0x80);
+      CacheLineRef c = cs.allocateLine(0x100);  // evicts 0x0 (LRU)
+      REQUIRE( wbq.size() == 1 );
+      REQUIRE( wbq.frontAddress() == 0x0 );
+      REQUIRE( wbq.frontSectors() == 0x2 );
+      REQUIRE( wbq.frontData()[1] == 11 );
+      REQUIRE( cs.getStats().dirtyEvictions == 1 );
+      wbq.pop();
+      c.line->setValidSectors(0);
+      c.data[3] = 33;
+      c.markDirty(0x8);
+      REQUIRE( cs.flush() == 1 );
+      REQUIRE( wbq.frontAddress() == 0x100 );
+      REQUIRE( wbq.frontSectors() == 0x8 );
+      REQUIRE( wbq.frontData()[3] == 33 );
+      REQUIRE( c.line->getDirtySectors() == 0 );
+      REQUIRE( c.line->getValidSectors() == 0x8 );
+    }
+    SECTION( "a handler that does not know sectors refuses partial lines" ) {
+      struct WholeLines : CacheEvictionHandler {
+        virtual void evictDirtyLine( uint64_t lineAddress, const uint32_t* data ) {}
+      } whole;
+      cs.setEvictionHandler(&whole);
+      CacheLineRef a = cs.allocateLine(0x0);
+      a.line->setValidSectors(0);
+      a.markDirty(0x1);
+      REQUIRE_THROWS( cs.flush() );
+    }
+    SECTION( "sectors survive a checkpoint, which only restores into a store of the same sector size" ) {
+      const char* path = "unittest_CacheStore.sectors.checkpoint";
+      CacheLineRef a = cs.allocateLine(0x40);
+      a.line->setValidSectors(0);
+      a.markDirty(0x4);
+      cs.saveCheckpoint(path);
+      for( int map = 0; map < 2; map++ ) {
+        CacheStore restored(pow(2,12),pow(2,8),LineSize16,2);
+        REQUIRE_THROWS( restored.restoreCheckpoint(path, map == 1) );
+        restored.setSectorSize(4);
+        restored.restoreCheckpoint(path, map == 1);
+        CacheLineRef b = restored.accessLine(0x40);
+        REQUIRE( b.isHit() );
+        REQUIRE( b.line->getValidSectors() == 0x4 );
+        REQUIRE( b.line->getDirtySectors() == 0x4 );
+      }
+      remove(path);
+    }
+    SECTION( "lines cached before the store was sectored count as whole" ) {
+      CacheStore plain(pow(2,12),pow(2,8),LineSize16,2);
+      plain.allocateLine(0x0).markDirty();
+      plain.allocateLine(0x10);
+      plain.setSectorSize(8);
+      REQUIRE( plain.accessLine(0x0).line->getDirtySectors() == 0x3 );
+      REQUIRE( plain.accessLine(0x10).line->isWhole() );
+      REQUIRE( plain.accessLine(0x10).line->getDirtySectors() == 0 );
+    }
+}
+
+TEST_CASE( "CacheStore statistics", "[CacheStore]" ) {
+
+    // 8 blocks of 2 ways, 8B (2 word) lines; 0x0, 0x40, 0x80 all map to block 0
+    CacheStore cs(pow(2,10),pow(2,7),LineSize8,2);
+    WriteBackQueue wbq(LineSize8, 2);
+    cs.setEvictionHandler(&wbq);
+
+    SECTION( "counts lookups, hits, fills and evictions" ) {
+      cs.allocateLine(0x0).markDirty();     // miss, fill
+      cs.allocateLine(0x40);                // miss, fill
+      cs.accessLine(0x4);                   // hit
+      cs.allocateLine(0x80);                // miss, fill, evicts clean 0x40
+      cs.accessLine(0x48);                  // miss
+      CacheStoreStats stats = cs.getStats();
+      REQUIRE( stats.lookups == 5 );
+      REQUIRE( stats.hits == 1 );
+      REQUIRE( stats.misses() == 4 );
+      REQUIRE( stats.fills == 3 );
+      REQUIRE( stats.evictions == 1 );
+      REQUIRE( stats.dirtyEvictions == 0 );
+      cs.allocateLine(0xC0);                // evicts dirty 0x0
+      REQUIRE( cs.getStats().dirtyEvictions == 1 );
+      cs.allocateLine(0xC0).markDirty();
+      REQUIRE( cs.flush() == 1 );
+      REQUIRE( cs.getStats().flushedLines == 1 );
+      cs.resetStats();
+      REQUIRE( cs.getStats().lookups == 0 );
+      REQUIRE( cs.getStats().hitRate() == 0.0 );
+    }
+    SECTION( "peekLine is neither counted nor seen by the replacement policy" ) {
+      cs.allocateLine(0x0);
+      cs.allocateLine(0x40);
+      uint64_t lookups = cs.getStats().lookups;
+      REQUIRE( cs.peekLine(0x0).isHit() );
+      REQUIRE( cs.peekLine(0x8).isHit() == false );
+      REQUIRE( cs.getStats().lookups == lookups );
+      cs.allocateLine(0x80);                // 0x0 is still the LRU line
+      REQUIRE( cs.peekLine(0x0).isHit() == false );
+      REQUIRE( cs.peekLine(0x40).isHit() );
+    }
+    SECTION( "per-set access and conflict counters are off until enabled" ) {
+      cs.allocateLine(0x0);
+      REQUIRE( cs.getSetStatsEnabled() == false );
+      REQUIRE( cs.getSetAccesses(0) == 0 );
+      cs.enableSetStats(true);
+      cs.allocateLine(0x0);
+      cs.allocateLine(0x40);
+      cs.allocateLine(0x80);                // conflict in block 0
+      cs.allocateLine(0x8);                 // block 1
+      REQUIRE( cs.getSetAccesses(0) == 3 );
+      REQUIRE( cs.getSetConflicts(0) == 1 );
+      REQUIRE( cs.getSetAccesses(1) == 1 );
+      REQUIRE( cs.getSetConflicts(1) == 0 );
+      std::ostringstream os;
+      cs.dumpSetStats(os);
+      REQUIRE( os.str() == "0 3 1\n1 1 0\n" );
+    }
+    SECTION( "prefetched lines evicted before any use are counted" ) {
+      cs.allocateLine(0x0).line->setPrefetched(true);
+      CacheLineRef b = cs.allocateLine(0x40);
+      b.line->setPrefetched(true);
+      b.line->setPrefetched(false);         // used by a demand access
+      cs.allocateLine(0x80);                // evicts 0x0
+      cs.allocateLine(0xC0);                // evicts 0x40
+      REQUIRE( cs.getStats().evictions == 2 );
+      REQUIRE( cs.getStats().unusedPrefetches == 1 );
+      REQUIRE( cs.allocateLine(0x100).line->getPrefetched() == false );
+    }
+    SECTION( "partitions are summed, and must be a power of 2" ) {
+      cs.allocateLine(0x0);
+      cs.setStatsPartitions(4);
+      cs.allocateLine(0x8);                 // block 1
+      cs.allocateLine(0x18);                // block 3
+      cs.accessLine(0x0);
+      CacheStoreStats stats = cs.getStats();
+      REQUIRE( stats.lookups == 4 );
+      REQUIRE( stats.hits == 1 );
+      REQUIRE( stats.fills == 3 );
+      REQUIRE_THROWS( cs.setStatsPartitions(3) );
+    }
+}
+
+// Do two stores hold the same lines: tags, state and data?
+static bool sameLines( CacheStore& a, CacheStore& b, uint64_t numLines )
+{
+    for( uint64_t ii = 0; ii < numLines; ii++ ) {
+      CacheLine* la = a.getCacheBlock(0) + ii;
+      CacheLine* lb = b.getCacheBlock(0) + ii;
+      if( la->getTag() != lb->getTag() || la->getValid() != lb->getValid() || la->getDirty() != lb->getDirty() ) return false;
+      for( uint32_t ww = 0; ww < LineSize16 / 4; ww++ ) {
+        if( *la->getData(ww) != *lb->getData(ww) ) return false;
+      }
+    }
+    return true;
+}
+
+TEST_CASE( "CacheStore checkpoints", "[CacheStore]" ) {
+
+    const char* path = "unittest_CacheStore.checkpoint";
+    // 16 blocks of 4 ways, 16B lines
+    const uint64_t numLines = 64;
+    ReplacementPolicy_t policies[4] = { ReplLRU, ReplTreePLRU, ReplFIFO, ReplRandom };
+
+    for( int pp = 0; pp < 4; pp++ ) {
+      CacheStore warm(pow(2,16),pow(2,10),LineSize16,4,policies[pp]);
+      srand(pp);
+      for( int ii = 0; ii < 2000; ii++ ) {
+        uint64_t adr = (rand() % 4096) * 16;
+        CacheLineRef ref = warm.allocateLine(adr);
+        if( !ref.isHit() ) ref.data[0] = (uint32_t)adr;
+        if( rand() % 4 == 0 ) { ref.data[1] = ii; ref.markDirty(); }
+      }
+      warm.invalidate( warm.getCachedLineAddress(5) );
+      warm.saveCheckpoint(path);
+
+      for( int map = 0; map < 2; map++ ) {
+        CacheStore restored(pow(2,16),pow(2,10),LineSize16,4,policies[pp]);
+        restored.restoreCheckpoint(path, map == 1);
+        REQUIRE( restored.isMappedFromCheckpoint() == (map == 1) );
+        REQUIRE( sameLines(warm, restored, numLines) );
+
+        // the replacement metadata came along: both stores evict the same lines from here on
+        CacheStore twin(pow(2,16),pow(2,10),LineSize16,4,policies[pp]);
+        twin.restoreCheckpoint(path, map == 1);
+        for( int ii = 0; ii < 500; ii++ ) {
+          uint64_t adr = (rand() % 4096) * 16;
+          CacheLineRef a = twin.allocateLine(adr);
+          CacheLineRef b = restored.allocateLine(adr);
+          REQUIRE( a.isHit() == b.isHit() );
+          a.data[2] = b.data[2] = ii;
+          a.markDirty();
+          b.markDirty();
+        }
+        REQUIRE( sameLines(twin, restored, numLines) );
+        REQUIRE( sameLines(warm, restored, numLines) == false );
+      }
+
+      // writes to a mapped store never reach the file
+      CacheStore again(pow(2,16),pow(2,10),LineSize16,4,policies[pp]);
+      again.restoreCheckpoint(path);
+      REQUIRE( sameLines(warm, again, numLines) );
+    }
+
+    SECTION( "a checkpoint only restores into a store of the same configuration" ) {
+      CacheStore warm(pow(2,16),pow(2,10),LineSize16,4);
+      warm.saveCheckpoint(path);
+      CacheStore otherWays(pow(2,16),pow(2,10),LineSize16,2);
+      REQUIRE_THROWS( otherWays.restoreCheckpoint(path) );
+      CacheStore otherPolicy(pow(2,16),pow(2,10),LineSize16,4,ReplFIFO);
+      REQUIRE_THROWS( otherPolicy.restoreCheckpoint(path) );
+      CacheStore otherIndex(pow(2,16),pow(2,10),LineSize16,4,ReplLRU,IndexXorFold);
+      REQUIRE_THROWS( otherIndex.restoreCheckpoint(path) );
+      REQUIRE_THROWS( warm.restoreCheckpoint("no/such/checkpoint") );
+    }
+    SECTION( "a truncated checkpoint is refused and the store is left alone" ) {
+      CacheStore warm(pow(2,16),pow(2,10),LineSize16,4);
+      warm.allocateLine(0x40).data[0] = 7;
+      warm.saveCheckpoint(path);
+      REQUIRE( truncate(path, 66000) == 0 );     // the arrays start at 64K
+      CacheStore restored(pow(2,16),pow(2,10),LineSize16,4);
+      REQUIRE_THROWS( restored.restoreCheckpoint(path) );
+      REQUIRE( restored.isMappedFromCheckpoint() == false );
+      REQUIRE( restored.accessLine(0x40).isHit() == false );
+    }
+    remove(path);
+}
+
 // Experimneting with JSON as a way to mock class instances.
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
@@ -110,7 +849,7 @@ public:
       cacheLine.Accept(writer);
       string s = buffer.GetString();
       CacheLineJSON clj((CacheLineSize_t)lineSize,s.c_str());
-      this->m_cacheLines[ii] = clj; // TODO: what is happening here? default assignment operator???
+      this->m_cacheLines[ii] = clj; // CacheLine::operator= copies tag, state and data into the store's line
     }
   }
   bool dump(int numCacheLines) {
@@ -257,8 +996,8 @@ TEST_CASE( "CacheStore newCacheLine", "[CacheStore]" ) {
         cl_4->load( cs.getCacheTag(adr4), dmydata, LineSize8);
         REQUIRE(cl_4->getEmpty() == false);
         REQUIRE( cl_4->getTag() == 3072 );
-        // This will fail until I implement LRU eviction rule for CacheLines within a block
-        CHECK_NOFAIL( cl_4 == cl_2 );
+        // LRU: cl_2 is now the least recently filled line of the block
+        REQUIRE( cl_4 == cl_2 );
     }
 }
 
@@ -0,0 +1,62 @@
+// Simple file uses "catch2" as a unittest framework for testing the MSHR model.
+// Times are plain tick counts here; RealCache uses sc_time.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "MSHRFile.h"
+
+using namespace std;
+
+TEST_CASE( "MSHRFile", "[MSHRFile]" ) {
+
+    // 2 fills in flight at most, each serving up to 3 accesses
+    MSHRFileT<uint64_t> mshrs(2, 3);
+    uint64_t ready = 0;
+
+    SECTION( "without entries nothing is modelled" ) {
+      MSHRFileT<uint64_t> none;
+      REQUIRE( none.enabled() == false );
+      REQUIRE( mshrs.enabled() );
+      REQUIRE_THROWS( MSHRFileT<uint64_t>(4, 0) );
+    }
+    SECTION( "an access to a line in flight joins its fill, until the fill is done" ) {
+      REQUIRE( mshrs.issue(100) == 100 );
+      mshrs.allocate(0x40, 200);
+      REQUIRE( mshrs.merge(0x80, 150, ready) == false );
+      REQUIRE( mshrs.merge(0x40, 150, ready) );
+      REQUIRE( ready == 200 );
+      REQUIRE( mshrs.merge(0x40, 200, ready) == false );   // the data is back
+      REQUIRE( mshrs.getStats().primaryMisses == 1 );
+      REQUIRE( mshrs.getStats().secondaryMisses == 1 );
+    }
+    SECTION( "an entry with no target left makes the access stall for the fill" ) {
+      mshrs.allocate(0x40, 200);
+      REQUIRE( mshrs.merge(0x40, 110, ready) );
+      REQUIRE( mshrs.merge(0x40, 120, ready) );
+      REQUIRE( mshrs.merge(0x40, 130, ready) );
+      REQUIRE( ready == 200 );
+      REQUIRE( mshrs.getStats().secondaryMisses == 2 );
+      REQUIRE( mshrs.getStats().targetStalls == 1 );
+    }
+    SECTION( "a miss with all entries busy waits for the first to complete" ) {
+      mshrs.allocate(0x40, 300);
+      mshrs.allocate(0x80, 250);
+      REQUIRE( mshrs.inFlight(100) == 2 );
+      REQUIRE( mshrs.issue(100) == 250 );
+      REQUIRE( mshrs.getStats().fullStalls == 1 );
+      REQUIRE( mshrs.inFlight(250) == 1 );
+      mshrs.allocate(0xC0, 400);
+      REQUIRE( mshrs.issue(260) == 300 );
+      REQUIRE( mshrs.getStats().fullStalls == 2 );
+    }
+    SECTION( "a prefetch takes an entry if one is free, and is not a primary miss" ) {
+      REQUIRE( mshrs.tryIssue(100) );
+      mshrs.allocate(0x40, 300, false);
+      mshrs.allocate(0x80, 300);
+      REQUIRE( mshrs.tryIssue(200) == false );
+      REQUIRE( mshrs.getStats().primaryMisses == 1 );
+      // a demand access joining the prefetch's fill is its first target
+      REQUIRE( mshrs.merge(0x40, 200, ready) );
+      REQUIRE( mshrs.getStats().secondaryMisses == 1 );
+      REQUIRE( mshrs.tryIssue(300) );
+    }
+}
@@ -0,0 +1,130 @@
+// Simple file uses "catch2" as a unittest framework for testing the image loader of the memory models.
+// Each image is written to a temporary file first; the ELF ones are put together here from <elf.h>.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include <stdio.h>
+#include <fstream>
+#include "MemoryImage.h"
+
+using namespace std;
+
+static string writeImage( const char* name, const string& contents )
+{
+  string path = string("/tmp/unittest_MemoryImage_") + name;
+  ofstream os( path.c_str(), ios::binary | ios::trunc );
+  os << contents;
+  return path;
+}
+
+// A 64-bit ELF with a text segment at 0x1000 of the file, loaded at 0x80000000, and a data segment with .bss.
+static string elfImage()
+{
+  string file( 0x2000 + 16, '\0' );
+  Elf64_Ehdr header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.e_ident, ELFMAG, SELFMAG );
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ? ELFDATA2LSB : ELFDATA2MSB;
+  header.e_entry = 0x80000010;
+  header.e_phoff = sizeof(header);
+  header.e_phentsize = sizeof(Elf64_Phdr);
+  header.e_phnum = 3;
+  Elf64_Phdr programs[3];
+  memset( programs, 0, sizeof(programs) );
+  programs[0].p_type = PT_LOAD;
+  programs[0].p_offset = 0x1000;
+  programs[0].p_vaddr = programs[0].p_paddr = 0x80000000;
+  programs[0].p_filesz = programs[0].p_memsz = 0x1000;
+  programs[1].p_type = PT_NOTE;
+  programs[2].p_type = PT_LOAD;
+  programs[2].p_offset = 0x2000;
+  programs[2].p_vaddr = programs[2].p_paddr = 0x80002000;
+  programs[2].p_filesz = 16;
+  programs[2].p_memsz = 64;
+  memcpy( &file[0], &header, sizeof(header) );
+  memcpy( &file[sizeof(header)], programs, sizeof(programs) );
+  file[0x1000] = 'T';
+  file[0x2000] = 'D';
+  return file;
+}
+
+TEST_CASE( "MemoryImage", "[MemoryImage]" ) {
+
+    SECTION( "the format follows the file name, then the ELF magic" ) {
+      string elf = writeImage( "detect.elf", elfImage() );
+      string raw = writeImage( "detect.bin", "\x7f" "EL" );
+      string hex = writeImage( "detect.hex", ":00000001FF\n" );
+      REQUIRE( detectImageFormat(elf) == ImageELF );
+      REQUIRE( detectImageFormat(raw) == ImageRaw );
+      REQUIRE( detectImageFormat(hex) == ImageIntelHex );
+      REQUIRE_THROWS( detectImageFormat("/tmp/unittest_MemoryImage_missing") );
+      remove( elf.c_str() );
+      remove( raw.c_str() );
+      remove( hex.c_str() );
+    }
+    SECTION( "raw: the whole file at the load address, straight from the mapping" ) {
+      string path = writeImage( "raw.bin", "0123456789" );
+      MemoryImage image( path, ImageRaw, 0x4000 );
+      REQUIRE( image.getSegments().size() == 1 );
+      const MemoryImage::Segment& segment = image.getSegments()[0];
+      REQUIRE( segment.address == 0x4000 );
+      REQUIRE( segment.fileSize == 10 );
+      REQUIRE( segment.memSize == 10 );
+      REQUIRE( segment.fileOffset == 0 );
+      REQUIRE( memcmp(segment.data, "0123456789", 10) == 0 );
+      REQUIRE( image.contains(segment.data + 9) );
+      REQUIRE( !image.contains(segment.data + 10) );
+      remove( path.c_str() );
+    }
+    SECTION( "ELF: the PT_LOAD segments at their physical addresses, .bss included" ) {
+      string path = writeImage( "image.elf", elfImage() );
+      MemoryImage image( path, ImageELF );
+      REQUIRE( image.getEntry() == 0x80000010 );
+      REQUIRE( image.getSegments().size() == 2 );
+      const MemoryImage::Segment& text = image.getSegments()[0];
+      const MemoryImage::Segment& data = image.getSegments()[1];
+      REQUIRE( text.address == 0x80000000 );
+      REQUIRE( text.fileOffset == 0x1000 );
+      REQUIRE( text.fileSize == 0x1000 );
+      REQUIRE( text.data[0] == 'T' );
+      REQUIRE( data.address == 0x80002000 );
+      REQUIRE( data.fileSize == 16 );
+      REQUIRE( data.memSize == 64 );
+      REQUIRE( data.data[0] == 'D' );
+
+      string truncated = writeImage( "truncated.elf", elfImage().substr(0, 0x1800) );
+      REQUIRE_THROWS( MemoryImage(truncated, ImageELF) );
+      remove( path.c_str() );
+      remove( truncated.c_str() );
+    }
+    SECTION( "Intel HEX: contiguous records make one segment, extended addresses move the rest" ) {
+      string path = writeImage( "image.hex",
+        ":0400100001020304E2\r\n"
+        ":020014000506DF\r\n"
+        ":020000040001F9\r\n"
+        ":0100000007F8\r\n"
+        ":0400000500000100F6\r\n"
+        ":00000001FF\r\n"
+        ":01000000FF00\r\n" );     // after the end of file record: ignored
+      MemoryImage image( path, ImageIntelHex );
+      REQUIRE( image.getSegments().size() == 2 );
+      const MemoryImage::Segment& first = image.getSegments()[0];
+      REQUIRE( first.address == 0x10 );
+      REQUIRE( first.fileSize == 6 );
+      REQUIRE( first.fileOffset == -1 );
+      REQUIRE( memcmp(first.data, "\x01\x02\x03\x04\x05\x06", 6) == 0 );
+      REQUIRE( image.getSegments()[1].address == 0x10000 );
+      REQUIRE( image.getSegments()[1].data[0] == 7 );
+      REQUIRE( image.getEntry() == 0x100 );
+      remove( path.c_str() );
+    }
+    SECTION( "Intel HEX: bad checksums, digits and lengths throw" ) {
+      const char* bad[] = { ":0400100001020304E3\n", ":04001000010203G4E2\n", ":0500100001020304E2\n", "0400100001020304E2\n",
+                            ":00000002FE\n" };
+      for( size_t ii = 0; ii < sizeof(bad) / sizeof(bad[0]); ii++) {
+        string path = writeImage( "bad.hex", bad[ii] );
+        REQUIRE_THROWS( MemoryImage(path, ImageIntelHex) );
+        remove( path.c_str() );
+      }
+    }
+  }
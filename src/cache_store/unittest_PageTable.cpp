@@ -0,0 +1,95 @@
+// Simple file uses "catch2" as a unittest framework for testing the radix page table of the memory models.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include <vector>
+#include <utility>
+#include "PageTable.h"
+
+using namespace std;
+
+TEST_CASE( "PageTable", "[PageTable]" ) {
+
+    PageTableT<uint32_t> table;
+    uint32_t pages[4][16];
+
+    SECTION( "a page is found under its number only" ) {
+      REQUIRE( table.find(0) == NULL );
+      table.insert( 0x12345, pages[0] );
+      REQUIRE( table.find(0x12345) == pages[0] );
+      REQUIRE( table.find(0x12344) == NULL );
+      REQUIRE( table.find(0x12345 + PageTableT<uint32_t>::FANOUT) == NULL );
+      REQUIRE( table.size() == 1 );
+    }
+    SECTION( "page numbers span every level" ) {
+      uint64_t last = PageTableT<uint32_t>::MAX_PAGES - 1;
+      table.insert( last, pages[1] );
+      table.insert( 1ULL << 40, pages[2] );
+      REQUIRE( table.find(last) == pages[1] );
+      REQUIRE( table.find(1ULL << 40) == pages[2] );
+      REQUIRE( table.find(0) == NULL );
+      REQUIRE_THROWS( table.insert(PageTableT<uint32_t>::MAX_PAGES, pages[3]) );
+    }
+    SECTION( "insert replaces, and inserting NULL removes" ) {
+      table.insert( 7, pages[0] );
+      table.insert( 7, pages[1] );
+      REQUIRE( table.find(7) == pages[1] );
+      REQUIRE( table.size() == 1 );
+      table.insert( 7, NULL );
+      REQUIRE( table.find(7) == NULL );
+      REQUIRE( table.size() == 0 );
+    }
+    SECTION( "forEach walks the pages in order of page number" ) {
+      table.insert( 1ULL << 40, pages[3] );
+      table.insert( 5, pages[1] );
+      table.insert( 0, pages[0] );
+      table.insert( 1ULL << 20, pages[2] );
+      vector< pair<uint64_t, uint32_t*> > walked;
+      table.forEach( [&walked](uint64_t pageID, uint32_t* page) { walked.push_back( make_pair(pageID, page) ); } );
+      REQUIRE( walked.size() == 4 );
+      REQUIRE( walked[0] == make_pair((uint64_t)0, &pages[0][0]) );
+      REQUIRE( walked[1] == make_pair((uint64_t)5, &pages[1][0]) );
+      REQUIRE( walked[2] == make_pair((uint64_t)1 << 20, &pages[2][0]) );
+      REQUIRE( walked[3] == make_pair((uint64_t)1 << 40, &pages[3][0]) );
+    }
+  }
+
+TEST_CASE( "PageTLB", "[PageTable]" ) {
+
+    PageTLBT<uint32_t, 4> tlb;
+    uint32_t pages[2][16];
+
+    SECTION( "a translation is found once filled, until another page takes its entry" ) {
+      REQUIRE( tlb.find(3) == NULL );
+      tlb.fill( 3, pages[0] );
+      REQUIRE( tlb.find(3) == pages[0] );
+      tlb.fill( 7, pages[1] );      // same entry
+      REQUIRE( tlb.find(3) == NULL );
+      REQUIRE( tlb.find(7) == pages[1] );
+      REQUIRE( tlb.getStats().lookups == 4 );
+      REQUIRE( tlb.getStats().hits == 2 );
+    }
+    SECTION( "invalidate drops only the page's own translation" ) {
+      tlb.fill( 3, pages[0] );
+      tlb.invalidate( 7 );
+      REQUIRE( tlb.find(3) == pages[0] );
+      tlb.invalidate( 3 );
+      REQUIRE( tlb.find(3) == NULL );
+      tlb.fill( 0, pages[0] );
+      tlb.fill( 1, pages[1] );
+      tlb.flush();
+      REQUIRE( tlb.find(0) == NULL );
+      REQUIRE( tlb.find(1) == NULL );
+      REQUIRE( tlb.getStats().invalidations == 3 );
+    }
+    SECTION( "a sequential scan of 1024-word pages misses once per page" ) {
+      PageTableT<uint32_t> table;
+      uint32_t page[1024];
+      for( uint64_t pageID = 0; pageID < 8; pageID++) table.insert( pageID, page );
+      for( uint64_t adr = 0; adr < 8 * 1024; adr++) {
+        uint64_t pageID = adr / 1024;
+        if( tlb.find(pageID) == NULL ) tlb.fill( pageID, table.find(pageID) );
+      }
+      REQUIRE( tlb.getStats().misses() == 8 );
+      REQUIRE( tlb.getStats().hits == 8 * 1023 );
+    }
+  }
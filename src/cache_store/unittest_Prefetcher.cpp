@@ -0,0 +1,82 @@
+// Simple file uses "catch2" as a unittest framework for testing the prefetcher models.
+// Each Prefetcher is fed a miss stream directly and its candidates are checked.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "Prefetcher.h"
+
+using namespace std;
+
+TEST_CASE( "Prefetcher candidates", "[Prefetcher]" ) {
+
+    vector<uint64_t> candidates;
+
+    SECTION( "next-line prefetches degree lines, distance lines ahead" ) {
+      NextLinePrefetcher nl(8, 2, 3);
+      nl.train(0x40, candidates);
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x58 );
+      REQUIRE( candidates[1] == 0x60 );
+    }
+    SECTION( "stride waits for the same stride twice, in either direction" ) {
+      StridePrefetcher st(8, 2, 1);
+      st.train(0x100, candidates);
+      st.train(0x120, candidates);
+      REQUIRE( candidates.empty() );
+      st.train(0x140, candidates);
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x160 );
+      REQUIRE( candidates[1] == 0x180 );
+      candidates.clear();
+      st.train(0x148, candidates);          // stride changes: retrain
+      REQUIRE( candidates.empty() );
+      st.train(0x140, candidates);
+      st.train(0x138, candidates);
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x130 );
+      REQUIRE( candidates[1] == 0x128 );
+    }
+    SECTION( "candidates never wrap below address 0" ) {
+      StridePrefetcher st(8, 4, 1);
+      st.train(0x20, candidates);
+      st.train(0x10, candidates);
+      st.train(0x0, candidates);
+      REQUIRE( candidates.empty() );
+    }
+    SECTION( "a stream learns its direction from its second miss and follows it" ) {
+      StreamPrefetcher sp(8, 2, 1);
+      sp.train(0x200, candidates);
+      REQUIRE( candidates.empty() );
+      sp.train(0x1F0, candidates);          // two lines below: a descending stream
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x1E8 );
+      REQUIRE( candidates[1] == 0x1E0 );
+      candidates.clear();
+      sp.train(0x1F8, candidates);          // behind the head: not this stream
+      REQUIRE( candidates.empty() );
+      sp.train(0x1E8, candidates);
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x1E0 );
+    }
+    SECTION( "independent streams are tracked side by side" ) {
+      StreamPrefetcher sp(8, 1, 1);
+      sp.train(0x1000, candidates);
+      sp.train(0x8000, candidates);
+      sp.train(0x1008, candidates);
+      sp.train(0x8008, candidates);
+      REQUIRE( candidates.size() == 2 );
+      REQUIRE( candidates[0] == 0x1010 );
+      REQUIRE( candidates[1] == 0x8010 );
+      candidates.clear();
+      sp.train(0x4000, candidates);         // far from both: a new stream
+      REQUIRE( candidates.empty() );
+    }
+    SECTION( "the factory" ) {
+      REQUIRE( createPrefetcher(PrefetchNone, 8) == NULL );
+      Prefetcher* p = createPrefetcher(PrefetchStream, 8, 4, 2);
+      REQUIRE( p->getType() == PrefetchStream );
+      REQUIRE( p->getDegree() == 4 );
+      REQUIRE( p->getDistance() == 2 );
+      delete p;
+      REQUIRE_THROWS( createPrefetcher(PrefetchNextLine, 8, 0) );
+    }
+}
@@ -0,0 +1,105 @@
+// Simple file uses "catch2" as a unittest framework for testing the CacheStore replacement policies.
+// First TestCase drives each ReplacementPolicy directly on a single 4-way block.
+// Then, the policies are exercised through CacheStore.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "CacheStore.h"
+
+using namespace std;
+
+TEST_CASE( "ReplacementPolicy victims on one 4-way block", "[ReplacementPolicy]" ) {
+
+    SECTION( "LRU evicts the least recently touched way" ) {
+      LRUReplacementPolicy lru(2,4);
+      REQUIRE( lru.victim(0) == 0 );
+      for( int ww = 0; ww < 4; ww++ ) lru.fill(0,ww);
+      REQUIRE( lru.victim(0) == 0 );
+      lru.touch(0,0);
+      REQUIRE( lru.victim(0) == 1 );
+      lru.touch(0,2);
+      lru.touch(0,1);
+      REQUIRE( lru.victim(0) == 3 );
+      lru.touch(0,3);
+      REQUIRE( lru.victim(0) == 0 );
+      // the other block is unaffected
+      REQUIRE( lru.victim(1) == 0 );
+    }
+    SECTION( "tree-PLRU never evicts the way just touched and follows the tree" ) {
+      TreePLRUReplacementPolicy plru(1,4);
+      for( int ww = 0; ww < 4; ww++ ) plru.fill(0,ww);
+      // after touching 0,1,2,3 in order, the tree points at the left pair and then at way 0
+      REQUIRE( plru.victim(0) == 0 );
+      plru.touch(0,0);
+      REQUIRE( plru.victim(0) == 2 );
+      plru.touch(0,2);
+      REQUIRE( plru.victim(0) == 1 );
+      for( int ww = 0; ww < 4; ww++ ) {
+        plru.touch(0,ww);
+        REQUIRE( plru.victim(0) != (uint64_t)ww );
+      }
+      REQUIRE_THROWS( TreePLRUReplacementPolicy(1,6) );
+    }
+    SECTION( "FIFO evicts in fill order regardless of hits" ) {
+      FIFOReplacementPolicy fifo(1,4);
+      for( int ww = 0; ww < 4; ww++ ) fifo.fill(0,ww);
+      REQUIRE( fifo.victim(0) == 0 );
+      fifo.touch(0,0);
+      REQUIRE( fifo.victim(0) == 0 );
+      fifo.fill(0,0);
+      REQUIRE( fifo.victim(0) == 1 );
+      fifo.fill(0,1);
+      fifo.fill(0,2);
+      fifo.fill(0,3);
+      REQUIRE( fifo.victim(0) == 0 );
+    }
+    SECTION( "Random stays in range and reaches every way" ) {
+      RandomReplacementPolicy rnd(1,4);
+      bool seen[4] = {false,false,false,false};
+      for( int ii = 0; ii < 200; ii++ ) {
+        uint64_t way = rnd.victim(0);
+        REQUIRE( way < 4 );
+        seen[way] = true;
+      }
+      REQUIRE( (seen[0] && seen[1] && seen[2] && seen[3]) );
+    }
+}
+
+TEST_CASE( "CacheStore with a selectable ReplacementPolicy", "[ReplacementPolicy]" ) {
+
+    // 4 blocks of 4 ways, 8B lines. These addresses all map to cacheBlockIndex 0.
+    uint64_t adr[5] = { 0x000, 0x100, 0x200, 0x300, 0x400 };
+    uint32_t dmydata[2] = {0,1} ;
+
+    SECTION( "default policy is LRU" ) {
+      CacheStore cs(pow(2,10),pow(2,7),LineSize8,4);
+      REQUIRE( cs.p_ReplacementPolicy == ReplLRU );
+    }
+    SECTION( "LRU keeps a line that keeps being hit" ) {
+      CacheStore cs(pow(2,10),pow(2,7),LineSize8,4,ReplLRU);
+      for( int ii = 0; ii < 4; ii++ ) cs.setDataLine(adr[ii], dmydata);
+      REQUIRE( cs.getCacheLine(adr[0]) != NULL );   // hit makes adr[0] the MRU
+      cs.setDataLine(adr[4], dmydata);               // evicts adr[1]
+      REQUIRE( cs.getCacheLine(adr[0]) != NULL );
+      REQUIRE( cs.getCacheLine(adr[1]) == NULL );
+      REQUIRE( cs.getCacheLine(adr[4]) != NULL );
+    }
+    SECTION( "FIFO evicts the oldest fill even if it keeps being hit" ) {
+      CacheStore cs(pow(2,10),pow(2,7),LineSize8,4,ReplFIFO);
+      for( int ii = 0; ii < 4; ii++ ) cs.setDataLine(adr[ii], dmydata);
+      REQUIRE( cs.getCacheLine(adr[0]) != NULL );
+      cs.setDataLine(adr[4], dmydata);
+      REQUIRE( cs.getCacheLine(adr[0]) == NULL );
+      REQUIRE( cs.getCacheLine(adr[1]) != NULL );
+    }
+    SECTION( "tree-PLRU and Random keep the block full and the new line cached" ) {
+      ReplacementPolicy_t policies[2] = { ReplTreePLRU, ReplRandom };
+      for( int pp = 0; pp < 2; pp++ ) {
+        CacheStore cs(pow(2,10),pow(2,7),LineSize8,4,policies[pp]);
+        for( int ii = 0; ii < 5; ii++ ) cs.setDataLine(adr[ii], dmydata);
+        int cached = 0;
+        for( int ii = 0; ii < 5; ii++ ) cached += ( cs.getCacheLine(adr[ii]) != NULL );
+        REQUIRE( cached == 4 );
+        REQUIRE( cs.getCacheLine(adr[4]) != NULL );
+      }
+    }
+}
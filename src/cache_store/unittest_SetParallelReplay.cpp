@@ -0,0 +1,68 @@
+// Simple file uses "catch2" as a unittest framework for testing SetParallelReplay.
+// A parallel replay must give, access for access, the results of replaying the same trace serially.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "SetParallelReplay.h"
+
+#include <vector>
+
+using namespace std;
+
+TEST_CASE( "SetParallelReplay", "[SetParallelReplay]" ) {
+
+    // 64 KiB of memory, 4B aligned; every fourth access a write
+    const size_t N = 50000;
+    std::vector<uint64_t> trace(N);
+    std::vector<char>     writes(N);
+    uint32_t seed = 4242;
+    for( size_t ii = 0; ii < N; ii++ ) {
+      seed = seed * 1103515245u + 12345u;
+      trace[ii] = (seed >> 8) & 0xFFFC;
+      writes[ii] = (ii % 4) == 0;
+    }
+    const bool* writeFlags = reinterpret_cast<const bool*>(&writes[0]);
+
+    SECTION( "every policy and thread count gives the serial hits, counters and lines" ) {
+      ReplacementPolicy_t policies[] = { ReplLRU, ReplTreePLRU, ReplFIFO, ReplRandom };
+      for( int pp = 0; pp < 4; pp++ ) {
+        CacheStore serial(pow(2,16),pow(2,12),LineSize16,4,policies[pp]);
+        std::vector<char> expected(N);
+        std::vector<CacheLineRef> refs(N);
+        serial.lookupMany( &trace[0], N, &refs[0], true, writeFlags );
+        for( size_t ii = 0; ii < N; ii++ ) expected[ii] = refs[ii].isHit();
+
+        for( unsigned int threads = 1; threads <= 8; threads *= 2 ) {
+          CacheStore store(pow(2,16),pow(2,12),LineSize16,4,policies[pp]);
+          SetParallelReplay parallel(store, threads);
+          REQUIRE( parallel.getNumThreads() == threads );
+          std::vector<char> hits(N);
+          // in two pieces, as a long trace would be
+          parallel.replay( &trace[0], N / 3, writeFlags, reinterpret_cast<bool*>(&hits[0]) );
+          parallel.replay( &trace[N / 3], N - N / 3, writeFlags + N / 3, reinterpret_cast<bool*>(&hits[N / 3]) );
+          REQUIRE( hits == expected );
+
+          CacheStoreStats a = serial.getStats(), b = store.getStats();
+          REQUIRE( a.lookups == b.lookups );
+          REQUIRE( a.hits == b.hits );
+          REQUIRE( a.evictions == b.evictions );
+          REQUIRE( a.dirtyEvictions == b.dirtyEvictions );
+          for( uint64_t ll = 0; ll < pow(2,12) / LineSize16; ll++ ) {
+            CacheLine* x = serial.getCacheBlock(0) + ll;
+            CacheLine* y = store.getCacheBlock(0) + ll;
+            REQUIRE( x->getTag() == y->getTag() );
+            REQUIRE( x->getDirty() == y->getDirty() );
+          }
+        }
+      }
+    }
+    SECTION( "partitions are runs of adjacent sets, and there are no more threads than sets" ) {
+      CacheStore store(pow(2,16),pow(2,8),LineSize16,4);      // 4 sets
+      SetParallelReplay parallel(store, 8);
+      REQUIRE( parallel.getNumThreads() == 4 );
+      REQUIRE( parallel.getPartition(0x00) == 0 );
+      REQUIRE( parallel.getPartition(0x10) == 1 );
+      REQUIRE( parallel.getPartition(0x30) == 3 );
+      REQUIRE( parallel.getPartition(0x40) == 0 );
+      REQUIRE_THROWS( SetParallelReplay(store, 3) );
+    }
+}
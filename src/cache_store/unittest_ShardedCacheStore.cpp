@@ -0,0 +1,113 @@
+// Simple file uses "catch2" as a unittest framework for testing ShardedCacheStore.
+// Catch's REQUIRE is not thread-safe, so the worker threads only record what they saw and the checks run
+// afterwards on the main thread.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "ShardedCacheStore.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// 16 KiB of memory, 4B aligned
+static std::vector<uint64_t> makeTrace( size_t n, uint32_t seed )
+{
+    std::vector<uint64_t> trace(n);
+    for( size_t ii = 0; ii < n; ii++ ) {
+      seed = seed * 1103515245u + 12345u;
+      trace[ii] = (seed >> 8) & 0x3FFC;
+    }
+    return trace;
+}
+
+TEST_CASE( "ShardedCacheStore on one thread", "[ShardedCacheStore]" ) {
+
+    std::vector<uint64_t> trace = makeTrace(5000, 12345);
+
+    SECTION( "matches CacheStore access for access" ) {
+      CacheStore        one(pow(2,14),pow(2,10),LineSize16,4);
+      ShardedCacheStore sharded(pow(2,14),pow(2,10),LineSize16,4,ReplLRU,8);
+      REQUIRE( sharded.getNumShards() == 8 );
+      for( size_t ii = 0; ii < trace.size(); ii++ ) {
+        REQUIRE( sharded.access(trace[ii], true) == one.allocateLine(trace[ii]).isHit() );
+      }
+    }
+    SECTION( "read and write copy in and out of cached lines only" ) {
+      ShardedCacheStore sharded(pow(2,14),pow(2,10),LineSize16,4);
+      uint32_t word = 7;
+      REQUIRE( sharded.write(0x104, &word, 4) == false );
+      REQUIRE( sharded.access(0x104, true) == false );
+      REQUIRE( sharded.write(0x104, &word, 4) == true );
+      word = 0;
+      REQUIRE( sharded.read(0x104, &word, 4) == true );
+      REQUIRE( word == 7 );
+      REQUIRE( sharded.withLine(0x100, false, [](CacheLineRef& ref) { REQUIRE( ref.line->getDirty() ); }) );
+      sharded.invalidate(0x104);
+      REQUIRE( sharded.read(0x104, &word, 4) == false );
+    }
+    SECTION( "the shard count is capped at the number of blocks and must be a power of 2" ) {
+      ShardedCacheStore small(pow(2,14),pow(2,7),LineSize16,4,ReplLRU,64);
+      REQUIRE( small.getNumShards() == 2 );
+      REQUIRE_THROWS( ShardedCacheStore(pow(2,14),pow(2,10),LineSize16,4,ReplLRU,6) );
+    }
+}
+
+TEST_CASE( "ShardedCacheStore on several threads", "[ShardedCacheStore]" ) {
+
+    const int NUM_THREADS = 8;
+    std::vector<uint64_t> trace = makeTrace(40000, 777);
+
+    SECTION( "a set-partitioned interleaving gives the single-threaded results" ) {
+      // Thread t replays, in trace order, the accesses whose cache block maps to t. Every block sees the same
+      // order of accesses as in the single-threaded replay, so every access must hit or miss the same way.
+      CacheStore        one(pow(2,14),pow(2,10),LineSize16,4);
+      ShardedCacheStore sharded(pow(2,14),pow(2,10),LineSize16,4,ReplLRU,16);
+      std::vector<char> expected(trace.size()), hits(trace.size());
+      for( size_t ii = 0; ii < trace.size(); ii++ ) expected[ii] = one.allocateLine(trace[ii]).isHit();
+
+      std::vector<std::thread> threads;
+      for( int tt = 0; tt < NUM_THREADS; tt++ ) {
+        threads.push_back( std::thread( [&, tt]() {
+          for( size_t ii = 0; ii < trace.size(); ii++ ) {
+            if( (int)(sharded.getStore().getCacheBlockIndex(trace[ii]) % NUM_THREADS) != tt ) continue;
+            hits[ii] = sharded.access(trace[ii], true);
+          }
+        } ) );
+      }
+      for( int tt = 0; tt < NUM_THREADS; tt++ ) threads[tt].join();
+      REQUIRE( hits == expected );
+    }
+    SECTION( "free-running threads leave every block consistent" ) {
+      // All threads hammer all sets. Each thread writes its own id into the lines it allocates and reads it
+      // back while it still hits; a torn update would show up as another thread's id or a duplicated tag.
+      ShardedCacheStore sharded(pow(2,14),pow(2,10),LineSize16,4,ReplLRU,16);
+      std::vector<int> errors(NUM_THREADS, 0);
+      std::vector<std::thread> threads;
+      for( int tt = 0; tt < NUM_THREADS; tt++ ) {
+        threads.push_back( std::thread( [&, tt]() {
+          std::vector<uint64_t> mine = makeTrace(20000, 1000 + tt);
+          for( size_t ii = 0; ii < mine.size(); ii++ ) {
+            uint64_t adr = (mine[ii] & ~0xFULL) | (tt & 3) << 2;   // each thread owns one word of every line
+            uint32_t word = tt;
+            sharded.withLine(adr, true, [&](CacheLineRef& ref) {
+              memcpy(ref.bytes() + (tt & 3) * 4, &word, 4);
+            });
+            uint32_t back = 0;
+            if( sharded.read(adr, &back, 4) && (back & 3) != (uint32_t)(tt & 3) ) errors[tt]++;
+          }
+        } ) );
+      }
+      for( int tt = 0; tt < NUM_THREADS; tt++ ) threads[tt].join();
+      for( int tt = 0; tt < NUM_THREADS; tt++ ) REQUIRE( errors[tt] == 0 );
+
+      CacheStore& cs = sharded.getStore();
+      for( uint64_t bb = 0; bb < 16; bb++ ) {
+        CacheLine* block = cs.getCacheBlock(bb);
+        for( int ww = 0; ww < 4; ww++ ) {
+          if( block[ww].getEmpty() ) continue;
+          for( int vv = ww + 1; vv < 4; vv++ ) REQUIRE( block[ww].getTag() != block[vv].getTag() );
+        }
+      }
+    }
+}
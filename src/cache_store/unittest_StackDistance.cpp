@@ -0,0 +1,59 @@
+// Simple file uses "catch2" as a unittest framework for testing the stack-distance analysis.
+// The miss counts it derives for each associativity are checked against replaying the trace through an LRU CacheStore.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include "StackDistance.h"
+#include "CacheStore.h"
+
+using namespace std;
+
+TEST_CASE( "StackDistance", "[StackDistance]" ) {
+
+    SECTION( "distances are the distinct lines accessed since the last access to the line" ) {
+      StackDistance sd(16);
+      REQUIRE( sd.access(0x00) == STACK_DISTANCE_COLD );
+      REQUIRE( sd.access(0x10) == STACK_DISTANCE_COLD );
+      REQUIRE( sd.access(0x20) == STACK_DISTANCE_COLD );
+      REQUIRE( sd.access(0x04) == 2 );      // same line as 0x00
+      REQUIRE( sd.access(0x04) == 0 );
+      REQUIRE( sd.access(0x10) == 2 );
+      REQUIRE( sd.access(0x00) == 1 );
+      REQUIRE( sd.getAccesses() == 7 );
+      REQUIRE( sd.getColdMisses() == 3 );
+      REQUIRE( sd.getMisses(1) == 6 );
+      REQUIRE( sd.getMisses(2) == 5 );
+      REQUIRE( sd.getMisses(3) == 3 );
+    }
+    SECTION( "each set has its own stack" ) {
+      StackDistance sd(16, 2);
+      sd.access(0x00);
+      sd.access(0x10);                      // the other set
+      sd.access(0x30);
+      REQUIRE( sd.access(0x00) == 0 );
+    }
+    SECTION( "one pass gives the misses of every LRU associativity" ) {
+      // a random trace over 64 KiB, long enough for the sets' clocks to be compacted many times
+      const size_t N = 20000;
+      vector<uint64_t> trace(N);
+      uint32_t seed = 12345;
+      for( size_t ii = 0; ii < N; ii++ ) {
+        seed = seed * 1103515245u + 12345u;
+        trace[ii] = (seed >> 8) & 0xFFFC;
+        if( ii % 3 == 0 ) trace[ii] &= 0x0FFC;    // and a hotter part
+      }
+      const uint64_t numSets = 16;
+      StackDistance sd(LineSize16, numSets);
+      sd.accessMany( &trace[0], N );
+      for( uint64_t ways = 1; ways <= 64; ways *= 2 ) {
+        CacheStore cs(pow(2,16), numSets*ways*LineSize16, LineSize16, ways, ReplLRU);
+        uint64_t misses = 0;
+        for( size_t ii = 0; ii < N; ii++ ) misses += !cs.allocateLine(trace[ii]).isHit();
+        REQUIRE( sd.getMisses(ways) == misses );
+      }
+      REQUIRE( sd.getMisses(4096) == sd.getColdMisses() );
+    }
+    SECTION( "line size and set count must be powers of 2" ) {
+      REQUIRE_THROWS( StackDistance(24) );
+      REQUIRE_THROWS( StackDistance(16, 3) );
+    }
+}
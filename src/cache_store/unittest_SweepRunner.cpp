@@ -0,0 +1,119 @@
+// Simple file uses "catch2" as a unittest framework for testing the design-space sweep runner.
+// The runs are real processes: /bin/sh scripts that print results the way the statistics' dump() does.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include <sstream>
+#include <chrono>
+#include "SweepRunner.h"
+
+using namespace std;
+
+static vector<string> values( const char* a, const char* b, const char* c=NULL )
+{
+  vector<string> v;
+  v.push_back(a);
+  v.push_back(b);
+  if( c ) v.push_back(c);
+  return v;
+}
+
+// sh -c script sh <point's options>: the options are $1, $2, ...
+static vector<string> shell( const char* script )
+{
+  vector<string> command;
+  command.push_back("/bin/sh");
+  command.push_back("-c");
+  command.push_back(script);
+  command.push_back("sh");
+  return command;
+}
+
+TEST_CASE( "SweepRunner", "[SweepRunner]" ) {
+
+    SECTION( "points cover the grid, last axis fastest" ) {
+      SweepRunner sweep;
+      sweep.addAxis( "-c", values("16k","32k") );
+      sweep.addAxis( "-w", values("1","2","4") );
+      REQUIRE( sweep.numPoints() == 6 );
+      REQUIRE( sweep.pointValues(0) == values("16k","1") );
+      REQUIRE( sweep.pointValues(2) == values("16k","4") );
+      REQUIRE( sweep.pointValues(3) == values("32k","1") );
+      REQUIRE( sweep.pointValues(5) == values("32k","4") );
+      REQUIRE_THROWS( sweep.addAxis("-l", vector<string>()) );
+    }
+    SECTION( "results are the key=value lines of a run's output" ) {
+      SweepRunner::Fields results;
+      SweepRunner::parseResults(
+        "SystemC 2.3.2 --- banner\n"
+        "cache 32768 bytes, 64-byte lines\n"
+        "L1: accesses=10 hitRate=0.5\n"
+        "L1.m_cacheStore: lookups=12 hits=5\n"
+        "Dumping: the set of address blocks\n"
+        "1000 accesses in 0.1 s, 0.01 M accesses/s\n", results );
+      REQUIRE( results.size() == 4 );
+      REQUIRE( results[0] == make_pair(string("L1.accesses"), string("10")) );
+      REQUIRE( results[1] == make_pair(string("L1.hitRate"), string("0.5")) );
+      REQUIRE( results[3] == make_pair(string("L1.m_cacheStore.hits"), string("5")) );
+    }
+    SECTION( "each point runs the command with its options appended" ) {
+      SweepRunner sweep;
+      sweep.addAxis( "-c", values("16k","32k") );
+      sweep.addAxis( "-w", values("1","2") );
+      REQUIRE( sweep.run( shell("echo \"sim: size=$2 ways=$4 args=$#\""), 2 ) == 0 );
+      const vector<SweepRunner::Point>& points = sweep.getPoints();
+      REQUIRE( points.size() == 4 );
+      for( size_t ii = 0; ii < points.size(); ii++) {
+        REQUIRE( points[ii].status == 0 );
+        REQUIRE( points[ii].results.size() == 3 );
+        REQUIRE( points[ii].results[0].second == points[ii].values[0] );
+        REQUIRE( points[ii].results[1].second == points[ii].values[1] );
+        REQUIRE( points[ii].results[2].second == "4" );
+      }
+
+      ostringstream csv;
+      sweep.writeCSV( csv );
+      REQUIRE( csv.str() ==
+        "point,status,c,w,sim.size,sim.ways,sim.args\n"
+        "0,0,16k,1,16k,1,4\n"
+        "1,0,16k,2,16k,2,4\n"
+        "2,0,32k,1,32k,1,4\n"
+        "3,0,32k,2,32k,2,4\n" );
+      ostringstream json;
+      sweep.writeJSON( json );
+      REQUIRE( json.str().find("{\"point\": 1, \"status\": 0, \"c\": \"16k\", \"w\": 2, \"sim.size\": \"16k\", \"sim.ways\": 2, \"sim.args\": 4},") != string::npos );
+    }
+    SECTION( "failed runs keep their exit status, and columns missing from a run stay empty" ) {
+      SweepRunner sweep;
+      sweep.addAxis( "-x", values("0","3") );
+      REQUIRE( sweep.run( shell("if [ $2 = 0 ]; then echo \"sim: ok=1\"; fi; exit $2") ) == 1 );
+      REQUIRE( sweep.getPoints()[0].status == 0 );
+      REQUIRE( sweep.getPoints()[1].status == 3 );
+      ostringstream csv;
+      sweep.writeCSV( csv );
+      REQUIRE( csv.str() == "point,status,x,sim.ok\n0,0,0,1\n1,3,3,\n" );
+
+      vector<string> missing;
+      missing.push_back("/nonexistent/simulator");
+      string output;
+      REQUIRE( SweepRunner::runProcess( missing, output ) == 127 );
+    }
+    SECTION( "CSV and JSON quote what needs it" ) {
+      SweepRunner sweep;
+      sweep.addAxis( "-n", values("a,b","say \"hi\"") );
+      sweep.run( shell("true"), 1 );
+      ostringstream csv, json;
+      sweep.writeCSV( csv );
+      sweep.writeJSON( json );
+      REQUIRE( csv.str() == "point,status,n\n0,0,\"a,b\"\n1,0,\"say \"\"hi\"\"\"\n" );
+      REQUIRE( json.str() == "[\n  {\"point\": 0, \"status\": 0, \"n\": \"a,b\"},\n  {\"point\": 1, \"status\": 0, \"n\": \"say \\\"hi\\\"\"}\n]\n" );
+    }
+    SECTION( "runs go in parallel" ) {
+      SweepRunner sweep;
+      sweep.addAxis( "-s", values("1","1","1") );
+      sweep.addAxis( "-t", values("1","1") );
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      REQUIRE( sweep.run( shell("sleep 0.$2"), 6 ) == 0 );
+      double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+      REQUIRE( seconds < 0.5 );     // 0.6 s one after the other
+    }
+  }
@@ -0,0 +1,86 @@
+// Simple file uses "catch2" as a unittest framework for testing the trace reader of cachesim.
+// Each trace is written to a temporary file first and read back in small batches.
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "catch2/catch.hpp"
+#include <stdio.h>
+#include <fstream>
+#include "TraceReader.h"
+
+using namespace std;
+
+static string writeTrace( const char* name, const string& contents )
+{
+  string path = string("/tmp/unittest_TraceReader_") + name;
+  ofstream os( path.c_str(), ios::binary | ios::trunc );
+  os << contents;
+  return path;
+}
+
+// Everything in the trace, read max accesses at a time.
+static size_t readAll( TraceReader& reader, vector<uint64_t>& adrs, vector<bool>& writes, size_t max )
+{
+  uint64_t a[8];
+  bool     w[8];
+  for( size_t n; (n = reader.next(a, w, max)) > 0; ) {
+    for( size_t ii = 0; ii < n; ii++) {
+      adrs.push_back( a[ii] );
+      writes.push_back( w[ii] );
+    }
+  }
+  return adrs.size();
+}
+
+TEST_CASE( "TraceReader", "[TraceReader]" ) {
+
+    vector<uint64_t> adrs;
+    vector<bool>     writes;
+
+    SECTION( "the format follows the file name" ) {
+      REQUIRE( traceFormatFromPath("trace.bin") == TraceBinary );
+      REQUIRE( traceFormatFromPath("trace.txt") == TraceText );
+      REQUIRE( traceFormatFromPath(".bin") == TraceText );
+    }
+    SECTION( "text: types, comments, blank lines, 0x and a last line without newline" ) {
+      string path = writeTrace( "text.txt", "# a comment\nR 0x1000\nW 2040\n\n  r ff\n1 0xABC\n2 10\n0 20\n40\nw 8" );
+      TraceReader reader( path, TraceText );
+      REQUIRE( readAll(reader, adrs, writes, 3) == 8 );
+      uint64_t expectedAdrs[]   = { 0x1000, 0x2040, 0xff, 0xabc, 0x10, 0x20, 0x40, 0x8 };
+      bool     expectedWrites[] = { false,  true,   false, true, false, false, false, true };
+      for( size_t ii = 0; ii < 8; ii++) {
+        REQUIRE( adrs[ii] == expectedAdrs[ii] );
+        REQUIRE( writes[ii] == expectedWrites[ii] );
+      }
+      REQUIRE( readAll(reader, adrs, writes, 3) == 8 );    // and stays done
+      remove( path.c_str() );
+    }
+    SECTION( "text: malformed lines throw" ) {
+      string path = writeTrace( "bad.txt", "R 100\nX 200\n" );
+      TraceReader reader( path, TraceText );
+      REQUIRE_THROWS( readAll(reader, adrs, writes, 8) );
+      string path2 = writeTrace( "bad2.txt", "R 10g\n" );
+      TraceReader reader2( path2, TraceText );
+      REQUIRE_THROWS( readAll(reader2, adrs, writes, 8) );
+      remove( path.c_str() );
+      remove( path2.c_str() );
+    }
+    SECTION( "binary: the write bit is split off" ) {
+      uint64_t records[] = { 0x40, 0x80 | TRACE_WRITE_BIT, 0xFFFFFFFFFFC0ULL, 0 };
+      string path = writeTrace( "records.bin", string(reinterpret_cast<char*>(records), sizeof(records)) );
+      TraceReader reader( path, traceFormatFromPath(path) );
+      REQUIRE( readAll(reader, adrs, writes, 3) == 4 );
+      REQUIRE( adrs[0] == 0x40 );
+      REQUIRE( !writes[0] );
+      REQUIRE( adrs[1] == 0x80 );
+      REQUIRE( writes[1] );
+      REQUIRE( adrs[2] == 0xFFFFFFFFFFC0ULL );
+      REQUIRE( adrs[3] == 0 );
+      remove( path.c_str() );
+    }
+    SECTION( "empty and missing files" ) {
+      string path = writeTrace( "empty.txt", "" );
+      TraceReader reader( path, TraceText );
+      REQUIRE( readAll(reader, adrs, writes, 8) == 0 );
+      remove( path.c_str() );
+      REQUIRE_THROWS( TraceReader("/tmp/unittest_TraceReader_missing", TraceText) );
+    }
+}
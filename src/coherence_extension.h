@@ -0,0 +1,46 @@
+#ifndef CoherenceExtension_H
+#define CoherenceExtension_H
+
+// The TLM extension that carries MESI coherence traffic between coherent RealCacheT's (see setCoherent) and the
+// SnoopBus they share. A coherent cache tags the line reads it sends with what it needs the line for, and the bus tags
+// the snoops it sends the other caches with what they must do with their copies. A target that knows nothing about
+// coherence (a memory) ignores it and just serves the read.
+// Requests, from a cache to the bus:
+//  - CoherenceRead          - a read miss: the other caches keep their copies, but as Shared
+//  - CoherenceReadExclusive - a write miss: the other caches drop their copies
+//  - CoherenceUpgrade       - a write to a Shared line, or one that overwrites a whole line: the other caches drop
+//                             their copies, and no data moves (TLM_IGNORE_COMMAND)
+// Snoops, from the bus to the other caches (TLM_READ_COMMAND of the whole line):
+//  - SnoopShared            - demote the line to Shared
+//  - SnoopInvalidate        - drop the line
+// A snooped cache that has the line sets shared; one with dirty data for it copies that data into the snoop's data
+// and sets dirty. After a CoherenceRead, shared tells the requester whether to fill the line Shared or Exclusive.
+
+#include "tlm.h"
+
+enum CoherenceOp_t { CoherenceRead, CoherenceReadExclusive, CoherenceUpgrade, SnoopShared, SnoopInvalidate };
+
+struct CoherenceExtension: tlm::tlm_extension<CoherenceExtension>
+{
+  CoherenceOp_t op;
+  bool          shared;     // another cache has a copy of the line
+  bool          dirty;      // the data of a snoop is a cache's dirty data, which memory does not have
+
+  CoherenceExtension( CoherenceOp_t _op=CoherenceRead )
+  : op( _op ), shared( false ), dirty( false )
+  {}
+
+  virtual tlm::tlm_extension_base* clone() const
+  {
+    return new CoherenceExtension( *this );
+  }
+  virtual void copy_from( const tlm::tlm_extension_base& other )
+  {
+    const CoherenceExtension& ext = static_cast<const CoherenceExtension&>( other );
+    op = ext.op;
+    shared = ext.shared;
+    dirty = ext.dirty;
+  }
+};
+
+#endif
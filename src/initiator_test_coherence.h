@@ -0,0 +1,122 @@
+#ifndef InitiatorTestCoherence_h
+#define InitiatorTestCoherence_h
+
+// Test Initiator class
+// This is just for SystemC "unit" testing (though since its systemc, it's really a kind of integration test).
+// This works in conjunction with TopCoherentCaches: one socket per core, each bound to that core's coherent RealCache.
+// Tests:
+// - a line read by two cores, then written by one of them: the other core reads the new data
+// - the cores taking turns incrementing one word, which moves the line back and forth between the caches
+// The coherence statistics and what memory ends up with are checked by TopCoherentCaches.
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "tlm.h"
+#include "tlm_utils/simple_initiator_socket.h"
+
+struct InitiatorTestCoherence: sc_module
+{
+  // TLM-2 sockets, one per core
+  std::vector< tlm_utils::simple_initiator_socket<InitiatorTestCoherence>* > sockets;
+
+  InitiatorTestCoherence(sc_module_name name, unsigned int numCores)
+  : sc_module(name)
+  {
+    for( unsigned int ii = 0; ii < numCores; ii++) {
+      std::ostringstream socketName;
+      socketName << "socket_" << ii;
+      sockets.push_back( new tlm_utils::simple_initiator_socket<InitiatorTestCoherence>(socketName.str().c_str()) );
+    }
+  }
+
+  // One word access by a core. Returns the word read, or written.
+  uint32_t access(const char* unittestName, unsigned int core, tlm::tlm_command cmd, sc_dt::uint64 adr, uint32_t data=0)
+  {
+    tlm::tlm_generic_payload trans;
+    sc_time delay = SC_ZERO_TIME;
+    m_data = data;
+    trans.set_command( cmd );
+    trans.set_address( adr );
+    trans.set_data_ptr( reinterpret_cast<unsigned char*>(&m_data) );
+    trans.set_data_length( 4 );
+    trans.set_streaming_width( 4 ); // = data_length to indicate no streaming
+    trans.set_byte_enable_ptr( 0 ); // 0 indicates unused
+    trans.set_dmi_allowed( false ); // Mandatory initial value
+    trans.set_response_status( tlm::TLM_INCOMPLETE_RESPONSE ); // Mandatory initial value
+    (*sockets[core])->b_transport( trans, delay );  // Blocking transport call
+    if ( trans.is_response_error() ) {
+      std::ostringstream oss;
+      oss << "Response error from b_transport of core " << core << ", " + sc_time_stamp().to_string() ;
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+    wait(delay);
+    return m_data;
+  }
+
+  void check_read(const char* unittestName, unsigned int core, sc_dt::uint64 adr, uint32_t expdata)
+  {
+    uint32_t data = access(unittestName, core, tlm::TLM_READ_COMMAND, adr);
+    cout << " core " << core << " read address=" << hex << adr << " data=" << data << dec << endl;
+    if ( data != expdata ) {
+      std::ostringstream oss;
+      oss << "Wrong data returned to core " << core << ", " << data << " instead of " << expdata << ", " << sc_time_stamp().to_string() ;
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+  }
+
+  void write(const char* unittestName, unsigned int core, sc_dt::uint64 adr, uint32_t data)
+  {
+    access(unittestName, core, tlm::TLM_WRITE_COMMAND, adr, data);
+    cout << " core " << core << " write address=" << hex << adr << " data=" << data << dec << endl;
+  }
+
+  void test_1()
+  {
+    //-----------------
+    const char* unittestName = "test_1.1 both cores read 0x4, then core 1 writes it";
+    cout << endl << unittestName << endl;
+    check_read(unittestName, 0, 0x4, 1);
+    check_read(unittestName, 1, 0x4, 1);
+    write(unittestName, 1, 0x4, 7);
+    check_read(unittestName, 1, 0x4, 7);
+
+    //-----------------
+    unittestName = "test_1.2 core 0 reads the word core 1 wrote";
+    cout << endl << unittestName << endl;
+    check_read(unittestName, 0, 0x4, 7);
+    check_read(unittestName, 0, 0x0, 0);
+
+    //-----------------
+    unittestName = "test_1.3 core 0 writes the shared line, core 1 reads it";
+    cout << endl << unittestName << endl;
+    write(unittestName, 0, 0x0, 9);
+    check_read(unittestName, 1, 0x0, 9);
+    check_read(unittestName, 1, 0x4, 7);
+
+    //-----------------
+    unittestName = "test_1.4 cores take turns incrementing 0x10";
+    cout << endl << unittestName << endl;
+    for( unsigned int ii = 0; ii < INCREMENTS; ii++) {
+      unsigned int core = ii % sockets.size();
+      uint32_t count = access(unittestName, core, tlm::TLM_READ_COMMAND, 0x10);
+      access(unittestName, core, tlm::TLM_WRITE_COMMAND, 0x10, count + 1);
+    }
+    check_read(unittestName, 0, 0x10, INCREMENTS);
+    check_read(unittestName, 1, 0x10, INCREMENTS);
+  }
+
+  // Internal data buffer used by initiator with generic payload
+  uint32_t m_data;
+
+  enum { INCREMENTS = 10 };
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef InitiatorTestMappedMemory_h
+#define InitiatorTestMappedMemory_h
+
+// Test Initiator class
+// This is just for SystemC "unit" testing (though since its systemc, it's really a kind of integration test).
+// This works in conjunction with MappedMemory of at least 4 GiB (see TopMappedMemory).
+// Tests:
+// - reads of never touched memory return 0, at any address
+// - a word written beyond 3 GiB reads back
+// - a burst crossing a page boundary, at an address that is not word aligned
+// - an access past the end of memory is an address error
+// - one DMI region covers the whole memory, and sees what was written through b_transport
+
+#include <string.h>     // memcpy
+#include <string>
+#include <sstream>
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "tlm.h"
+#include "tlm_utils/simple_initiator_socket.h"
+
+struct InitiatorTestMappedMemory: sc_module
+{
+  // TLM-2 socket, defaults to 32-bits wide, base protocol
+  tlm_utils::simple_initiator_socket<InitiatorTestMappedMemory> socket;
+
+  SC_CTOR(InitiatorTestMappedMemory)
+  : socket("socket")  // Construct and name socket
+  {
+  }
+
+  // One access of len bytes at adr from/to m_bytes. Returns the response status.
+  tlm::tlm_response_status access(tlm::tlm_command cmd, sc_dt::uint64 adr, unsigned int len)
+  {
+    tlm::tlm_generic_payload trans;
+    sc_time delay = SC_ZERO_TIME;
+    trans.set_command( cmd );
+    trans.set_address( adr );
+    trans.set_data_ptr( m_bytes );
+    trans.set_data_length( len );
+    trans.set_streaming_width( len ); // = data_length to indicate no streaming
+    trans.set_byte_enable_ptr( 0 ); // 0 indicates unused
+    trans.set_dmi_allowed( false ); // Mandatory initial value
+    trans.set_response_status( tlm::TLM_INCOMPLETE_RESPONSE ); // Mandatory initial value
+    socket->b_transport( trans, delay );  // Blocking transport call
+    wait(delay);
+    return trans.get_response_status();
+  }
+
+  void check_read(const char* unittestName, sc_dt::uint64 adr, uint32_t expdata)
+  {
+    if ( access(tlm::TLM_READ_COMMAND, adr, 4) != tlm::TLM_OK_RESPONSE ) {
+      SC_REPORT_ERROR(unittestName, "Response error from b_transport." );
+    }
+    uint32_t data;
+    memcpy(&data, m_bytes, 4);
+    cout << " read address=" << hex << adr << " data=" << data << dec << endl;
+    if ( data != expdata ) {
+      std::ostringstream oss;
+      oss << "Wrong data returned, " << hex << data << " instead of " << expdata << dec;
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+  }
+
+  void write(const char* unittestName, sc_dt::uint64 adr, uint32_t data)
+  {
+    memcpy(m_bytes, &data, 4);
+    if ( access(tlm::TLM_WRITE_COMMAND, adr, 4) != tlm::TLM_OK_RESPONSE ) {
+      SC_REPORT_ERROR(unittestName, "Response error from b_transport." );
+    }
+    cout << " write address=" << hex << adr << " data=" << data << dec << endl;
+  }
+
+  void test_1(sc_dt::uint64 memorySize)
+  {
+    const sc_dt::uint64 HIGH = 3ULL << 30;
+
+    //-----------------
+    const char* unittestName = "test_1.1 untouched memory reads 0";
+    cout << endl << unittestName << endl;
+    check_read(unittestName, 0x0, 0);
+    check_read(unittestName, HIGH + 4, 0);
+
+    //-----------------
+    unittestName = "test_1.2 write and read back beyond 3 GiB";
+    cout << endl << unittestName << endl;
+    write(unittestName, HIGH + 4, 0x12345678);
+    check_read(unittestName, HIGH + 4, 0x12345678);
+    check_read(unittestName, HIGH, 0);
+
+    //-----------------
+    unittestName = "test_1.3 unaligned burst across a page boundary";
+    cout << endl << unittestName << endl;
+    for( unsigned int ii = 0; ii < 32; ii++) m_bytes[ii] = ii + 1;
+    if ( access(tlm::TLM_WRITE_COMMAND, 0x1ff1, 32) != tlm::TLM_OK_RESPONSE ) {
+      SC_REPORT_ERROR(unittestName, "Response error from b_transport." );
+    }
+    check_read(unittestName, 0x2000, 0x13121110);
+
+    //-----------------
+    unittestName = "test_1.4 past the end of memory";
+    cout << endl << unittestName << endl;
+    if ( access(tlm::TLM_READ_COMMAND, memorySize - 2, 4) != tlm::TLM_ADDRESS_ERROR_RESPONSE ) {
+      SC_REPORT_ERROR(unittestName, "Expected an address error." );
+    }
+
+    //-----------------
+    unittestName = "test_1.5 DMI covers the whole memory";
+    cout << endl << unittestName << endl;
+    tlm::tlm_generic_payload trans;
+    tlm::tlm_dmi dmi_data;
+    trans.set_address( HIGH );
+    if ( !socket->get_direct_mem_ptr( trans, dmi_data ) ) {
+      SC_REPORT_ERROR(unittestName, "Expected DMI to be granted." );
+    }
+    if ( dmi_data.get_start_address() != 0 || dmi_data.get_end_address() != memorySize - 1 || !dmi_data.is_read_write_allowed() ) {
+      SC_REPORT_ERROR(unittestName, "Expected one read/write DMI region for all of memory." );
+    }
+    uint32_t data;
+    memcpy(&data, dmi_data.get_dmi_ptr() + HIGH + 4, 4);
+    if ( data != 0x12345678 ) {
+      SC_REPORT_ERROR(unittestName, "Expected DMI to see the word written through b_transport." );
+    }
+  }
+
+  // Internal data buffer used by initiator with generic payload
+  unsigned char m_bytes[64];
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef InitiatorTrace_h
+#define InitiatorTrace_h
+
+// Workload initiator: drives one word access per entry of a memory access trace (see cache_store/TraceReader.h),
+// or a number of random accesses, through its socket. Used by TopTraceReplay to simulate one cache configuration.
+// Addresses are folded into the memory behind the cache (memorySize bytes) and aligned to a word.
+// Random accesses are spread over a footprint of lines and a quarter of them are writes, as in cachesim -n, with the
+// same seed, so every point of a sweep sees the same workload.
+// The initiator runs ahead of simulated time, and only waits for the delay it has accumulated once per batch of
+// accesses (a quantum, as in loosely-timed temporal decoupling).
+// At end_of_simulation it prints "<name>: accesses=.. reads=.. writes=.. errors=.. simulatedTimeNS=..".
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>    // max
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "tlm.h"
+#include "tlm_utils/simple_initiator_socket.h"
+
+#include "cache_store/TraceReader.h"
+
+struct InitiatorTrace: sc_module
+{
+  tlm_utils::simple_initiator_socket<InitiatorTrace> socket;
+
+  enum { BATCH = 4096 };   // accesses between two waits
+
+  SC_HAS_PROCESS(InitiatorTrace);
+
+  // Replays the trace at tracePath.
+  InitiatorTrace(sc_module_name name, uint64_t memorySize, const std::string& tracePath, TraceFormat_t format)
+  : sc_module(name)
+  , socket("socket")
+  , m_memorySize(memorySize)
+  , m_trace(new TraceReader(tracePath, format))
+  , m_numRandom(0)
+  , m_footprint(0)
+  , m_lineSize(0)
+  {
+    init();
+  }
+  // numRandom random accesses over footprint bytes of lineSize lines.
+  InitiatorTrace(sc_module_name name, uint64_t memorySize, uint64_t numRandom, uint64_t footprint, uint64_t lineSize)
+  : sc_module(name)
+  , socket("socket")
+  , m_memorySize(memorySize)
+  , m_trace(NULL)
+  , m_numRandom(numRandom)
+  , m_footprint(footprint)
+  , m_lineSize(lineSize)
+  {
+    init();
+  }
+  ~InitiatorTrace()
+  {
+    delete m_trace;
+  }
+
+  void thread_process()
+  {
+    std::vector<uint64_t> adrs( BATCH );
+    std::vector<char>     writes( BATCH );      // not vector<bool>: TraceReader::next wants a bool array
+    bool* writeFlags = reinterpret_cast<bool*>( &writes[0] );
+    std::mt19937_64 rng( 1 );
+    uint64_t footprintLines = std::max( m_footprint / std::max( m_lineSize, (uint64_t)1 ), (uint64_t)1 );
+    uint64_t generated = 0;
+
+    for( ;; ) {
+      size_t n = 0;
+      if ( m_trace != NULL ) {
+        n = m_trace->next( &adrs[0], writeFlags, BATCH );
+      } else {
+        for( ; n < BATCH && generated < m_numRandom; n++, generated++) {
+          uint64_t r = rng();
+          adrs[n] = (r % footprintLines) * m_lineSize;
+          writeFlags[n] = (r >> 62) == 0;
+        }
+      }
+      if ( n == 0 ) break;
+
+      sc_time delay = SC_ZERO_TIME;
+      for( size_t ii = 0; ii < n; ii++) {
+        access( adrs[ii] % m_memorySize & ~(sc_dt::uint64)3, writeFlags[ii], delay );
+      }
+      wait( delay );
+    }
+  }
+
+  virtual void end_of_simulation()
+  {
+    cout << name() << ": accesses=" << m_reads + m_writes << " reads=" << m_reads << " writes=" << m_writes
+         << " errors=" << m_errors << " simulatedTimeNS=" << sc_time_stamp().to_seconds() * 1e9 << endl;
+  }
+
+private:
+  void init()
+  {
+    m_reads = m_writes = m_errors = 0;
+    m_data = 0;
+    m_trans.set_byte_enable_ptr( 0 ); // 0 indicates unused
+    m_trans.set_data_ptr( reinterpret_cast<unsigned char*>(&m_data) );
+    m_trans.set_data_length( 4 );
+    m_trans.set_streaming_width( 4 ); // = data_length to indicate no streaming
+    SC_THREAD(thread_process);
+  }
+
+  void access(sc_dt::uint64 adr, bool write, sc_time& delay)
+  {
+    m_trans.set_command( write ? tlm::TLM_WRITE_COMMAND : tlm::TLM_READ_COMMAND );
+    m_trans.set_address( adr );
+    m_trans.set_dmi_allowed( false ); // Mandatory initial value
+    m_trans.set_response_status( tlm::TLM_INCOMPLETE_RESPONSE ); // Mandatory initial value
+    if ( write ) m_data = (uint32_t)adr;
+    socket->b_transport( m_trans, delay );
+    if ( m_trans.is_response_error() ) m_errors++;
+    if ( write ) m_writes++;
+    else         m_reads++;
+  }
+
+  uint64_t     m_memorySize;
+  TraceReader* m_trace;
+  uint64_t     m_numRandom;
+  uint64_t     m_footprint;
+  uint64_t     m_lineSize;
+  uint64_t     m_reads, m_writes, m_errors;
+  uint32_t     m_data;
+  tlm::tlm_generic_payload m_trans;
+};
+
+#endif
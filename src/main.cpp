@@ -1,7 +1,10 @@
 // Simple main.cpp, nothing of interest. Look inside "Top".
+// With arguments, it simulates one cache configuration instead (see top_trace_replay.h).
 #include "top.h"
+#include "top_trace_replay.h"
 int sc_main(int argc, char* argv[])
 {
+  if ( argc > 1 ) return runTraceReplay(argc, argv);
   Top top("top");
   sc_start();
   sc_stop();
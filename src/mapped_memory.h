@@ -0,0 +1,199 @@
+#ifndef MappedMemory_H
+#define MappedMemory_H
+
+// Mapped Memory class: the alternative to SparseMemory for large memories.
+// The whole simulated address range, p_Size bytes (multi-GiB is fine), is reserved at construction with one
+// anonymous mmap(MAP_NORESERVE). The host kernel then allocates its pages on first touch, so only the pages that
+// were accessed take up host memory, and finding the host address of a simulated one is a single add.
+//  - memory starts out zeroed (no 0,1,0,1 pattern, unlike SparseMemory: nothing is touched until accessed)
+//  - a transaction may access any number of bytes at any address, as long as they are all inside p_Size
+//  - DMI hands out one pointer covering the whole memory
+//  - adviseHugePages(adr,len) asks the kernel to back a region that will be dense with huge pages
+//  - loadImage(image) puts a program or data image in memory (see cache_store/MemoryImage.h). Whole host pages of a
+//    raw or ELF image that are page aligned both in memory and in the file are mapped from the file in place of the
+//    anonymous ones (privately: writes do not go to the file), so a GiB image loads in about the time of an mmap.
+//    The rest is copied, and zeroed memory (.bss) gets fresh anonymous pages.
+//  - delay += 100 always, as SparseMemory
+// At end_of_simulation it prints "<name>: size=.. residentBytes=..", residentBytes being the host memory in use.
+
+// Needed for the simple_target_socket
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <string.h>     // memcpy
+#include <unistd.h>     // sysconf
+#include <sys/mman.h>   // mmap, madvise, mincore
+#include <algorithm>    // min, max
+#include <vector>
+#include <stdexcept>
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "tlm.h"
+#include "tlm_utils/simple_target_socket.h"
+
+#include "cache_store/MemoryImage.h"
+
+struct MappedMemory: sc_module
+{
+  // TLM-2 socket, defaults to 32-bits wide, base protocol
+  tlm_utils::simple_target_socket<MappedMemory> socket;
+
+  const sc_dt::uint64 p_Size;  // bytes
+
+  MappedMemory(sc_module_name name, sc_dt::uint64 size=(1ULL<<32))
+  : sc_module(name)
+  , socket("socket")
+  , p_Size(size)
+  {
+    void* mem = mmap(NULL, p_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( mem == MAP_FAILED ) throw std::runtime_error("MappedMemory: cannot reserve the address range.");
+    m_mem = static_cast<unsigned char*>(mem);
+
+    // Register callback for incoming b_transport interface method call
+    socket.register_b_transport(this, &MappedMemory::b_transport);
+    socket.register_get_direct_mem_ptr(this, &MappedMemory::get_direct_mem_ptr);
+    socket.register_transport_dbg(this, &MappedMemory::transport_dbg);
+  }
+  ~MappedMemory()
+  {
+    munmap(m_mem, p_Size);
+  }
+
+  virtual void end_of_simulation()
+  {
+    cout << dec << name() << ": size=" << p_Size << " residentBytes=" << residentBytes() << endl;
+  }
+
+  // The host address of simulated byte address adr.
+  unsigned char* hostAddress( sc_dt::uint64 adr )
+  {
+    return m_mem + adr;
+  }
+
+  // Back [adr, adr+len) with huge pages where the kernel can (a hint; a no-op where they are not supported).
+  void adviseHugePages( sc_dt::uint64 adr, sc_dt::uint64 len )
+  {
+#ifdef MADV_HUGEPAGE
+    const sc_dt::uint64 HUGEPAGE = 2 << 20;
+    sc_dt::uint64 first = (adr + HUGEPAGE - 1) / HUGEPAGE * HUGEPAGE;
+    sc_dt::uint64 last  = std::min(adr + len, p_Size) / HUGEPAGE * HUGEPAGE;
+    if ( first < last ) madvise(m_mem + first, last - first, MADV_HUGEPAGE);
+#endif
+  }
+
+  // Put the segments of image in memory. Throws std::runtime_error if one does not fit.
+  void loadImage( const MemoryImage& image )
+  {
+    const sc_dt::uint64 HOSTPAGE = sysconf(_SC_PAGESIZE);
+    const std::vector<MemoryImage::Segment>& segments = image.getSegments();
+    for( size_t ii = 0; ii < segments.size(); ii++) {
+      const MemoryImage::Segment& segment = segments[ii];
+      if ( segment.address > p_Size || segment.memSize > p_Size - segment.address ) {
+        throw std::runtime_error("MappedMemory: image segment does not fit in memory");
+      }
+      sc_dt::uint64 mapped = 0;
+      if ( segment.fileOffset >= 0 && segment.address % HOSTPAGE == 0 && segment.fileOffset % HOSTPAGE == 0 ) {
+        mapped = segment.fileSize / HOSTPAGE * HOSTPAGE;
+        if ( mapped > 0 && mmap(m_mem + segment.address, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                                image.getFd(), segment.fileOffset) == MAP_FAILED ) mapped = 0;
+      }
+      memcpy(m_mem + segment.address + mapped, segment.data + mapped, segment.fileSize - mapped);
+      zero(segment.address + segment.fileSize, segment.memSize - segment.fileSize);
+    }
+  }
+
+  // Zero [adr, adr+len): whole host pages are replaced by fresh anonymous ones, which take no memory until touched.
+  void zero( sc_dt::uint64 adr, sc_dt::uint64 len )
+  {
+    const sc_dt::uint64 HOSTPAGE = sysconf(_SC_PAGESIZE);
+    sc_dt::uint64 first = std::min((adr + HOSTPAGE - 1) / HOSTPAGE * HOSTPAGE, adr + len);
+    sc_dt::uint64 last  = std::max((adr + len) / HOSTPAGE * HOSTPAGE, first);
+    if ( first == last || mmap(m_mem + first, last - first, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED ) {
+      memset(m_mem + first, 0, last - first);
+    }
+    memset(m_mem + adr, 0, first - adr);
+    memset(m_mem + last, 0, adr + len - last);
+  }
+
+  // Host memory the simulated memory takes up: the pages that were touched.
+  uint64_t residentBytes()
+  {
+    const sc_dt::uint64 HOSTPAGE = sysconf(_SC_PAGESIZE);
+    const sc_dt::uint64 CHUNK = 1ULL << 30;   // mincore one GiB at a time, to keep its vector small
+    std::vector<unsigned char> resident(CHUNK / HOSTPAGE);
+    uint64_t pages = 0;
+    for( sc_dt::uint64 first = 0; first < p_Size; first += CHUNK) {
+      sc_dt::uint64 len = std::min(CHUNK, p_Size - first);
+      if ( mincore(m_mem + first, len, &resident[0]) != 0 ) continue;
+      for( sc_dt::uint64 ii = 0; ii < (len + HOSTPAGE - 1) / HOSTPAGE; ii++) pages += resident[ii] & 1;
+    }
+    return pages * HOSTPAGE;
+  }
+
+  // TLM-2 blocking transport method
+  virtual void b_transport( tlm::tlm_generic_payload& trans, sc_time& delay )
+  {
+    tlm::tlm_command  cmd = trans.get_command();
+    sc_dt::uint64     adr = trans.get_address();
+    unsigned char*    ptr = trans.get_data_ptr();
+    unsigned int      len = trans.get_data_length();
+    unsigned char*    byt = trans.get_byte_enable_ptr();
+    unsigned int      wid = trans.get_streaming_width();
+
+    if ( adr >= p_Size || len > p_Size - adr ) {
+      trans.set_response_status( tlm::TLM_ADDRESS_ERROR_RESPONSE );
+      return;
+    }
+    if ( byt != 0 ) {
+      trans.set_response_status( tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE );
+      return;
+    }
+    if ( wid < len ) {
+      trans.set_response_status( tlm::TLM_BURST_ERROR_RESPONSE );
+      return;
+    }
+
+    delay += sc_time(100, SC_NS);
+
+    if ( cmd == tlm::TLM_READ_COMMAND )       memcpy(ptr, m_mem + adr, len);
+    else if ( cmd == tlm::TLM_WRITE_COMMAND ) memcpy(m_mem + adr, ptr, len);
+
+    // Set DMI hint to indicated that DMI is supported
+    trans.set_dmi_allowed(true);
+    trans.set_response_status( tlm::TLM_OK_RESPONSE );
+  }
+
+  // TLM-2 forward DMI method: the whole memory at once
+  virtual bool get_direct_mem_ptr(tlm::tlm_generic_payload& trans, tlm::tlm_dmi& dmi_data)
+  {
+    dmi_data.allow_read_write();
+    dmi_data.set_dmi_ptr( m_mem );
+    dmi_data.set_start_address( 0 );
+    dmi_data.set_end_address( p_Size - 1 );
+    dmi_data.set_read_latency( LATENCY_ONE_CLOCK );
+    dmi_data.set_write_latency( LATENCY_ONE_CLOCK );
+    return true;
+  }
+
+  // TLM-2 debug transport method
+  virtual unsigned int transport_dbg(tlm::tlm_generic_payload& trans)
+  {
+    sc_dt::uint64 adr = trans.get_address();
+    if ( adr >= p_Size ) return 0;
+    unsigned int len = std::min((sc_dt::uint64)trans.get_data_length(), p_Size - adr);
+    if ( trans.get_command() == tlm::TLM_READ_COMMAND )       memcpy(trans.get_data_ptr(), m_mem + adr, len);
+    else if ( trans.get_command() == tlm::TLM_WRITE_COMMAND ) memcpy(m_mem + adr, trans.get_data_ptr(), len);
+    trans.set_response_status( tlm::TLM_OK_RESPONSE );
+    return len;
+  }
+
+public:
+  const sc_time LATENCY_ONE_CLOCK = sc_time(10, SC_NS);
+protected:
+  unsigned char* m_mem;
+
+} ;
+#endif
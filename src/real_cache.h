@@ -1,8 +1,48 @@
 // A real model of a Cache.
 // Implementation uses a separate C class CacheStore from subdirectory.
+// RealCacheT is templated on that store, so a CacheStoreT with compile-time geometry can be plugged in
+// and its address translation inlines into b_transport. RealCache is the runtime-configured version.
 //
-// Initial implementation only support singel byte read/write by Initiator.
-// But reads and caches entire cache lines at once.
+// Reads and caches entire cache lines at once. Transactions may be of any length: a word from an initiator,
+// or whole lines from another RealCache above this one (see TopCacheHierarchy for an N-level stack).
+//
+// Write-back, write-allocate: writes only update the cache and mark the line dirty. Dirty lines that get
+// evicted go to a WriteBackQueue, which is drained to memory p_WriteBackBatchSize lines at a time.
+// flush() writes back everything still dirty; it runs at end_of_simulation.
+//
+// Statistics: getStats() returns the read/write hits and misses, write-backs and back-invalidations of this level,
+// m_cacheStore.getStats() the store's lookups, fills and evictions. The store counts one lookup per access of a line
+// (its hits are the accesses that found the line cached, sector misses included); fills, prefetches, victims from
+// above and snoops go through fillLine/peekLine and are not counted as lookups. Both are dumped at end_of_simulation,
+// together with the per-set access/conflict counters if m_cacheStore.enableSetStats(true) was called.
+//
+// Prefetching: setPrefetcher attaches a next-line, stride or stream prefetcher (see cache_store/Prefetcher.h). It is
+// trained on demand misses and on the first demand hit of each prefetched line, and its candidates are filled into
+// m_cacheStore right after the demand access, marked as prefetched. A prefetched line is ready once its fill's
+// memory delay has passed; a demand hit before that is a late prefetch and waits for the rest of it.
+// getPrefetchStats() counts issued, useful, late and dropped prefetches, and pollution: demand misses on lines a
+// prefetch fill evicted (remembered in a small direct-mapped filter, so it is a close lower bound).
+//
+// Sectored lines: setSectorSize splits the lines of m_cacheStore into sectors with their own valid and dirty bits.
+// A write miss that covers whole sectors then allocates the line and writes just those, without reading the line
+// from memory first; an access that needs a sector the line lacks (a sector miss) fills the missing ones from memory.
+// A line that is still partial when it is written back goes to memory as one write per run of dirty sectors.
+// Only for a non-inclusive level that is not above an exclusive one, as those hand whole lines between levels.
+//
+// MSHRs: setMSHRs models the miss status holding registers of the level (see cache_store/MSHRFile.h). Every fill from
+// memory is then in flight from its issue until its data is back. An access to a line whose fill is still in flight
+// (e.g. from another initiator, or a prefetch) is a secondary miss: it joins that fill and waits for its data,
+// rather than taking it as a free hit. A miss that finds all MSHRs busy stalls until one frees up, and a prefetch
+// that does is dropped. getMSHRStats() counts primary and secondary misses and both kinds of stall.
+//
+// Coherence: setCoherent makes this cache one of several private caches on a SnoopBus (see snoop_bus.h and
+// TopCoherentCaches), which keeps them coherent with the MESI protocol. Its lines then carry a MESI state (see
+// CoherenceState_t). Misses go to the bus as coherence requests (see coherence_extension.h): a read miss fills the line
+// Exclusive if no other cache has it, Shared if one does; a write miss, or a write to a Shared line, first has the
+// other caches drop their copies. The bus's snoops come in on snoop_export: a read by another cache demotes this
+// cache's copy to Shared, a write drops it, and dirty data (cached, or still queued for write-back) goes along with
+// the snoop. getCoherenceStats() counts upgrades, downgrades, invalidations, interventions and coherence misses:
+// demand misses on lines another cache's write took away.
 
 #ifndef RealCache_H
 #define RealCache_H
@@ -22,17 +62,65 @@ using namespace std;
 #include "tlm_utils/simple_initiator_socket.h"
 #include "tlm_utils/simple_target_socket.h"
 
+#include <map>
+#include <set>
+
 #include "cache_store/CacheStore.h"
+#include "cache_store/Prefetcher.h"
+#include "cache_store/MSHRFile.h"
+#include "coherence_extension.h"
+
+// How a cache level relates to the levels above it (closer to the initiator):
+//  - CacheNonInclusive - no constraint; each level allocates and evicts on its own
+//  - CacheInclusive    - holds everything the levels above hold: evicting a line back-invalidates it above
+//  - CacheExclusive    - holds only lines the level above does not: a hit hands the line up (and drops it here),
+//                        a miss is filled from below without allocating here, and the level above moves all its
+//                        victims, clean or dirty, down into this level. Needs the same line size as the level above.
+enum CacheInclusion_t { CacheNonInclusive, CacheInclusive, CacheExclusive };
+
+// What one level of a cache hierarchy needs from its neighbours besides the TLM traffic on its sockets.
+// Levels are linked with RealCacheT::addUpperLevel, in addition to binding their sockets.
+struct CacheLevel
+{
+  virtual ~CacheLevel() {}
+  virtual uint64_t getLineSize() = 0;
+  // Drop every copy of the len bytes at lineAdr from this level and those above it. Dirty data found is copied
+  // into line (at its offset from lineAdr), newest level last. Returns whether any was found.
+  virtual bool backInvalidate( sc_dt::uint64 lineAdr, unsigned char* line, unsigned int len ) = 0;
+  // A line the level above evicted, for an exclusive level to cache.
+  virtual void insertVictim( sc_dt::uint64 lineAdr, uint32_t* line, bool dirty ) = 0;
+  // Told by the level below which level that is, and whether it is exclusive.
+  virtual void setLowerLevel( CacheLevel* lower, bool lowerIsExclusive ) = 0;
+  virtual void flush( sc_time& delay ) = 0;
+};
 
-struct RealCache: sc_module
+template <class CACHESTORE>
+struct RealCacheT: sc_module, CacheLevel, CacheEvictionHandler
 {
   // TLM-2 socket, defaults to 32-bits wide, base protocol
-  tlm_utils::simple_initiator_socket<RealCache>	initiator_socket;
+  tlm_utils::simple_initiator_socket<RealCacheT>	initiator_socket;
   // TLM-2 socket, defaults to 32-bits wide, base protocol
-  tlm_utils::simple_target_socket<RealCache> 		target_socket;
+  tlm_utils::simple_target_socket<RealCacheT> 		target_socket;
+  // Snoops from a SnoopBus, if this cache is coherent (see setCoherent)
+  sc_export< tlm::tlm_blocking_transport_if<> >  snoop_export;
 
   // The CacheStore object that implements the cache storage
-  CacheStore m_cacheStore;
+  CACHESTORE m_cacheStore;
+
+  // Dirty lines evicted from m_cacheStore, waiting to be written to memory
+  WriteBackQueue m_writeBackQueue;
+  // How many evicted lines are collected before they are written to memory in one go
+  unsigned int p_WriteBackBatchSize;
+  // This level's relation to the levels above it
+  CacheInclusion_t p_Inclusion;
+  // Accesses seen on target_socket, write-backs and back-invalidations
+  CacheAccessStats m_stats;
+  // Prefetches issued by m_prefetcher and what became of them
+  PrefetchStats m_prefetchStats;
+  // The fills in flight, if MSHRs are modelled (see setMSHRs)
+  MSHRFileT<sc_time> m_mshrs;
+  // Coherence traffic seen by this cache, if it is coherent
+  CoherenceStats m_coherenceStats;
 
   // TODO: should be a configurable parameter
   //  HACK FOR TESTING!
@@ -40,15 +128,242 @@ struct RealCache: sc_module
   //  Doing this only for re-use of testing harness
   const sc_time cacheDelay = sc_time(100, SC_NS);
 
-  RealCache(sc_module_name name, uint64_t memorySize=pow(2,30), uint64_t cacheSize=pow(2,20), uint64_t lineSize=pow(2,3), uint64_t numWays=pow(2,0) )
+  RealCacheT(sc_module_name name, uint64_t memorySize=pow(2,30), uint64_t cacheSize=pow(2,20), uint64_t lineSize=pow(2,3), uint64_t numWays=pow(2,0), ReplacementPolicy_t replacementPolicy=ReplLRU, unsigned int writeBackBatchSize=4, CacheInclusion_t inclusion=CacheNonInclusive )
   : sc_module(name)
   , initiator_socket("initiator_socket")  // Construct and name initiator_socket
   , target_socket("target_socket")  // Construct and name target_socket
-  , m_cacheStore( memorySize,cacheSize,lineSize,numWays)  // Construct and configure the CacheStore
+  , snoop_export("snoop_export")
+  , m_cacheStore( memorySize,cacheSize,lineSize,numWays,replacementPolicy)  // Construct and configure the CacheStore
+  , m_writeBackQueue( lineSize, writeBackBatchSize )
+  , p_WriteBackBatchSize( writeBackBatchSize ? writeBackBatchSize : 1 )
+  , p_Inclusion( inclusion )
+  , m_lowerLevel( NULL )
+  , m_lowerLevelIsExclusive( false )
+  , m_lineBuffer( m_writeBackQueue.getNumWordsPerLine() )
+  , m_writeBackBuffer( m_writeBackQueue.getNumWordsPerLine() )
   , m_cachetrans()
+  , m_prefetcher( NULL )
+  , m_prefetching( false )
+  , m_pollutionFilter( 256, uint64_t(CacheLine::EMPTY) )
+  , m_coherent( false )
   {
     // Register callback for incoming b_transport interface method call
-    target_socket.register_b_transport(this, &RealCache::b_transport);
+    target_socket.register_b_transport(this, &RealCacheT::b_transport);
+    // Snoops come back to snoop() below
+    m_snoopTarget.m_cache = this;
+    snoop_export.bind( m_snoopTarget );
+    // Victims come back to evictLine/evictDirtyLine below
+    m_cacheStore.setEvictionHandler( this );
+  }
+
+  ~RealCacheT()
+  {
+    delete m_prefetcher;
+  }
+
+  // Prefetch degree lines, distance lines (or strides) ahead of each trigger. PrefetchNone turns prefetching off.
+  void setPrefetcher( Prefetcher_t type, unsigned int degree=1, unsigned int distance=1 )
+  {
+    if( type != PrefetchNone && p_Inclusion == CacheExclusive )
+      throw std::runtime_error("RealCache: an exclusive level cannot prefetch, it does not allocate on a miss.");
+    delete m_prefetcher;
+    m_prefetcher = createPrefetcher( type, m_cacheStore.p_LineSize, degree, distance );
+  }
+  Prefetcher* getPrefetcher()
+  {
+    return m_prefetcher;
+  }
+
+  // Model numEntries MSHRs of numTargets accesses each; no entries stops modelling them (the default).
+  void setMSHRs( unsigned int numEntries, unsigned int numTargets=4 )
+  {
+    m_mshrs.configure( numEntries, numTargets );
+  }
+  MSHRStats& getMSHRStats()
+  {
+    return m_mshrs.getStats();
+  }
+
+  // Split the lines into sectors of sectorSize bytes (see CacheStoreBase::setSectorSize); the line size turns it
+  // off again. Call before the first access.
+  void setSectorSize( uint64_t sectorSize )
+  {
+    if( sectorSize != 0 && sectorSize != m_cacheStore.p_LineSize && (p_Inclusion != CacheNonInclusive || m_lowerLevelIsExclusive) )
+      throw std::runtime_error("RealCache: only a non-inclusive level that is not above an exclusive one can be sectored.");
+    if( sectorSize != 0 && sectorSize != m_cacheStore.p_LineSize && m_coherent )
+      throw std::runtime_error("RealCache: a coherent level cannot be sectored, its snoops hand over whole lines.");
+    m_cacheStore.setSectorSize( sectorSize );
+    m_writeBackQueue.setSectorSize( m_cacheStore.getSectorSize() );
+  }
+
+  // Keep this cache coherent with the other caches on the SnoopBus its initiator_socket is bound to; snoop_export
+  // must be bound to the bus too. Only for a level with no levels above it (a core's private cache), that is neither
+  // exclusive nor sectored. Call before the first access.
+  void setCoherent( bool coherent )
+  {
+    if( coherent && (p_Inclusion == CacheExclusive || !m_upperLevels.empty() || m_cacheStore.getNumSectors() > 1) )
+      throw std::runtime_error("RealCache: only a level with no levels above it, neither exclusive nor sectored, can be coherent.");
+    m_coherent = coherent;
+  }
+  bool getCoherent()
+  {
+    return m_coherent;
+  }
+  CoherenceStats& getCoherenceStats()
+  {
+    return m_coherenceStats;
+  }
+
+  // Link a cache whose initiator_socket is bound to this cache's target_socket, so back-invalidation, exclusive
+  // victim hand-off and flush() can reach it.
+  void addUpperLevel( CacheLevel* upper )
+  {
+    if( m_coherent )
+      throw std::runtime_error("RealCache: a coherent level cannot have levels above it, it does not pass snoops on.");
+    if( p_Inclusion == CacheExclusive && upper->getLineSize() != m_cacheStore.p_LineSize )
+      throw std::runtime_error("RealCache: an exclusive level needs the same line size as the level above it.");
+    if( p_Inclusion == CacheInclusive && upper->getLineSize() > m_cacheStore.p_LineSize )
+      throw std::runtime_error("RealCache: an inclusive level cannot have smaller lines than the level above it.");
+    m_upperLevels.push_back( upper );
+    upper->setLowerLevel( this, p_Inclusion == CacheExclusive );
+  }
+
+  // Write every dirty line back to memory, so memory holds everything that was written through this cache.
+  // Then report the statistics.
+  virtual void end_of_simulation()
+  {
+    sc_time delay = SC_ZERO_TIME;
+    flush(delay);
+    dumpStats(cout);
+  }
+
+  CacheAccessStats& getStats()
+  {
+    return m_stats;
+  }
+  PrefetchStats& getPrefetchStats()
+  {
+    return m_prefetchStats;
+  }
+  void resetStats()
+  {
+    m_stats.reset();
+    m_prefetchStats.reset();
+    m_mshrs.getStats().reset();
+    m_coherenceStats.reset();
+    m_cacheStore.resetStats();
+  }
+  virtual void dumpStats( std::ostream& os )
+  {
+    m_stats.dump(os, name());
+    std::string storeName = std::string(name()) + ".m_cacheStore";
+    m_cacheStore.getStats().dump(os, storeName.c_str());
+    if ( m_prefetcher != NULL ) {
+      std::string prefetchName = std::string(name()) + ".prefetcher";
+      m_prefetchStats.dump(os, prefetchName.c_str());
+    }
+    if ( m_mshrs.enabled() ) {
+      std::string mshrName = std::string(name()) + ".mshrs";
+      m_mshrs.getStats().dump(os, mshrName.c_str());
+    }
+    if ( m_coherent ) {
+      std::string coherenceName = std::string(name()) + ".coherence";
+      m_coherenceStats.dump(os, coherenceName.c_str());
+    }
+    if ( m_cacheStore.getSetStatsEnabled() ) {
+      os << name() << " per set: set accesses conflicts" << endl;
+      m_cacheStore.dumpSetStats(os);
+    }
+  }
+
+  // Write all dirty lines, queued or still cached, to memory. The cached lines stay cached, but clean.
+  // The levels above are flushed first, so their dirty data passes through this level on its way down.
+  virtual void flush( sc_time& delay )
+  {
+    for( size_t ii = 0; ii < m_upperLevels.size(); ii++) m_upperLevels[ii]->flush(delay);
+    m_cacheStore.flush();
+    drainWriteBackQueue(delay);
+  }
+
+  // CacheLevel
+  virtual uint64_t getLineSize()
+  {
+    return m_cacheStore.p_LineSize;
+  }
+  virtual bool backInvalidate( sc_dt::uint64 lineAdr, unsigned char* line, unsigned int len )
+  {
+    bool dirty = false;
+    for( unsigned int offset = 0; offset < len; offset += m_cacheStore.p_LineSize) {
+      // A write of the line still queued here is newer than the evicting level's copy; it goes along with the
+      // victim instead, or it would reach memory after (and over) the newer data of the levels above.
+      uint64_t queuedSectors = 0;
+      uint32_t* queued = m_writeBackQueue.find(lineAdr + offset, &queuedSectors);
+      if ( queued != NULL ) {
+        copySectors(line + offset, reinterpret_cast<unsigned char*>(queued), queuedSectors, len - offset);
+        m_writeBackQueue.cancel(lineAdr + offset);
+        dirty = true;
+      }
+      // not an access of this level: peekLine leaves the statistics and the replacement state alone
+      CacheLineRef ref = m_cacheStore.peekLine(lineAdr + offset);
+      if ( !ref.isHit() ) continue;
+      if ( ref.line->getDirty() ) {
+        copySectors(line + offset, ref.bytes(), ref.line->isWhole() ? ~0ULL : ref.line->getDirtySectors(), len - offset);
+        dirty = true;
+      }
+      ref.line->setValid(false);
+      m_stats.backInvalidations++;
+      if ( !m_prefetchReady.empty() ) m_prefetchReady.erase(lineAdr + offset);
+    }
+    // the levels above hold newer data than this one, so theirs is copied last
+    for( size_t ii = 0; ii < m_upperLevels.size(); ii++) {
+      if ( m_upperLevels[ii]->backInvalidate(lineAdr, line, len) ) dirty = true;
+    }
+    return dirty;
+  }
+  virtual void insertVictim( sc_dt::uint64 lineAdr, uint32_t* line, bool dirty )
+  {
+    CacheLineRef ref = m_cacheStore.fillLine(lineAdr);
+    memcpy(ref.bytes(), line, m_cacheStore.p_LineSize);
+    // A dirty copy is newer than any write of the line still queued here. A clean one is not, the queued
+    // write is what makes it clean.
+    if ( dirty ) {
+      ref.markDirty();
+      m_writeBackQueue.cancel(lineAdr);
+    }
+  }
+  virtual void setLowerLevel( CacheLevel* lower, bool lowerIsExclusive )
+  {
+    if( lowerIsExclusive && m_cacheStore.getNumSectors() > 1 )
+      throw std::runtime_error("RealCache: a sectored level cannot be above an exclusive one, it hands over whole lines.");
+    m_lowerLevel = lower;
+    m_lowerLevelIsExclusive = lowerIsExclusive;
+  }
+
+  // CacheEvictionHandler, called by m_cacheStore
+  virtual void evictLine( uint64_t lineAdr, uint32_t* data, bool dirty )
+  {
+    if ( m_prefetching ) m_pollutionFilter[pollutionFilterIndex(lineAdr)] = lineAdr;
+    if ( !m_prefetchReady.empty() ) m_prefetchReady.erase(lineAdr);
+    // An inclusive level may not lose a line the levels above still have; their dirty data comes along.
+    if ( p_Inclusion == CacheInclusive ) {
+      for( size_t ii = 0; ii < m_upperLevels.size(); ii++) {
+        if ( m_upperLevels[ii]->backInvalidate(lineAdr, reinterpret_cast<unsigned char*>(data), m_cacheStore.p_LineSize) ) dirty = true;
+      }
+    }
+    // An exclusive level below takes every victim; it is where the line lives from now on.
+    if ( m_lowerLevelIsExclusive ) {
+      m_lowerLevel->insertVictim(lineAdr, data, dirty);
+      return;
+    }
+    if ( dirty ) m_writeBackQueue.evictDirtyLine(lineAdr, data);
+  }
+  virtual void evictDirtyLine( uint64_t lineAdr, const uint32_t* data )
+  {
+    m_writeBackQueue.evictDirtyLine(lineAdr, data);
+  }
+  virtual void evictDirtySectors( uint64_t lineAdr, const uint32_t* data, uint64_t dirtySectors )
+  {
+    m_writeBackQueue.evictDirtySectors(lineAdr, data, dirtySectors);
   }
 
   //  Delegate the access call to the Memory
@@ -67,11 +382,13 @@ struct RealCache: sc_module
   }
 
   // Used when the cache needs to read an entire line form memory -- ie to cache it.
-  virtual void readLineFromMemory(sc_dt::uint64 adr, uint32_t* dataout, sc_time& delay )
+  // Returns false if memory reported an error.
+  // A coherent cache sends it as the coherence request op; m_coherence.shared then tells whether another cache has the line.
+  virtual bool readLineFromMemory(sc_dt::uint64 adr, uint32_t* dataout, sc_time& delay, CoherenceOp_t op=CoherenceRead )
   {
     unsigned char* d = reinterpret_cast<unsigned char*>(dataout);
     m_cachetrans.set_command(tlm::TLM_READ_COMMAND);
-    m_cachetrans.set_address(m_cacheStore.getWordIndex(adr)); // TODO: Review! getLineAddress ?! shouldnt this be line address?
+    m_cachetrans.set_address(m_cacheStore.getLineAddress(adr));
     m_cachetrans.set_data_ptr( d );
     m_cachetrans.set_data_length(m_cacheStore.p_LineSize);
     //m_cachetrans.set_data_length(sizeof(uint32_t));
@@ -79,16 +396,227 @@ struct RealCache: sc_module
     m_cachetrans.set_byte_enable_ptr( 0 ); // 0 indicates unused
     m_cachetrans.set_dmi_allowed( false ); // Mandatory initial value
 
+    if ( m_coherent ) {
+      m_coherence = CoherenceExtension(op);
+      m_cachetrans.set_extension(&m_coherence);
+    }
     accessDataFromMemory(m_cachetrans,delay);
+    if ( m_coherent ) m_cachetrans.clear_extension(&m_coherence);
     if ( m_cachetrans.is_response_error() ) {
       //SC_REPORT_ERROR("TLM-2", "ERROR in transaction ro read dataline from memory!");
       cout << "ERROR RealCache: in transaction to read dataline from memory!" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Used when the cache writes a dirty line back to memory.
+  // Returns false if memory reported an error.
+  virtual bool writeLineToMemory(sc_dt::uint64 lineAdr, uint32_t* datain, sc_time& delay )
+  {
+    return writeBytesToMemory(lineAdr, reinterpret_cast<unsigned char*>(datain), m_cacheStore.p_LineSize, delay);
+  }
+
+  // The same for the dirty sectors of a partial line: one write per run of adjacent dirty sectors.
+  virtual bool writeSectorsToMemory(sc_dt::uint64 lineAdr, uint32_t* datain, uint64_t sectors, sc_time& delay )
+  {
+    unsigned char* d = reinterpret_cast<unsigned char*>(datain);
+    uint64_t sectorSize = m_cacheStore.getSectorSize();
+    bool ok = true;
+    for( uint64_t first = 0; sectors >> first != 0; ) {
+      if ( ((sectors >> first) & 1) == 0 ) { first++; continue; }
+      uint64_t end = first;
+      while ( end < 64 && ((sectors >> end) & 1) ) end++;
+      if ( !writeBytesToMemory(lineAdr + first * sectorSize, d + first * sectorSize, (end - first) * sectorSize, delay) ) ok = false;
+      if ( end == 64 ) break;
+      first = end;
+    }
+    return ok;
+  }
+
+  virtual bool writeBytesToMemory(sc_dt::uint64 adr, unsigned char* d, unsigned int len, sc_time& delay )
+  {
+    m_cachetrans.set_command(tlm::TLM_WRITE_COMMAND);
+    m_cachetrans.set_address(adr);
+    m_cachetrans.set_data_ptr( d );
+    m_cachetrans.set_data_length(len);
+    m_cachetrans.set_streaming_width( len); // = data_length to indicate no streaming
+    m_cachetrans.set_byte_enable_ptr( 0 ); // 0 indicates unused
+    m_cachetrans.set_dmi_allowed( false ); // Mandatory initial value
+
+    accessDataFromMemory(m_cachetrans,delay);
+    if ( m_cachetrans.is_response_error() ) {
+      cout << "ERROR RealCache: in transaction to write back dataline to memory!" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Write all queued dirty lines to memory, oldest first.
+  // Each line is taken off the queue before it is written: the write may make a level below evict another line
+  // and back-invalidate it here, which cancels queued entries.
+  virtual void drainWriteBackQueue( sc_time& delay )
+  {
+    while ( !m_writeBackQueue.empty() ) {
+      uint64_t lineAdr = m_writeBackQueue.frontAddress();
+      uint64_t sectors = m_writeBackQueue.frontIsWhole() ? 0 : m_writeBackQueue.frontSectors();
+      std::copy(m_writeBackQueue.frontData(), m_writeBackQueue.frontData() + m_writeBackBuffer.size(), m_writeBackBuffer.begin());
+      m_writeBackQueue.pop();
+      if ( sectors == 0 ) writeLineToMemory(lineAdr, &m_writeBackBuffer[0], delay);
+      else                writeSectorsToMemory(lineAdr, &m_writeBackBuffer[0], sectors, delay);
+      m_stats.writeBacks++;
+    }
+  }
+
+  // Read a line from memory into the cache. A pending write-back of that line is drained first,
+  // otherwise memory would hand back stale data.
+  virtual bool fillLineFromMemory(sc_dt::uint64 adr, uint32_t* dataout, sc_time& delay, CoherenceOp_t op=CoherenceRead )
+  {
+    if ( m_writeBackQueue.contains(m_cacheStore.getLineAddress(adr)) ) {
+      drainWriteBackQueue(delay);
+    }
+    return readLineFromMemory(adr,dataout,delay,op);
+  }
+
+  // fillLineFromMemory for a demand miss, through an MSHR if they are modelled: waits for a free one first, and
+  // keeps it until the data is back.
+  virtual bool fillLineOnMiss(sc_dt::uint64 adr, uint32_t* dataout, sc_time& delay, CoherenceOp_t op=CoherenceRead )
+  {
+    if ( !m_mshrs.enabled() ) return fillLineFromMemory(adr,dataout,delay,op);
+    sc_time now = sc_time_stamp() + delay;
+    delay += m_mshrs.issue(now) - now;
+    bool ok = fillLineFromMemory(adr,dataout,delay,op);
+    m_mshrs.allocate(m_cacheStore.getLineAddress(adr), sc_time_stamp() + delay);
+    return ok;
+  }
+
+  // A hit on a line whose fill is still in flight waits for its data (a secondary miss).
+  void waitForFill( sc_dt::uint64 adr, sc_time& delay )
+  {
+    if ( !m_mshrs.enabled() ) return;
+    sc_time now = sc_time_stamp() + delay;
+    sc_time ready;
+    if ( m_mshrs.merge(m_cacheStore.getLineAddress(adr), now, ready) ) delay += ready - now;
+  }
+
+  // While a line is being filled, the levels below may evict it and back-invalidate it here. The slot keeps its tag,
+  // and is made valid again; the access was counted already. Its data is the latest only if the fill went straight
+  // into the slot of a line that had no dirty data of its own (a plain miss): see fillMissingSectors otherwise.
+  CacheLineRef reborrowAfterFill( sc_dt::uint64 adr )
+  {
+    return m_cacheStore.fillLine(m_cacheStore.getLineAddress(adr));
+  }
+
+  // A sector miss: the cached line at adr lacks some of the sectors an access needs. The line is read from memory
+  // aside and its missing sectors are filled from it; the sectors it has keep their (possibly dirty) data.
+  // Returns the line, whole, or a miss if memory reported an error.
+  CacheLineRef fillMissingSectors( sc_dt::uint64 adr, sc_time& delay )
+  {
+    m_stats.sectorMisses++;
+    if ( !fillLineOnMiss(adr, &m_lineBuffer[0], delay) ) return CacheLineRef();
+    const unsigned char* filled = reinterpret_cast<const unsigned char*>(&m_lineBuffer[0]);
+    // The fill may have made a level below back-invalidate the line, which took the dirty sectors down with it. The
+    // data filled before that may not have them: the line is read again, now that they are written down, as on a
+    // plain miss.
+    CacheLineRef line = m_cacheStore.peekLine(adr);
+    if ( !line.isHit() ) {
+      line = reborrowAfterFill(adr);
+      if ( !fillLineOnMiss(adr, line.data, delay) ) {
+        m_cacheStore.invalidate(adr);
+        return CacheLineRef();
+      }
+      line = reborrowAfterFill(adr);
+      return CacheLineRef(line.line, true);    // reborrowed as a fresh allocation, but the fill did not fail
+    }
+    copySectors(line.bytes(), filled, ~line.line->getValidSectors(), m_cacheStore.p_LineSize);
+    line.line->setValid(true);    // all sectors
+    return line;
+  }
+
+  // Copy the given sectors (bit ii for sector ii; all of them if this level is not sectored) of a line, but no more
+  // than len bytes of it.
+  void copySectors( unsigned char* to, const unsigned char* from, uint64_t sectors, uint64_t len )
+  {
+    uint64_t sectorSize = m_cacheStore.getSectorSize();
+    len = std::min(len, m_cacheStore.p_LineSize);
+    if ( sectorSize == m_cacheStore.p_LineSize ) sectors = 1;
+    for( uint64_t ss = 0; ss * sectorSize < len; ss++) {
+      if ( (sectors >> ss) & 1 ) memcpy(to + ss * sectorSize, from + ss * sectorSize, std::min(sectorSize, len - ss * sectorSize));
+    }
+  }
+
+  // Have the other caches on the bus drop their copies of the line at adr, before this cache writes it without
+  // reading it first: a write to a Shared line, or one that overwrites the whole line.
+  virtual void requestOwnership( sc_dt::uint64 adr, sc_time& delay )
+  {
+    m_cachetrans.set_command(tlm::TLM_IGNORE_COMMAND);
+    m_cachetrans.set_address(m_cacheStore.getLineAddress(adr));
+    m_cachetrans.set_data_ptr( reinterpret_cast<unsigned char*>(&m_lineBuffer[0]) );
+    m_cachetrans.set_data_length(m_cacheStore.p_LineSize);
+    m_cachetrans.set_streaming_width( m_cacheStore.p_LineSize);
+    m_cachetrans.set_byte_enable_ptr( 0 );
+    m_cachetrans.set_dmi_allowed( false );
+    m_coherence = CoherenceExtension(CoherenceUpgrade);
+    m_cachetrans.set_extension(&m_coherence);
+    accessDataFromMemory(m_cachetrans,delay);
+    m_cachetrans.clear_extension(&m_coherence);
+  }
+
+  // A snoop from the bus, on snoop_export: another cache reads (SnoopShared) or writes (SnoopInvalidate) the line
+  // at the snoop's address. Not an access of this level, so the statistics and replacement state are left alone.
+  virtual void snoop( tlm::tlm_generic_payload& trans, sc_time& delay )
+  {
+    CoherenceExtension* ext = trans.get_extension<CoherenceExtension>();
+    sc_dt::uint64 lineAdr = trans.get_address();
+    if ( ext == NULL || trans.get_data_length() != m_cacheStore.p_LineSize || lineAdr != m_cacheStore.getLineAddress(lineAdr) ) {
+      SC_REPORT_ERROR("RealCache", "A snoop must carry a CoherenceExtension and cover one whole line of the cache.");
+      trans.set_response_status( tlm::TLM_GENERIC_ERROR_RESPONSE );
+      return;
+    }
+    // a dirty copy still queued for write-back is this cache's too; the snoop takes it instead of memory
+    uint32_t* queued = m_writeBackQueue.find(lineAdr);
+    if ( queued != NULL ) {
+      memcpy(trans.get_data_ptr(), queued, m_cacheStore.p_LineSize);
+      m_writeBackQueue.cancel(lineAdr);
+      ext->dirty = true;
+      m_coherenceStats.interventions++;
+    }
+    CacheLineRef ref = m_cacheStore.peekLine(lineAdr);
+    if ( ref.isHit() ) {
+      ext->shared = true;
+      if ( ref.line->getDirty() ) {
+        memcpy(trans.get_data_ptr(), ref.bytes(), m_cacheStore.p_LineSize);
+        ext->dirty = true;
+        m_coherenceStats.interventions++;
+      }
+      if ( ext->op == SnoopInvalidate ) {
+        // the way is free for the next miss of its set (see CacheStore::pickOrEvict)
+        ref.line->setValid(false);
+        if ( !m_prefetchReady.empty() ) m_prefetchReady.erase(lineAdr);
+        m_invalidatedLines.insert(lineAdr);
+        m_coherenceStats.invalidations++;
+      } else if ( ref.line->getExclusive() ) {
+        // the dirty data goes to memory with the snoop, so the copy left here is clean
+        ref.line->setDirty(false);
+        ref.line->setExclusive(false);
+        m_coherenceStats.downgrades++;
+      }
     }
+    trans.set_response_status( tlm::TLM_OK_RESPONSE );
+  }
+
+  // A demand miss on a line that another cache's write invalidated here.
+  void checkCoherenceMiss( sc_dt::uint64 adr )
+  {
+    if ( !m_coherent || m_invalidatedLines.erase(m_cacheStore.getLineAddress(adr)) == 0 ) return;
+    m_coherenceStats.coherenceMisses++;
   }
 
   // TLM-2 blocking transport method
   //  Check if data is in the cache, return it with short delay.
   //  Else forward to memory (which has longer delay).
+  // Accepts any length: an initiator typically reads or writes a word, a cache level above reads and writes
+  // whole lines. A transaction is served one of this cache's lines at a time.
   virtual void b_transport( tlm::tlm_generic_payload& trans, sc_time& delay )
   {
     dump_trans("RealCache::b_transport ",trans);
@@ -96,65 +624,210 @@ struct RealCache: sc_module
     sc_dt::uint64    adr = trans.get_address();
     unsigned char*   ptr = trans.get_data_ptr();
     unsigned int     len = trans.get_data_length();
-    unsigned char*   byt = trans.get_byte_enable_ptr();
-    unsigned int     wid = trans.get_streaming_width();
 
-    // Only supports single byte read and write.
-    assert(len==sizeof(uint32_t));
-    //assert(len==sizeof(uint32_t) && "RealCache only supports transactions of len==4");
-    bool bHit;
-    if ( cmd == tlm::TLM_READ_COMMAND ) {
-      uint8_t* dataout = new uint8_t[m_cacheStore.p_LineSize](); // allocs array for dataline and inits all elems to 0
-      bHit = m_cacheStore.getDataLine(adr, reinterpret_cast<uint32_t*>(dataout) ); //
-      if ( bHit == true ) {
-        // Hit!
-        dump_line("dataout from cache: ", dataout);
-        uint8_t dByte = dataout[m_cacheStore.getByteIndex(adr)];
-        *ptr= dByte;
-        cout << "Cache read hit 2.  delay is " << delay << endl;
-      } else {
-        // Miss!  Read the entire dataline from memory, cache it and return just the word requested
-        // 1. Read the entire data line
-        uint8_t* dataout = new uint8_t[m_cacheStore.p_LineSize](); // allocs array for dataline and inits all elems to 0
-        readLineFromMemory(adr,reinterpret_cast<uint32_t*>(dataout),delay);
-        dump_line("dataout from mem: ", dataout);
-        // 2. cache the entire line from memory
-        m_cacheStore.setDataLine(m_cacheStore.getLineAddress(adr), reinterpret_cast<uint32_t*>(dataout) );
-        // 3. return just the word requested
-        *ptr=dataout[m_cacheStore.getByteIndex(adr)];
-
-        cout << "Cache miss.  delay is " << delay << endl;
+    bool ok = true;
+    for( unsigned int offset = 0; ok && offset < len; ) {
+      // the part of the transaction that falls within one line
+      unsigned int partLen = std::min((uint64_t)(len - offset), m_cacheStore.p_LineSize - m_cacheStore.getByteIndex(adr + offset));
+      if ( cmd == tlm::TLM_READ_COMMAND )       ok = readFromLine(adr + offset, ptr + offset, partLen, delay);
+      else if ( cmd == tlm::TLM_WRITE_COMMAND ) ok = writeToLine(adr + offset, ptr + offset, partLen, delay);
+      offset += partLen;
+    }
+    // Write evicted dirty lines back once a full batch has built up
+    if ( m_writeBackQueue.size() >= p_WriteBackBatchSize ) {
+      drainWriteBackQueue(delay);
+    }
+    trans.set_response_status( ok ? tlm::TLM_OK_RESPONSE : tlm::TLM_GENERIC_ERROR_RESPONSE );
+  }
+
+  // Read len bytes at adr, all within one line.
+  // The line is borrowed from the CacheStore (no copy); only the requested bytes are copied out.
+  virtual bool readFromLine( sc_dt::uint64 adr, unsigned char* ptr, unsigned int len, sc_time& delay )
+  {
+    uint64_t byteIndex = m_cacheStore.getByteIndex(adr);
+    CacheLineRef line = m_cacheStore.accessLine(adr);
+    uint64_t sectors = m_cacheStore.getSectorMask(adr, len);
+    if ( line.isHit() && (line.line->getValidSectors() & sectors) != sectors ) {
+      // Sector miss: the line is cached, but not all of the bytes asked for
+      m_stats.readMisses++;
+      line = fillMissingSectors(adr, delay);
+      if ( !line.isHit() ) return false;
+      memcpy(ptr, line.bytes() + byteIndex, len);
+      return true;
+    }
+    if ( line.isHit() ) {
+      // Hit!
+      bool prefetched = line.line->getPrefetched();
+      if ( prefetched ) usePrefetchedLine(line, adr, delay);
+      waitForFill(adr, delay);
+      dump_line("dataout from cache: ", line.bytes());
+      memcpy(ptr, line.bytes() + byteIndex, len);
+      m_stats.readHits++;
+      // Exclusive: the level above takes the whole line over. It does not know the line may be dirty, so
+      // memory gets this level's data now. The line's way is free for the next victim (see CacheStore::pickOrEvict).
+      if ( p_Inclusion == CacheExclusive && len == m_cacheStore.p_LineSize ) {
+        if ( line.line->getDirty() ) m_writeBackQueue.evictDirtyLine(m_cacheStore.getLineAddress(adr), line.data);
+        line.line->setValid(false);
+      }
+      if ( prefetched ) prefetchAfter(adr, delay);
+      return true;
+    }
+    m_stats.readMisses++;
+    checkPollution(adr);
+    checkCoherenceMiss(adr);
+    if ( p_Inclusion == CacheExclusive ) {
+      // Miss! The line goes to the level above only; this level gets it when that level evicts it.
+      bool ok = fillLineOnMiss(adr,&m_lineBuffer[0],delay);
+      memcpy(ptr, reinterpret_cast<unsigned char*>(&m_lineBuffer[0]) + byteIndex, len);
+      return ok;
+    }
+    // Miss!  Read the entire dataline from memory, cache it and return just the bytes requested
+    // 1.+2. allocate the line in the cache and read the entire data line from memory straight into it
+    line = m_cacheStore.fillLine(m_cacheStore.getLineAddress(adr));
+    bool ok = fillLineOnMiss(adr,line.data,delay);
+    if ( !ok ) {
+      m_cacheStore.invalidate(adr);
+    } else {
+      line = reborrowAfterFill(adr);
+      if ( m_coherent ) line.line->setExclusive(!m_coherence.shared);
+    }
+    dump_line("dataout from mem: ", line.bytes());
+    // 3. return just the bytes requested
+    memcpy(ptr, line.bytes() + byteIndex, len);
+    if ( ok ) prefetchAfter(adr, delay);
+    return ok;
+  }
+
+  // Write len bytes at adr, all within one line.
+  virtual bool writeToLine( sc_dt::uint64 adr, unsigned char* ptr, unsigned int len, sc_time& delay )
+  {
+    uint64_t byteIndex = m_cacheStore.getByteIndex(adr);
+    CacheLineRef line = m_cacheStore.accessLine(adr);
+    // the sectors the write touches, and the ones among them it only partly overwrites
+    uint64_t sectors = m_cacheStore.getSectorMask(adr, len);
+    uint64_t partSectors = sectors & ~m_cacheStore.getWholeSectorMask(adr, len);
+    if ( line.isHit() && (partSectors & ~line.line->getValidSectors()) != 0 ) {
+      // Sector miss: the rest of a sector the write only partly covers has to come from memory first
+      m_stats.writeMisses++;
+      line = fillMissingSectors(adr, delay);
+      if ( !line.isHit() ) return false;
+      memcpy(line.bytes() + byteIndex, ptr, len);
+      line.markDirty(sectors);
+      return true;
+    }
+    if ( line.isHit() ) {
+      bool prefetched = line.line->getPrefetched();
+      if ( prefetched ) usePrefetchedLine(line, adr, delay);
+      waitForFill(adr, delay);
+      if ( m_coherent && !line.line->getExclusive() ) {
+        requestOwnership(adr, delay);
+        m_coherenceStats.upgrades++;
       }
+      dump_line("dataout from cache: ", line.bytes());
+      memcpy(line.bytes() + byteIndex, ptr, len);
+      line.markDirty(sectors);
+      if ( m_coherent ) line.line->setExclusive(true);
+      m_stats.writeHits++;
+      if ( prefetched ) prefetchAfter(adr, delay);
+      return true;
+    }
+    m_stats.writeMisses++;
+    checkPollution(adr);
+    checkCoherenceMiss(adr);
+    // Write-allocate: read the line from memory into the cache, then write the bytes into the cached line.
+    // Memory gets the data when the line is evicted or flushed.
+    // 1.+2. allocate the line in the cache and read the entire data line from memory straight into it,
+    //       unless the write covers the whole line (e.g. a write-back from the level above), or, with sectors,
+    //       all the sectors it touches
+    line = m_cacheStore.fillLine(m_cacheStore.getLineAddress(adr));
+    if ( len == m_cacheStore.p_LineSize ) {
+      // the whole line is overwritten, so a write of it still queued here is stale, and so are other caches' copies
+      m_writeBackQueue.cancel(m_cacheStore.getLineAddress(adr));
+      if ( m_coherent ) requestOwnership(adr, delay);
+    } else if ( m_cacheStore.getNumSectors() > 1 && partSectors == 0 ) {
+      // the rest of the line stays invalid until an access needs it; a queued write of the line does not
+      // conflict, as this line's sectors will be written back after it
+      line.line->setValidSectors(0);
+    } else if ( !fillLineOnMiss(adr,line.data,delay,CoherenceReadExclusive) ) {
+      m_cacheStore.invalidate(adr);
+      cout << "ERROR RealCache: Reading the line from memory upon a write miss" << endl;
+      return false;
+    } else {
+      line = reborrowAfterFill(adr);
+    }
+    // 3. write the bytes and remember that memory does not have them yet
+    memcpy(line.bytes() + byteIndex, ptr, len);
+    line.markDirty(sectors);
+    if ( m_coherent ) line.line->setExclusive(true);
+    dump_line("dataout from mem: ", line.bytes());
+    prefetchAfter(adr, delay);
+    return true;
+  }
+
+  // The first demand access of a prefetched line. If the prefetch's data is not back yet, the access waits for it.
+  void usePrefetchedLine( CacheLineRef& line, sc_dt::uint64 adr, sc_time& delay )
+  {
+    line.line->setPrefetched(false);
+    m_prefetchStats.useful++;
+    std::map<uint64_t, sc_time>::iterator ready = m_prefetchReady.find(m_cacheStore.getLineAddress(adr));
+    if ( ready == m_prefetchReady.end() ) return;
+    sc_time now = sc_time_stamp() + delay;
+    if ( ready->second > now ) {
+      m_prefetchStats.late++;
+      delay += ready->second - now;
+    }
+    m_prefetchReady.erase(ready);
+  }
 
-    } else if ( cmd == tlm::TLM_WRITE_COMMAND ) {
-      // Because we only access entire datalines from CacheStore.
-      uint8_t* dataout = new uint8_t[m_cacheStore.p_LineSize](); // allocs array for dataline and inits all elems to 0
-      bHit = m_cacheStore.getDataLine(adr, reinterpret_cast<uint32_t*>(dataout));
-      if ( bHit == true ) {
-        dump_line("dataout from cache: ", dataout);
-        dataout[m_cacheStore.getByteIndex(adr)] = *ptr;
-        m_cacheStore.setDataLine(adr, reinterpret_cast<uint32_t*>(dataout));
-        cout << "Cache write hit. " << endl;
-        // TODO: schedule a write to memory
-      } else {
-        // write the data to memory, then read the line from memory and cache it.
-        // 1. write the data to memory
-        accessDataFromMemory(trans,delay);
-        cout << "Cache write miss.  delay is " << delay << endl;
-        if ( trans.is_response_error() ) {
-          //SC_REPORT_ERROR("TLM-2", "Cache: Received response error from memory!");
-          cout << "ERROR RealCache: Writing to memory upon a write miss" << endl;
-        } else {
-          // 2. read the entire line from memory with the newly written data
-          //TODO: create a new transaction for this!!! why corrupt the existing one?
-          readLineFromMemory(adr,reinterpret_cast<uint32_t*>(dataout),delay);
-          dump_line("dataout from mem: ", dataout);
-          // 3. put line from memory into the cache
-          m_cacheStore.setDataLine(m_cacheStore.getLineAddress(adr), reinterpret_cast<uint32_t*>(dataout) );
-        }
+  // Train the prefetcher on a demand access at adr and fill the lines it asks for. Called once the demand access
+  // is done with its line, as the fills may evict it.
+  virtual void prefetchAfter( sc_dt::uint64 adr, sc_time& delay )
+  {
+    if ( m_prefetcher == NULL ) return;
+    m_prefetchCandidates.clear();
+    m_prefetcher->train(m_cacheStore.getLineAddress(adr), m_prefetchCandidates);
+    // the fills go out one after the other once the demand access is done; they do not delay it
+    sc_time prefetchDelay = delay;
+    for( size_t ii = 0; ii < m_prefetchCandidates.size(); ii++) {
+      uint64_t lineAdr = m_prefetchCandidates[ii];
+      if ( lineAdr + m_cacheStore.p_LineSize > m_cacheStore.p_MemorySize || m_cacheStore.peekLine(lineAdr).isHit()
+        || (m_mshrs.enabled() && !m_mshrs.tryIssue(sc_time_stamp() + prefetchDelay)) ) {
+        m_prefetchStats.dropped++;
+        continue;
+      }
+      m_prefetching = true;
+      CacheLineRef line = m_cacheStore.fillLine(lineAdr);
+      bool ok = fillLineFromMemory(lineAdr, line.data, prefetchDelay);
+      m_prefetching = false;
+      if ( m_mshrs.enabled() ) m_mshrs.allocate(lineAdr, sc_time_stamp() + prefetchDelay, false);
+      line = reborrowAfterFill(lineAdr);
+      if ( !ok ) {
+        line.line->setValid(false);
+        continue;
+      }
+      line.line->setPrefetched(true);
+      if ( m_coherent ) {
+        line.line->setExclusive(!m_coherence.shared);
+        m_invalidatedLines.erase(lineAdr);
       }
+      m_prefetchReady[lineAdr] = sc_time_stamp() + prefetchDelay;
+      m_prefetchStats.issued++;
     }
-    trans.set_response_status( tlm::TLM_OK_RESPONSE );
+  }
+
+  // A demand miss on a line that a prefetch fill evicted.
+  void checkPollution( sc_dt::uint64 adr )
+  {
+    if ( m_prefetcher == NULL ) return;
+    uint64_t lineAdr = m_cacheStore.getLineAddress(adr);
+    uint64_t& evicted = m_pollutionFilter[pollutionFilterIndex(lineAdr)];
+    if ( evicted != lineAdr ) return;
+    m_prefetchStats.pollution++;
+    evicted = CacheLine::EMPTY;
+  }
+  size_t pollutionFilterIndex( uint64_t lineAdr )
+  {
+    return (lineAdr / m_cacheStore.p_LineSize) & (m_pollutionFilter.size() - 1);
   }
 
   virtual void dump_trans( const char* msg, tlm::tlm_generic_payload& trans )
@@ -240,12 +913,38 @@ struct RealCache: sc_module
     cout<<endl;
   }
 
-  SC_HAS_PROCESS(RealCache);
+  SC_HAS_PROCESS(RealCacheT);
 
 protected:
+  // The hierarchy around this level (see addUpperLevel)
+  std::vector<CacheLevel*> m_upperLevels;
+  CacheLevel*              m_lowerLevel;
+  bool                     m_lowerLevelIsExclusive;
+  // An exclusive level reads missed lines here, as it does not cache them itself
+  std::vector<uint32_t>    m_lineBuffer;
+  // The line drainWriteBackQueue is writing to memory
+  std::vector<uint32_t>    m_writeBackBuffer;
   tlm::tlm_generic_payload m_cachetrans;
+  // Prefetching (see setPrefetcher)
+  Prefetcher*                 m_prefetcher;
+  std::vector<uint64_t>       m_prefetchCandidates;
+  bool                        m_prefetching;        // a prefetch fill is evicting lines
+  std::map<uint64_t, sc_time> m_prefetchReady;      // when the data of each prefetched, unused line is back
+  std::vector<uint64_t>       m_pollutionFilter;    // lines evicted by prefetch fills, direct-mapped
+  // Coherence (see setCoherent)
+  struct SnoopTarget: tlm::tlm_blocking_transport_if<>
+  {
+    RealCacheT* m_cache;
+    virtual void b_transport( tlm::tlm_generic_payload& trans, sc_time& delay ) { m_cache->snoop(trans, delay); }
+  };
+  bool                        m_coherent;
+  SnoopTarget                 m_snoopTarget;        // what snoop_export is bound to
+  CoherenceExtension          m_coherence;          // the request of m_cachetrans, and its answer
+  std::set<uint64_t>          m_invalidatedLines;   // lines snoops invalidated that no miss has brought back yet
 };
 
+typedef RealCacheT<CacheStore> RealCache;
+
 //const sc_time Cache::cacheDelay = sc_time(10, SC_NS);
 
 #endif
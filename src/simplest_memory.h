@@ -4,6 +4,7 @@
 // Simple memory
 //  - memory is modeled as a single contiguous block of 32bit values
 //  - supports DMI by returning the pointer to that mem
+//  - loadImage copies a program or data image into it (see cache_store/MemoryImage.h)
 
 // Needed for the simple_target_socket
 #define SC_INCLUDE_DYNAMIC_PROCESSES
@@ -16,6 +17,9 @@ using namespace std;
 #include "tlm.h"
 #include "tlm_utils/simple_target_socket.h"
 
+#include <stdexcept>
+#include "cache_store/MemoryImage.h"
+
 // This Memory is implemented with a fixed buffer to represent actual memeory
 struct SimplestMemory: sc_module
 {
@@ -69,6 +73,21 @@ struct SimplestMemory: sc_module
     // Obliged to set response status to indicate successful completion
     trans.set_response_status( tlm::TLM_OK_RESPONSE );
   }
+  // Copy the segments of image into memory. Throws std::runtime_error if one does not fit.
+  void loadImage( const MemoryImage& image )
+  {
+    const sc_dt::uint64 bytes = sc_dt::uint64(p_PAGESIZE) * sizeof(uint32_t);
+    const std::vector<MemoryImage::Segment>& segments = image.getSegments();
+    for( size_t ii = 0; ii < segments.size(); ii++) {
+      const MemoryImage::Segment& segment = segments[ii];
+      if ( segment.address > bytes || segment.memSize > bytes - segment.address ) {
+        throw std::runtime_error("SimplestMemory: image segment does not fit in memory");
+      }
+      unsigned char* mem = reinterpret_cast<unsigned char*>(m_mem) + segment.address;
+      memcpy(mem, segment.data, segment.fileSize);
+      memset(mem + segment.fileSize, 0, segment.memSize - segment.fileSize);
+    }
+  }
   // This is to support an implementation cheat by the FakeCache module class.
   virtual uint32_t* getDirectMemoryPointer()
   {
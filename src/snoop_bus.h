@@ -0,0 +1,156 @@
+#ifndef SnoopBus_H
+#define SnoopBus_H
+
+// A snooping bus between several coherent RealCache's (see RealCacheT::setCoherent) and the memory they share,
+// which keeps the caches coherent with the MESI protocol.
+// Each cache's initiator_socket is bound to one of target_sockets, and one of snoop_ports to the cache's snoop_export.
+// A coherence request (see coherence_extension.h) from one cache is snooped in all the others before it is served:
+//  - CoherenceRead          - the others demote their copies to Shared. If one of them had dirty data, that data
+//                             serves the read and is written to memory, since no cache owns it any more. The
+//                             requester learns whether any of them had the line.
+//  - CoherenceReadExclusive - the others drop their copies. Dirty data serves the read, and is now the requester's.
+//  - CoherenceUpgrade       - the others drop their copies; nothing is read.
+// Anything else, write-backs in particular, passes through to memory. The caches must all have the same line size.
+// Every request that is snooped costs snoopDelay, on top of memory's delay if memory serves it.
+// getStats() counts the requests, snoops and cache-to-cache transfers (see SnoopBusStats in cache_store/CacheStats.h).
+
+// Needed for the simple_target_socket
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "tlm.h"
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+#include <vector>
+#include <sstream>
+
+#include "cache_store/CacheStats.h"
+#include "coherence_extension.h"
+
+struct SnoopBus: sc_module
+{
+  // One per cache, tagged with the cache's index
+  std::vector< tlm_utils::simple_target_socket_tagged<SnoopBus>* > target_sockets;
+  // One per cache, bound to the snoop_export of the cache on the same index
+  std::vector< sc_port< tlm::tlm_blocking_transport_if<> >* >       snoop_ports;
+  // To memory
+  tlm_utils::simple_initiator_socket<SnoopBus>                      initiator_socket;
+
+  const sc_time snoopDelay;
+
+  SnoopBus(sc_module_name name, unsigned int numCaches, sc_time _snoopDelay=sc_time(10, SC_NS))
+  : sc_module(name)
+  , initiator_socket("initiator_socket")
+  , snoopDelay( _snoopDelay )
+  {
+    for( unsigned int ii = 0; ii < numCaches; ii++) {
+      std::ostringstream targetName, snoopName;
+      targetName << "target_socket_" << ii;
+      snoopName << "snoop_port_" << ii;
+      target_sockets.push_back( new tlm_utils::simple_target_socket_tagged<SnoopBus>(targetName.str().c_str()) );
+      target_sockets.back()->register_b_transport(this, &SnoopBus::b_transport, ii);
+      snoop_ports.push_back( new sc_port< tlm::tlm_blocking_transport_if<> >(snoopName.str().c_str()) );
+    }
+  }
+
+  virtual void end_of_simulation()
+  {
+    m_stats.dump(cout, name());
+  }
+
+  SnoopBusStats& getStats()
+  {
+    return m_stats;
+  }
+
+  // TLM-2 blocking transport method, for the cache on target_sockets[id]
+  virtual void b_transport( int id, tlm::tlm_generic_payload& trans, sc_time& delay )
+  {
+    CoherenceExtension* request = trans.get_extension<CoherenceExtension>();
+    if ( request == NULL || trans.is_write() ) {
+      if ( trans.is_write() ) m_stats.writes++;
+      initiator_socket->b_transport( trans, delay );
+      return;
+    }
+    if ( request->op == CoherenceRead )               m_stats.reads++;
+    else if ( request->op == CoherenceReadExclusive ) m_stats.readExclusives++;
+    else                                              m_stats.upgrades++;
+
+    // Snoop every other cache. Only one of them can have dirty data for the line: the one that owned it.
+    unsigned int len = trans.get_data_length();
+    m_snoopData.resize( len );
+    m_snoop = CoherenceExtension( request->op == CoherenceRead ? SnoopShared : SnoopInvalidate );
+    m_snooptrans.set_command( tlm::TLM_READ_COMMAND );
+    m_snooptrans.set_address( trans.get_address() );
+    m_snooptrans.set_data_ptr( &m_snoopData[0] );
+    m_snooptrans.set_data_length( len );
+    m_snooptrans.set_streaming_width( len );
+    m_snooptrans.set_byte_enable_ptr( 0 );
+    m_snooptrans.set_dmi_allowed( false );
+    m_snooptrans.set_extension( &m_snoop );
+    delay += snoopDelay;
+    bool shared = false;
+    for( unsigned int ii = 0; ii < snoop_ports.size(); ii++) {
+      if ( ii == (unsigned int)id ) continue;
+      m_snoop.shared = false;
+      m_snooptrans.set_response_status( tlm::TLM_INCOMPLETE_RESPONSE );
+      (*snoop_ports[ii])->b_transport( m_snooptrans, delay );
+      m_stats.snoops++;
+      if ( m_snoop.shared ) {
+        m_stats.snoopHits++;
+        shared = true;
+      }
+    }
+    m_snooptrans.clear_extension( &m_snoop );
+    request->shared = shared;
+
+    if ( request->op == CoherenceUpgrade ) {
+      // the requester overwrites the line, dirty data found for it included
+      trans.set_response_status( tlm::TLM_OK_RESPONSE );
+      return;
+    }
+    if ( !m_snoop.dirty ) {
+      initiator_socket->b_transport( trans, delay );
+      return;
+    }
+    // Dirty data from the cache that owned the line
+    m_stats.cacheToCache++;
+    memcpy( trans.get_data_ptr(), &m_snoopData[0], len );
+    trans.set_response_status( tlm::TLM_OK_RESPONSE );
+    if ( request->op == CoherenceRead ) writeToMemory( trans.get_address(), len, delay );
+  }
+
+  // Write the dirty data a read snoop found to memory.
+  void writeToMemory( sc_dt::uint64 adr, unsigned int len, sc_time& delay )
+  {
+    m_memtrans.set_command( tlm::TLM_WRITE_COMMAND );
+    m_memtrans.set_address( adr );
+    m_memtrans.set_data_ptr( &m_snoopData[0] );
+    m_memtrans.set_data_length( len );
+    m_memtrans.set_streaming_width( len );
+    m_memtrans.set_byte_enable_ptr( 0 );
+    m_memtrans.set_dmi_allowed( false );
+    m_memtrans.set_response_status( tlm::TLM_INCOMPLETE_RESPONSE );
+    initiator_socket->b_transport( m_memtrans, delay );
+    m_stats.writes++;
+    if ( m_memtrans.is_response_error() ) {
+      SC_REPORT_ERROR("SnoopBus", "Response error from b_transport call to Memory, writing back snooped dirty data.");
+    }
+  }
+
+  SC_HAS_PROCESS(SnoopBus);
+
+protected:
+  SnoopBusStats               m_stats;
+  tlm::tlm_generic_payload    m_snooptrans;
+  CoherenceExtension          m_snoop;        // the snoop of m_snooptrans, and what the caches answered
+  std::vector<unsigned char>  m_snoopData;    // dirty data a snoop found
+  tlm::tlm_generic_payload    m_memtrans;
+};
+
+#endif
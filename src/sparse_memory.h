@@ -2,12 +2,24 @@
 #define MEMORY_SPARSE_H
 
 // Sparse Memory class
-// Behavior is that it doesnt allocate any actual space until a transaction asks to
-// access some memory, then this allocates a page containing that and
+// Behavior is that it doesnt allocate any actual space until a transaction writes
+// some memory, then this allocates a page containing that and
 // implements the transaction.
 //  delay += 100 //always
 // By default, for testing, memory is initialized with words alternating 0,1,0,1,...
-// Allocated mem pages are kept ion a hash map (unordered_map)
+// Pages nobody wrote are copy-on-write: reads of them (readMemoryPage) are served from one shared read-only page of
+// that pattern, and a page gets a private copy of it on its first write (fetchMemoryPage). So only written pages
+// take up memory; getNumPages() counts them. DMI to an unwritten page is read-only, unless the request is a write;
+// a page that gets its private copy has any DMI to the pattern page invalidated.
+// loadImage puts a program or data image in memory (see cache_store/MemoryImage.h). Whole pages of a raw or ELF image
+// that are page aligned in memory are adopted straight from the image's mapping of the file, without copying; the
+// memory keeps the image for as long as it has pages of it.
+// A transaction accesses one word, or a burst of whole words within one page (e.g. a cache line).
+// Allocated mem pages are kept in a radix page table (see cache_store/PageTable.h): finding the page of an address
+// is a few dependent loads, no hashing, and dump() lists the pages in address order.
+// In front of the page table, a small TLB of recent translations (PageTLBT) serves the accesses that stay on the
+// pages just used: a sequential scan walks the table once per page. Pages are mapped through mapPage, which keeps
+// the TLB in step. getTLBStats() counts its lookups and hits; they are dumped with the pages.
 
 // Needed for the simple_target_socket
 #define SC_INCLUDE_DYNAMIC_PROCESSES
@@ -20,7 +32,13 @@ using namespace std;
 #include "tlm.h"
 #include "tlm_utils/simple_target_socket.h"
 
-#include <unordered_map>
+#include <memory>       // shared_ptr
+#include <vector>
+#include <algorithm>    // min
+#include <stdexcept>
+
+#include "cache_store/PageTable.h"
+#include "cache_store/MemoryImage.h"
 
 // Target module representing a simple memory
 
@@ -36,6 +54,15 @@ struct SparseMemory: sc_module
     socket.register_b_transport(this, &SparseMemory::b_transport);
     socket.register_get_direct_mem_ptr(this, &SparseMemory::get_direct_mem_ptr);
     socket.register_transport_dbg(this, &SparseMemory::transport_dbg);
+
+    // what every page holds until it is written: word pattern of 0,1,0,1,...
+    m_patternPage = new uint32_t[PAGESIZE];
+    for( int ii=0; ii<PAGESIZE; ii++) { m_patternPage[ii] = ii % 2; }
+  }
+  ~SparseMemory()
+  {
+    m_pages.forEach( [this](sc_dt::uint64, uint32_t* page) { if ( ownsPage(page) ) delete[] page; } );
+    delete[] m_patternPage;
   }
 
   virtual void end_of_simulation	()
@@ -46,30 +73,111 @@ struct SparseMemory: sc_module
   virtual void dump()
   {
     cout << "Dumping the set of address blocks allocated in memory. " << endl;
-    for( unordered_map<sc_dt::uint64,uint32_t*>::iterator itr = m_writtenAddresses.begin(); itr != m_writtenAddresses.end(); ++itr) {
-      cout << hex << itr->first << endl;
-    }
+    m_pages.forEach( [](sc_dt::uint64 pageID, uint32_t*) { cout << hex << pageID << endl; } );
+    cout << dec;
+    cout << name() << ": pages=" << m_pages.size() << " bytes=" << m_pages.size() * PAGESIZE * sizeof(uint32_t) << endl;
+    std::string tlbName = std::string(name()) + ".tlb";
+    m_tlb.getStats().dump(cout, tlbName.c_str());
+  }
+
+  PageTLBStats& getTLBStats()
+  {
+    return m_tlb.getStats();
+  }
+  // the pages that were written, each taking up memory
+  size_t getNumPages()
+  {
+    return m_pages.size();
+  }
+
+  // return the page of Memory holding word adr, to read from
+  // if never written, that is the shared pattern page: nothing is allocated
+  const uint32_t* readMemoryPage( sc_dt::uint64 adr )
+  {
+    sc_dt::uint64 pageID = adr / PAGESIZE;
+    uint32_t* page = m_tlb.find(pageID);
+    if( page != NULL ) return page;
+    page = m_pages.find(pageID);
+    if( page == NULL ) page = m_patternPage;
+    m_tlb.fill(pageID, page);
+    return page;
   }
 
-  // return a page of Memory
-  // if never accessed before, allocate and initialize it
+  // return a page of Memory, to write to
+  // if never written before, allocate it as a copy of the pattern page
   virtual uint32_t* fetchMemoryPage( sc_dt::uint64 adr )
   {
-    uint32_t* page = NULL;
     sc_dt::uint64 pageID = adr / PAGESIZE;
-    // From our hashmap, grab the page containing that address. If not there, allocate and init it.
-    unordered_map<sc_dt::uint64,uint32_t*>::iterator itr = m_writtenAddresses.find(pageID);
-    if( itr != m_writtenAddresses.end() ) {
-      page = m_writtenAddresses[pageID];
-    } else {
+    uint32_t* page = m_tlb.find(pageID);
+    if( page != NULL && page != m_patternPage ) return page;
+    // From our page table, grab the page containing that address. If not there, allocate and init it.
+    page = m_pages.find(pageID);
+    if( page == NULL ) {
       page = new uint32_t[PAGESIZE];
-      memset(page,0, PAGESIZE);
-      for( int ii=1; ii<PAGESIZE-2; ii+=2) { page[ii] = 1; } // fill with word pattern of 0,1,0,1,...
-      m_writtenAddresses[pageID] = page;
+      memcpy(page, m_patternPage, PAGESIZE * sizeof(uint32_t));
+      mapPage(pageID, page);
     }
+    m_tlb.fill(pageID, page);
     return page;
   }
 
+  // Map pageID to page (NULL unmaps it), dropping any translation of it the TLB still holds,
+  // and any DMI granted to it: that points at the page it was mapped to until now.
+  void mapPage( sc_dt::uint64 pageID, uint32_t* page )
+  {
+    m_pages.insert(pageID, page);
+    m_tlb.invalidate(pageID);
+    sc_dt::uint64 start_adr = pageID * PAGESIZE * sizeof(uint32_t);
+    socket->invalidate_direct_mem_ptr(start_adr, start_adr + PAGESIZE * sizeof(uint32_t) - 1);
+  }
+
+  // Put the segments of image in memory. Throws std::runtime_error, before loading any, if one does not fit in
+  // MAXSIZEMEM words.
+  void loadImage( const std::shared_ptr<MemoryImage>& image )
+  {
+    const sc_dt::uint64 PAGEBYTES = PAGESIZE * sizeof(uint32_t);
+    const sc_dt::uint64 MAXBYTES = sc_dt::uint64(MAXSIZEMEM) * sizeof(uint32_t);
+    const std::vector<MemoryImage::Segment>& segments = image->getSegments();
+    for( size_t ii = 0; ii < segments.size(); ii++) {
+      if ( segments[ii].address > MAXBYTES || segments[ii].memSize > MAXBYTES - segments[ii].address ) {
+        throw std::runtime_error("SparseMemory: image segment does not fit in memory");
+      }
+    }
+    // kept from the start, so a page two segments both adopt is not taken for one of this memory's own
+    m_images.push_back(image);
+    bool adopted = false;
+    for( size_t ii = 0; ii < segments.size(); ii++) {
+      const MemoryImage::Segment& segment = segments[ii];
+      // a page, or the part of one the segment covers, at a time
+      for( sc_dt::uint64 done = 0; done < segment.memSize; ) {
+        sc_dt::uint64 adr = segment.address + done;
+        sc_dt::uint64 offset = adr % PAGEBYTES;
+        sc_dt::uint64 len = std::min(PAGEBYTES - offset, segment.memSize - done);
+        sc_dt::uint64 fromFile = done < segment.fileSize ? std::min(len, segment.fileSize - done) : 0;
+        const unsigned char* data = segment.data + done;
+        if ( fromFile == PAGEBYTES && segment.fileOffset >= 0 && reinterpret_cast<uintptr_t>(data) % PAGEBYTES == 0 ) {
+          uint32_t* old = m_pages.find(adr / PAGEBYTES);
+          mapPage(adr / PAGEBYTES, reinterpret_cast<uint32_t*>(const_cast<unsigned char*>(data)));
+          if ( old != NULL && ownsPage(old) ) delete[] old;
+          adopted = true;
+        } else {
+          unsigned char* page = reinterpret_cast<unsigned char*>( fetchMemoryPage(adr / sizeof(uint32_t)) );
+          memcpy(page + offset, data, fromFile);
+          memset(page + offset + fromFile, 0, len - fromFile);
+        }
+        done += len;
+      }
+    }
+    if ( !adopted ) m_images.pop_back();
+  }
+
+  // Did this memory allocate page, or was it adopted from an image?
+  bool ownsPage( const uint32_t* page )
+  {
+    for( size_t ii = 0; ii < m_images.size(); ii++) if ( m_images[ii]->contains(page) ) return false;
+    return true;
+  }
+
   // TLM-2 blocking transport method
   virtual void b_transport( tlm::tlm_generic_payload& trans, sc_time& delay )
   {
@@ -91,7 +199,7 @@ struct SparseMemory: sc_module
       trans.set_response_status( tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE );
       return;
     }
-    if (len > 4 || wid < len) {
+    if (wid < len || (len > 4 && (len % 4 != 0 || trans.get_address() % 4 != 0 || adr % PAGESIZE + len / 4 > sc_dt::uint64(PAGESIZE)))) {
       trans.set_response_status( tlm::TLM_BURST_ERROR_RESPONSE );
       return;
     }
@@ -103,20 +211,21 @@ struct SparseMemory: sc_module
     // delay always incrd by 100
     delay += sc_time(100, SC_NS);
 
-    uint32_t* page = fetchMemoryPage(adr);
     sc_dt::uint64 pageID = adr / PAGESIZE;
     sc_dt::uint64 offset = adr % PAGESIZE;
     //cout << "b_transport 4:  " << "pageID hex=" << hex << pageID << " pageID dec=" << dec << pageID << endl;
     //cout << "b_transport 4:  " << "adr hex=" << hex << adr << " adr dec=" << dec << adr << endl;
-    //cout << "b_transport 4:  " << "page hex=" << hex << page << " page dec=" << dec << page << endl;
-    //cout << "b_transport 4:  " << "offset hex=" << hex << offset << " offset dec=" << dec << offset<< endl;
-    //cout << "b_transport 4:  " << "page[offset] before, hex=" << hex << page[offset] << " dec=" << dec << page[offset]<< endl;
 
     // Obliged to implement read and write commands
+    // A read leaves an unwritten page shared, a write gets it its own copy
     if ( cmd == tlm::TLM_READ_COMMAND ) {
-      *ptr = page[offset];
+      const uint32_t* page = readMemoryPage(adr);
+      if ( len > 4 ) memcpy(ptr, &page[offset], len);
+      else           *ptr = page[offset];
     } else if ( cmd == tlm::TLM_WRITE_COMMAND ) {
-      page[offset] = *ptr;
+      uint32_t* page = fetchMemoryPage(adr);
+      if ( len > 4 ) memcpy(&page[offset], ptr, len);
+      else           page[offset] = *ptr;
     }
     // no additional behavior for TLM_WRITE_COMMAND
     //cout << "b_transport 5:  " << "page[offset] after, hex=" << hex << page[offset] << " dec=" << dec << page[offset]<< endl;
@@ -133,18 +242,24 @@ struct SparseMemory: sc_module
   {
     sc_dt::uint64     adr = trans.get_address() / sizeof(uint32_t);
 
-    // Permit read and write access
-    dmi_data.allow_read_write();
+    // Permit read and write access to a written page, or when asked to write; an unwritten page stays shared
+    const uint32_t* page;
+    if ( trans.get_command() == tlm::TLM_WRITE_COMMAND || m_pages.find(adr / PAGESIZE) != NULL ) {
+      page = fetchMemoryPage(adr);
+      dmi_data.allow_read_write();
+    } else {
+      page = readMemoryPage(adr);
+      dmi_data.allow_read();
+    }
 
-    // Set other details of DMI region
+    // Set other details of DMI region, in bytes
     //cout << "get_direct_mem_ptr 0:  " << "adr=" << hex << adr << endl;
-    uint32_t* page = fetchMemoryPage(adr);
-    sc_dt::uint64 start_adr = (adr / PAGESIZE) * PAGESIZE;
+    sc_dt::uint64 start_adr = (adr / PAGESIZE) * PAGESIZE * sizeof(uint32_t);
     //cout << "get_direct_mem_ptr 1:  " << "page=" << hex << page << endl;
-    dmi_data.set_dmi_ptr( reinterpret_cast<unsigned char*>( page ) );
+    dmi_data.set_dmi_ptr( reinterpret_cast<unsigned char*>( const_cast<uint32_t*>(page) ) );
     //cout << "get_direct_mem_ptr 2:  " << "start_adr=" << hex << start_adr << endl;
     dmi_data.set_start_address( start_adr );
-    dmi_data.set_end_address( start_adr + PAGESIZE - 1 );
+    dmi_data.set_end_address( start_adr + PAGESIZE * sizeof(uint32_t) - 1 );
     dmi_data.set_read_latency( LATENCY_ONE_CLOCK );
     dmi_data.set_write_latency( LATENCY_ONE_CLOCK );
 
@@ -182,7 +297,10 @@ public:
   const sc_time LATENCY_ONE_CLOCK = sc_time(10, SC_NS);
   enum { MAXSIZEMEM = (1<<20) }; // 1MiB
 protected:
-  unordered_map<sc_dt::uint64,uint32_t*> m_writtenAddresses;
+  PageTableT<uint32_t> m_pages;
+  PageTLBT<uint32_t>   m_tlb;           // translations of written pages, and of unwritten ones to m_patternPage
+  uint32_t*            m_patternPage;   // shared by all unwritten pages, never written
+  std::vector< std::shared_ptr<MemoryImage> > m_images;   // the images pages were adopted from
 
 } ;
 #endif
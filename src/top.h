@@ -18,7 +18,10 @@ using namespace std;
 #include "top_simplest_memory.h"
 #include "top_fake_cache.h"
 #include "top_real_cache.h"
+#include "top_cache_hierarchy.h"
 #include "top_sparse_memory.h"
+#include "top_coherent_caches.h"
+#include "top_mapped_memory.h"
 
 SC_MODULE(Top)
 {
@@ -31,7 +34,12 @@ SC_MODULE(Top)
     m_testable_modules.push_back(new TopSimplestMemory("TopSimplestMemory")  );
     m_testable_modules.push_back(new TopFakeCache("TopFakeCache")  );
     m_testable_modules.push_back(new TopRealCache("TopRealCache")  );
+    m_testable_modules.push_back(new TopRealCacheFixed("TopRealCacheFixed")  );
+    m_testable_modules.push_back(new TopCacheHierarchy("TopCacheHierarchy", TopCacheHierarchy::defaultConfigs())  );
+    m_testable_modules.push_back(new TopCacheHierarchy("TopCacheHierarchySectored", TopCacheHierarchy::sectoredConfigs())  );
     m_testable_modules.push_back(new TopSparseMemory("TopSparseMemory")  );
+    m_testable_modules.push_back(new TopCoherentCaches("TopCoherentCaches")  );
+    m_testable_modules.push_back(new TopMappedMemory("TopMappedMemory")  );
     SC_THREAD(thread_process);
   }
 
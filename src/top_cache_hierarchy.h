@@ -0,0 +1,155 @@
+#ifndef TopCacheHierarchy_H
+#define TopCacheHierarchy_H
+
+// Top of a SystemC hierarchy that assembles an initiator, a stack of N RealCache levels, and SimplestMemory.
+// levels[0] is the L1 (bound to the initiator), the last one is the LLC (bound to memory). Each level fills whole
+// lines from the one below it, and is linked to it with addUpperLevel so inclusion can be enforced.
+
+#include <vector>
+
+#include "testable_module.h"
+#include "initiator_test_simplest_memory.h"
+#include "simplest_memory.h"
+#include "real_cache.h"
+
+// Configuration of one level of the stack.
+struct CacheLevelConfig {
+  uint64_t            cacheSize;
+  uint64_t            lineSize;
+  uint64_t            numWays;
+  CacheInclusion_t    inclusion;            // relative to the level above; ignored for the L1
+  ReplacementPolicy_t replacementPolicy;
+  Prefetcher_t        prefetcher;           // see RealCacheT::setPrefetcher
+  unsigned int        prefetchDegree;
+  unsigned int        prefetchDistance;
+  uint64_t            sectorSize;           // see RealCacheT::setSectorSize; 0: not sectored
+
+  CacheLevelConfig(uint64_t _cacheSize, uint64_t _lineSize, uint64_t _numWays, CacheInclusion_t _inclusion=CacheNonInclusive, ReplacementPolicy_t _replacementPolicy=ReplLRU,
+                   Prefetcher_t _prefetcher=PrefetchNone, unsigned int _prefetchDegree=1, unsigned int _prefetchDistance=1, uint64_t _sectorSize=0)
+  : cacheSize(_cacheSize), lineSize(_lineSize), numWays(_numWays), inclusion(_inclusion), replacementPolicy(_replacementPolicy)
+  , prefetcher(_prefetcher), prefetchDegree(_prefetchDegree), prefetchDistance(_prefetchDistance), sectorSize(_sectorSize)
+  {}
+};
+
+struct TopCacheHierarchy : TestableModule {
+  InitiatorTestSimplestMemory *initiatorTestSimplestMemory;
+  SimplestMemory              *simplestMemory;
+  std::vector<RealCache*>      levels;
+
+  TopCacheHierarchy(const sc_module_name& name, const std::vector<CacheLevelConfig>& configs, uint64_t memorySize=pow(2,10))
+  : TestableModule(name)
+  {
+    initiatorTestSimplestMemory = new InitiatorTestSimplestMemory("InitiatorTestSimplestMemory",100,0);
+    simplestMemory    = new SimplestMemory   ("SimplestMemory");
+    for( size_t ii = 0; ii < configs.size(); ii++) {
+      std::ostringstream levelName;
+      levelName << "L" << ii+1;
+      levels.push_back( new RealCache(levelName.str().c_str(), memorySize, configs[ii].cacheSize, configs[ii].lineSize,
+                                      configs[ii].numWays, configs[ii].replacementPolicy, 4, configs[ii].inclusion) );
+      levels.back()->setPrefetcher( configs[ii].prefetcher, configs[ii].prefetchDegree, configs[ii].prefetchDistance );
+    }
+
+    initiatorTestSimplestMemory->socket.bind( levels.front()->target_socket );
+    for( size_t ii = 1; ii < levels.size(); ii++) {
+      levels[ii-1]->initiator_socket.bind( levels[ii]->target_socket );
+      levels[ii]->addUpperLevel( levels[ii-1] );
+    }
+    levels.back()->initiator_socket.bind( simplestMemory->socket );
+    // once linked: whether a level may be sectored depends on the level below
+    for( size_t ii = 0; ii < levels.size(); ii++) {
+      if ( configs[ii].sectorSize != 0 ) levels[ii]->setSectorSize( configs[ii].sectorSize );
+    }
+  }
+  void runTests() {
+    if ( levels.front()->m_cacheStore.getNumSectors() > 1 ) {
+      testSectorFillAfterBackInvalidation();
+      return;
+    }
+    initiatorTestSimplestMemory->test_1();
+    if ( levels.back()->p_Inclusion == CacheExclusive ) testExclusiveWayReuse();
+  }
+
+  // A sector miss in the L1 fills the line from the L2, whose prefetch then evicts the line and back-invalidates it
+  // in the L1, taking its dirty sector down. The L1 must not keep the line as filled before that: its data is stale.
+  // For the sectored stack (see sectoredConfigs).
+  void testSectorFillAfterBackInvalidation() {
+    const char* unittestName = "TopCacheHierarchy sector fill after back-invalidation";
+    uint32_t data = 0xAAAA;
+    sc_time delay = SC_ZERO_TIME;
+    tlm::tlm_generic_payload trans;
+    trans.set_data_ptr(reinterpret_cast<unsigned char*>(&data));
+    trans.set_data_length(sizeof(data));
+    trans.set_streaming_width(sizeof(data));
+    trans.set_byte_enable_ptr(0);
+    const tlm::tlm_command commands[3] = { tlm::TLM_WRITE_COMMAND, tlm::TLM_READ_COMMAND, tlm::TLM_READ_COMMAND };
+    const sc_dt::uint64 addresses[3] = { 0x0, 0x4, 0x0 };
+    for( int ii = 0; ii < 3; ii++) {
+      trans.set_command(commands[ii]);
+      trans.set_address(addresses[ii]);
+      trans.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+      initiatorTestSimplestMemory->socket->b_transport(trans, delay);
+      if ( trans.is_response_error() ) SC_REPORT_ERROR(unittestName, "Response error from b_transport." );
+    }
+    if ( data != 0xAAAA ) {
+      std::ostringstream oss;
+      oss << "Expected 0xAAAA written at 0x0 to be read back, got 0x" << hex << data << dec;
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+  }
+
+  // An exclusive LLC gives a line up to the level above on a hit. The way it leaves must take the next victim,
+  // rather than push out a valid line. Uses set 7 of the default LLC (8 sets of 4 ways), which test_1 leaves alone.
+  void testExclusiveWayReuse() {
+    const char* unittestName = "TopCacheHierarchy exclusive way reuse";
+    RealCache* llc = levels.back();
+    uint64_t setStride = llc->m_cacheStore.getNumCacheBlocks() * llc->getLineSize();
+    uint64_t lineAdr = 7 * llc->getLineSize();
+    uint32_t* mem = simplestMemory->getDirectMemoryPointer();
+    for( uint64_t way = 0; way < 4; way++) {
+      llc->insertVictim(lineAdr + way * setStride, mem + (lineAdr + way * setStride) / sizeof(uint32_t), false);
+    }
+    uint64_t evictions = llc->m_cacheStore.getStats().evictions;
+
+    // a hit of a whole line moves it up, out of the LLC
+    uint32_t line[2];
+    tlm::tlm_generic_payload trans;
+    trans.set_command(tlm::TLM_READ_COMMAND);
+    trans.set_address(lineAdr);
+    trans.set_data_ptr(reinterpret_cast<unsigned char*>(line));
+    trans.set_data_length(llc->getLineSize());
+    trans.set_streaming_width(llc->getLineSize());
+    trans.set_byte_enable_ptr(0);
+    sc_time delay = SC_ZERO_TIME;
+    llc->b_transport(trans, delay);
+    uint64_t victimAdr = lineAdr + 4 * setStride;
+    llc->insertVictim(victimAdr, mem + victimAdr / sizeof(uint32_t), false);
+
+    bool othersKept = true;
+    for( uint64_t way = 1; way < 4; way++) othersKept = othersKept && llc->m_cacheStore.peekLine(lineAdr + way * setStride).isHit();
+    if ( trans.is_response_error() || llc->m_cacheStore.peekLine(lineAdr).isHit() || !othersKept
+      || !llc->m_cacheStore.peekLine(victimAdr).isHit() || llc->m_cacheStore.getStats().evictions != evictions ) {
+      SC_REPORT_ERROR(unittestName, "Expected the way of a line moved up to take the next victim, with nothing evicted." );
+    }
+  }
+
+  // The default stack: 64B L1, 128B inclusive L2, 256B exclusive LLC, all with 8B lines.
+  static std::vector<CacheLevelConfig> defaultConfigs() {
+    std::vector<CacheLevelConfig> configs;
+    configs.push_back( CacheLevelConfig(pow(2,6),LineSize8,2) );
+    configs.push_back( CacheLevelConfig(pow(2,7),LineSize8,2,CacheInclusive) );
+    configs.push_back( CacheLevelConfig(pow(2,8),LineSize8,4,CacheExclusive) );
+    return configs;
+  }
+
+  // 16B L1 of 8B lines in 4B sectors, over a 16B direct-mapped inclusive L2 that prefetches the next two lines: the
+  // second maps to the set of the line missed.
+  static std::vector<CacheLevelConfig> sectoredConfigs() {
+    std::vector<CacheLevelConfig> configs;
+    configs.push_back( CacheLevelConfig(pow(2,4),LineSize8,2,CacheNonInclusive,ReplLRU,PrefetchNone,1,1,4) );
+    configs.push_back( CacheLevelConfig(pow(2,4),LineSize8,1,CacheInclusive,ReplLRU,PrefetchNextLine,2) );
+    return configs;
+  }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef TopCoherentCaches_H
+#define TopCoherentCaches_H
+
+// Top of a SystemC hierarchy that assembles a multi-core initiator, one coherent RealCache per core, a SnoopBus
+// keeping them coherent, and the SparseMemory they share.
+// After the initiator's tests, it checks that the caches saw coherence traffic, and that memory has everything the
+// cores wrote once the caches are flushed.
+
+#include <vector>
+
+#include "testable_module.h"
+#include "initiator_test_coherence.h"
+#include "sparse_memory.h"
+#include "snoop_bus.h"
+#include "real_cache.h"
+
+struct TopCoherentCaches : TestableModule {
+  InitiatorTestCoherence  *initiatorTestCoherence;
+  std::vector<RealCache*>  caches;
+  SnoopBus                *snoopBus;
+  SparseMemory            *sparseMemory;
+
+  TopCoherentCaches(const sc_module_name& name, unsigned int numCores=2)
+  : TestableModule(name)
+  {
+    initiatorTestCoherence = new InitiatorTestCoherence("InitiatorTestCoherence", numCores);
+    for( unsigned int ii = 0; ii < numCores; ii++) {
+      std::ostringstream cacheName;
+      cacheName << "L1_" << ii;
+      caches.push_back( new RealCache(cacheName.str().c_str(), pow(2,20), pow(2,7), LineSize8, 2) );
+      caches.back()->setCoherent( true );
+    }
+    snoopBus     = new SnoopBus    ("SnoopBus", numCores);
+    sparseMemory = new SparseMemory("SparseMemory");
+
+    for( unsigned int ii = 0; ii < numCores; ii++) {
+      initiatorTestCoherence->sockets[ii]->bind( caches[ii]->target_socket );
+      caches[ii]->initiator_socket.bind( *snoopBus->target_sockets[ii] );
+      snoopBus->snoop_ports[ii]->bind( caches[ii]->snoop_export );
+    }
+    snoopBus->initiator_socket.bind( sparseMemory->socket );
+  }
+
+  void runTests() {
+    initiatorTestCoherence->test_1();
+
+    const char* unittestName = "TopCoherentCaches coherence statistics";
+    for( size_t ii = 0; ii < caches.size(); ii++) {
+      CoherenceStats& stats = caches[ii]->getCoherenceStats();
+      if ( stats.upgrades == 0 || stats.invalidations == 0 || stats.downgrades == 0 || stats.interventions == 0 || stats.coherenceMisses == 0 ) {
+        std::string s = std::string("Expected upgrades, invalidations, downgrades, interventions and coherence misses in ") + caches[ii]->name();
+        SC_REPORT_ERROR(unittestName, s.c_str() );
+      }
+    }
+    if ( snoopBus->getStats().cacheToCache == 0 ) {
+      SC_REPORT_ERROR(unittestName, "Expected cache-to-cache transfers on the bus." );
+    }
+
+    unittestName = "TopCoherentCaches memory after flush";
+    sc_time delay = SC_ZERO_TIME;
+    for( size_t ii = 0; ii < caches.size(); ii++) caches[ii]->flush(delay);
+    const uint32_t* page = sparseMemory->readMemoryPage(0);
+    if ( page[0] != 9 || page[1] != 7 || page[4] != InitiatorTestCoherence::INCREMENTS ) {
+      std::ostringstream oss;
+      oss << "Memory has " << page[0] << " " << page[1] << " " << page[4] << " at 0x0 0x4 0x10";
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+
+    // A line another core's write invalidated gives its way to the next miss of its set, rather than have a valid
+    // line evicted. Set 7 of the caches (8 sets of 2 ways), which the tests above leave alone.
+    unittestName = "TopCoherentCaches invalidated way reuse";
+    const sc_dt::uint64 setStride = caches[0]->m_cacheStore.getNumCacheBlocks() * caches[0]->getLineSize();
+    const sc_dt::uint64 lineAdr = 7 * caches[0]->getLineSize();
+    initiatorTestCoherence->check_read(unittestName, 0, lineAdr + setStride, 0);
+    initiatorTestCoherence->check_read(unittestName, 0, lineAdr, 0);     // most recently used: not LRU's victim
+    initiatorTestCoherence->write(unittestName, 1, lineAdr, 5);
+    uint64_t evictions = caches[0]->m_cacheStore.getStats().evictions;
+    initiatorTestCoherence->check_read(unittestName, 0, lineAdr + 2 * setStride, 0);
+    if ( caches[0]->m_cacheStore.getStats().evictions != evictions || !caches[0]->m_cacheStore.peekLine(lineAdr + setStride).isHit() ) {
+      SC_REPORT_ERROR(unittestName, "Expected the way of the invalidated line to be reused, with nothing evicted." );
+    }
+    initiatorTestCoherence->check_read(unittestName, 0, lineAdr, 5);
+  }
+};
+
+#endif
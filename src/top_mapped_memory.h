@@ -0,0 +1,67 @@
+#ifndef TopMappedMemory_H
+#define TopMappedMemory_H
+
+// Top of a SystemC hierarchy that assembles an initiator and a 4 GiB MappedMemory.
+// After the initiator's tests, it checks that the memory only took up host memory for the pages it touched.
+
+#include "testable_module.h"
+#include "initiator_test_mapped_memory.h"
+#include "mapped_memory.h"
+
+#include <stdio.h>
+
+struct TopMappedMemory : TestableModule {
+  InitiatorTestMappedMemory *initiatorTestMappedMemory;
+  MappedMemory              *mappedMemory;
+
+  TopMappedMemory(const sc_module_name& name)
+  : TestableModule(name)
+  {
+    initiatorTestMappedMemory = new InitiatorTestMappedMemory("InitiatorTestMappedMemory");
+    mappedMemory              = new MappedMemory             ("MappedMemory", 1ULL<<32);
+    initiatorTestMappedMemory->socket.bind( mappedMemory->socket );
+  }
+  void runTests() {
+    initiatorTestMappedMemory->test_1(mappedMemory->p_Size);
+
+    const char* unittestName = "TopMappedMemory resident memory";
+    uint64_t resident = mappedMemory->residentBytes();
+    if ( resident == 0 || resident > (1 << 20) ) {
+      std::ostringstream oss;
+      oss << "Expected only the few pages touched to be resident, not " << resident << " bytes";
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+
+    // A raw image of 64 MiB and a bit at 1 GiB: all but the bit mapped from the file, so nothing is read yet.
+    unittestName = "TopMappedMemory loadImage";
+    const sc_dt::uint64 IMAGE = 64 << 20, AT = 1ULL << 30;
+    const char* path = "/tmp/TopMappedMemory_image.bin";
+    FILE* file = fopen(path, "wb");
+    fseek(file, IMAGE - 1, SEEK_SET);
+    fputc('E', file);     // the end of the last whole page; the rest is a hole, zero
+    fputs("tail", file);
+    fclose(file);
+    uint64_t before = mappedMemory->residentBytes();
+    {
+      MemoryImage image(path, ImageRaw, AT);
+      mappedMemory->loadImage(image);
+    }
+    remove(path);
+    unsigned char* mem = mappedMemory->hostAddress(AT);
+    if ( mem[IMAGE - 1] != 'E' || memcmp(mem + IMAGE, "tail", 4) != 0 || mem[IMAGE + 4] != 0 || mem[0] != 0 ) {
+      SC_REPORT_ERROR(unittestName, "Expected the image in memory at 1 GiB." );
+    }
+    // (mincore counts the file pages the kernel has cached, read ahead around the last page: far less than a copy)
+    if ( mappedMemory->residentBytes() - before > IMAGE / 2 ) {
+      SC_REPORT_ERROR(unittestName, "Expected the image to be mapped, not copied." );
+    }
+    mem[0] = 3;
+    mappedMemory->zero(AT, IMAGE + 4);
+    if ( mem[0] != 0 || mem[IMAGE - 1] != 0 || mem[IMAGE + 3] != 0 ) {
+      SC_REPORT_ERROR(unittestName, "Expected zero() to clear the image." );
+    }
+  }
+};
+
+#endif
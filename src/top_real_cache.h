@@ -2,30 +2,44 @@
 #define TopRealCache_H
 
 // Top of a SystemC hierarchy that assembles an initiator, RealCache, and SimplestMemory.
+// TopRealCacheT takes the cache type, so the same test also runs a RealCacheT over a compile-time CacheStoreT.
 
 #include "testable_module.h"
 #include "initiator_test_simplest_memory.h"
 #include "simplest_memory.h"
 #include "real_cache.h"
 
-struct TopRealCache : TestableModule {
+template <class REALCACHE>
+struct TopRealCacheT : TestableModule {
   InitiatorTestSimplestMemory *initiatorTestSimplestMemory;
   SimplestMemory              *simplestMemory;
-  RealCache                   *realCache;
+  REALCACHE                   *realCache;
 
-  TopRealCache(const sc_module_name& name)
+  TopRealCacheT(const sc_module_name& name)
   : TestableModule(name)
   {
     initiatorTestSimplestMemory = new InitiatorTestSimplestMemory("InitiatorTestSimplestMemory",100,0);
     simplestMemory    = new SimplestMemory   ("SimplestMemory");
-    realCache    = new RealCache   ("RealCache",pow(2,10),pow(2,7),LineSize8,2);
+    realCache    = new REALCACHE   ("RealCache",pow(2,10),pow(2,7),LineSize8,2);
 
     initiatorTestSimplestMemory->socket.bind( realCache->target_socket );
     realCache->initiator_socket.bind( simplestMemory->socket );
   }
   void runTests() {
     initiatorTestSimplestMemory->test_1();
+
+    // the store counts one lookup per access, whether it hit, missed and filled, or missed and got back-invalidated
+    CacheAccessStats& stats = realCache->getStats();
+    CacheStoreStats storeStats = realCache->m_cacheStore.getStats();
+    if ( storeStats.lookups != stats.readHits + stats.readMisses + stats.writeHits + stats.writeMisses
+      || storeStats.hits != stats.readHits + stats.writeHits ) {
+      SC_REPORT_ERROR(name(), "Expected the store's lookups and hits to match the accesses of the cache." );
+    }
   }
 };
 
+typedef TopRealCacheT<RealCache> TopRealCache;
+// 128B cache of 8B lines, 2 ways, so 8 cache blocks -- same geometry as TopRealCache
+typedef TopRealCacheT< RealCacheT< CacheStoreT<LineSize8,2,8> > > TopRealCacheFixed;
+
 #endif
@@ -7,6 +7,10 @@
 #include "initiator_test_sparse_memory.h"
 #include "sparse_memory.h"
 
+#include <stdio.h>
+#include <vector>
+#include <memory>
+
 struct TopSparseMemory : TestableModule {
   InitiatorTestSparseMemory *initiatorTestSparseMemory;
   SparseMemory    *sparseMemory;
@@ -20,6 +24,107 @@ struct TopSparseMemory : TestableModule {
   }
   void runTests() {
     initiatorTestSparseMemory->test_1();
+
+    // A sequential scan walks the page table once per page, the TLB serves the rest.
+    const char* unittestName = "TopSparseMemory TLB";
+    PageTLBStats before = sparseMemory->getTLBStats();
+    for( sc_dt::uint64 adr = 0; adr < 4 * (sc_dt::uint64)sparseMemory->PAGESIZE; adr++) sparseMemory->readMemoryPage(adr);
+    uint64_t hits = sparseMemory->getTLBStats().hits - before.hits;
+    if ( hits < 4 * ((sc_dt::uint64)sparseMemory->PAGESIZE - 1) ) {
+      std::ostringstream oss;
+      oss << "Expected a TLB hit on all but the first word of each page, got " << hits << " hits in " << 4 * sparseMemory->PAGESIZE;
+      std::string s = oss.str();
+      SC_REPORT_ERROR(unittestName, s.c_str() );
+    }
+
+    // Reads of pages nobody wrote allocate nothing; DMI to them is read-only until the first write.
+    unittestName = "TopSparseMemory copy-on-write";
+    size_t pages = sparseMemory->getNumPages();
+    sc_dt::uint64 untouched = 64 * sparseMemory->PAGESIZE;
+    const uint32_t* shared = sparseMemory->readMemoryPage(untouched);
+    tlm::tlm_generic_payload trans;
+    tlm::tlm_dmi dmi;
+    trans.set_command( tlm::TLM_READ_COMMAND );
+    trans.set_address( untouched * sizeof(uint32_t) );
+    sparseMemory->get_direct_mem_ptr(trans, dmi);
+    if ( shared[0] != 0 || shared[1] != 1 || shared[sparseMemory->PAGESIZE - 1] != 1 || sparseMemory->getNumPages() != pages ) {
+      SC_REPORT_ERROR(unittestName, "Expected an unwritten page to read as the 0,1 pattern without being allocated." );
+    }
+    if ( dmi.is_write_allowed() || dmi.get_start_address() != untouched * sizeof(uint32_t) ) {
+      SC_REPORT_ERROR(unittestName, "Expected read-only DMI to an unwritten page." );
+    }
+    uint32_t* written = sparseMemory->fetchMemoryPage(untouched);
+    written[0] = 5;
+    if ( written == shared || shared[0] != 0 || sparseMemory->readMemoryPage(untouched)[0] != 5 || sparseMemory->getNumPages() != pages + 1 ) {
+      SC_REPORT_ERROR(unittestName, "Expected the first write to give the page its own copy." );
+    }
+    sparseMemory->get_direct_mem_ptr(trans, dmi);
+    if ( !dmi.is_read_write_allowed() || dmi.get_dmi_ptr() != reinterpret_cast<unsigned char*>(written) ) {
+      SC_REPORT_ERROR(unittestName, "Expected read/write DMI to a written page." );
+    }
+
+    // A raw image of two pages and a bit, at a page boundary: the two pages come straight from the file.
+    unittestName = "TopSparseMemory loadImage";
+    const sc_dt::uint64 PAGEBYTES = sparseMemory->PAGESIZE * sizeof(uint32_t);
+    std::vector<uint32_t> words( 2 * sparseMemory->PAGESIZE + 3 );
+    for( size_t ii = 0; ii < words.size(); ii++) words[ii] = 0x1000 + ii;
+    const char* path = "/tmp/TopSparseMemory_image.bin";
+    FILE* file = fopen(path, "wb");
+    fwrite(&words[0], sizeof(uint32_t), words.size(), file);
+    fclose(file);
+    std::shared_ptr<MemoryImage> image( new MemoryImage(path, ImageRaw, 8 * PAGEBYTES) );
+    remove(path);
+    sparseMemory->loadImage(image);
+    sc_dt::uint64 first = 8 * sparseMemory->PAGESIZE;
+    const uint32_t* adopted = sparseMemory->readMemoryPage(first);
+    const uint32_t* tail = sparseMemory->readMemoryPage(first + 2 * sparseMemory->PAGESIZE);
+    if ( !image->contains(adopted) || adopted[5] != 0x1005 || sparseMemory->readMemoryPage(first + sparseMemory->PAGESIZE)[0] != 0x1400 ) {
+      SC_REPORT_ERROR(unittestName, "Expected the whole pages of the image to be adopted from the file." );
+    }
+    if ( image->contains(tail) || tail[2] != 0x1802 || tail[3] != 1 || tail[4] != 0 ) {
+      SC_REPORT_ERROR(unittestName, "Expected the rest of the image copied into a page of the pattern." );
+    }
+    uint32_t* writable = sparseMemory->fetchMemoryPage(first);
+    writable[5] = 7;
+    if ( writable != adopted || sparseMemory->readMemoryPage(first)[5] != 7 ) {
+      SC_REPORT_ERROR(unittestName, "Expected an adopted page to be written in place." );
+    }
+
+    // Two PT_LOAD segments of one ELF file over the same page: the second adopts it again, over the first's copy.
+    unittestName = "TopSparseMemory loadImage of overlapping segments";
+    std::vector<unsigned char> elf( 2 * PAGEBYTES );
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ? ELFDATA2LSB : ELFDATA2MSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type = ET_EXEC;
+    header.e_phoff = sizeof(header);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = 2;
+    memcpy(&elf[0], &header, sizeof(header));
+    for( int ii = 0; ii < 2; ii++) {
+      Elf64_Phdr program;
+      memset(&program, 0, sizeof(program));
+      program.p_type = PT_LOAD;
+      program.p_offset = PAGEBYTES;
+      program.p_paddr = 16 * PAGEBYTES;
+      program.p_filesz = program.p_memsz = PAGEBYTES;
+      memcpy(&elf[sizeof(header) + ii * sizeof(program)], &program, sizeof(program));
+    }
+    for( size_t ii = 0; ii < (size_t)sparseMemory->PAGESIZE; ii++) reinterpret_cast<uint32_t*>(&elf[PAGEBYTES])[ii] = 0x2000 + ii;
+    path = "/tmp/TopSparseMemory_image.elf";
+    file = fopen(path, "wb");
+    fwrite(&elf[0], 1, elf.size(), file);
+    fclose(file);
+    std::shared_ptr<MemoryImage> elfImage( new MemoryImage(path, detectImageFormat(path)) );
+    remove(path);
+    sparseMemory->loadImage(elfImage);    // must not free the page the first segment adopted
+    const uint32_t* twice = sparseMemory->readMemoryPage(16 * sparseMemory->PAGESIZE);
+    if ( elfImage->getSegments().size() != 2 || !elfImage->contains(twice) || twice[3] != 0x2003 || sparseMemory->ownsPage(twice) ) {
+      SC_REPORT_ERROR(unittestName, "Expected the page adopted by both segments to stay the image's." );
+    }
   }
 };
 
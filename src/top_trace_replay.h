@@ -0,0 +1,143 @@
+#ifndef TopTraceReplay_H
+#define TopTraceReplay_H
+
+// Top of a SystemC hierarchy that simulates one cache configuration on one workload: an InitiatorTrace driving a
+// RealCache in front of a SparseMemory, or of a MappedMemory of the size given by -m. The RealCache and the
+// initiator dump their statistics at end_of_simulation.
+// This is what each point of a sweep runs (see cache_store/SweepRunner.h and cache_store/sweep.cpp); sc_main hands
+// its command line to runTraceReplay when it has one, and runs the unit tests of Top when it has none.
+//
+// usage: tlm2freesampler [options] trace     (see cache_store/TraceReader.h for the formats)
+//        tlm2freesampler [options] -n N      (N random accesses, as in cachesim -n)
+//  -c size     cache size in bytes, k/m/g suffixes allowed (default 32k)
+//  -l size     line size in bytes (default 64)
+//  -w ways     associativity (default 8)
+//  -r policy   lru, plru, fifo or random (default lru)
+//  -P type     prefetcher: none, nextline, stride or stream (default none)
+//  -M entries  MSHRs of the cache (default 0: none modelled)
+//  -f format   bin or text (default: bin for *.bin, otherwise text)
+//  -p size     footprint of the -n accesses (default 1m)
+//  -m size     memory size: a MappedMemory of that many bytes, e.g. 16g (default: SparseMemory's MAXSIZEMEM words)
+//  -L image    load a raw, Intel HEX or ELF image into memory first (see cache_store/MemoryImage.h), raw at 0
+// Addresses are folded into the memory.
+
+#include <string>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include "systemc"
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "initiator_trace.h"
+#include "sparse_memory.h"
+#include "mapped_memory.h"
+#include "real_cache.h"
+#include "cache_store/CacheOptions.h"
+
+struct TopTraceReplayConfig {
+  uint64_t            cacheSize;
+  uint64_t            lineSize;
+  uint64_t            numWays;
+  ReplacementPolicy_t policy;
+  Prefetcher_t        prefetcher;
+  uint64_t            numMSHRs;
+  std::string         tracePath;
+  std::string         format;
+  uint64_t            numRandom;
+  uint64_t            footprint;
+  uint64_t            memorySize;   // 0: SparseMemory
+  std::string         imagePath;
+
+  TopTraceReplayConfig()
+  : cacheSize(32 << 10), lineSize(64), numWays(8), policy(ReplLRU), prefetcher(PrefetchNone), numMSHRs(0)
+  , numRandom(0), footprint(1 << 20), memorySize(0)
+  {}
+};
+
+struct TopTraceReplay : sc_module {
+  InitiatorTrace  *initiatorTrace;
+  RealCache       *realCache;
+  SparseMemory    *sparseMemory;
+  MappedMemory    *mappedMemory;
+
+  TopTraceReplay(const sc_module_name& name, const TopTraceReplayConfig& config)
+  : sc_module(name)
+  , sparseMemory(NULL)
+  , mappedMemory(NULL)
+  {
+    uint64_t memorySize = config.memorySize ? config.memorySize : SparseMemory::MAXSIZEMEM * sizeof(uint32_t);
+    if ( config.tracePath.empty() ) {
+      initiatorTrace = new InitiatorTrace("InitiatorTrace", memorySize, config.numRandom, config.footprint, config.lineSize);
+    } else {
+      TraceFormat_t traceFormat = config.format.empty() ? traceFormatFromPath(config.tracePath)
+                                : config.format == "bin" ? TraceBinary
+                                : config.format == "text" ? TraceText
+                                : throw std::runtime_error("unknown trace format " + config.format);
+      initiatorTrace = new InitiatorTrace("InitiatorTrace", memorySize, config.tracePath, traceFormat);
+    }
+    realCache    = new RealCache   ("RealCache", memorySize, config.cacheSize, config.lineSize, config.numWays, config.policy);
+    if ( config.prefetcher != PrefetchNone ) realCache->setPrefetcher( config.prefetcher );
+    if ( config.numMSHRs > 0 ) realCache->setMSHRs( config.numMSHRs );
+
+    initiatorTrace->socket.bind( realCache->target_socket );
+    if ( config.memorySize ) {
+      mappedMemory = new MappedMemory("MappedMemory", memorySize);
+      realCache->initiator_socket.bind( mappedMemory->socket );
+    } else {
+      sparseMemory = new SparseMemory("SparseMemory");
+      realCache->initiator_socket.bind( sparseMemory->socket );
+    }
+    if ( !config.imagePath.empty() ) {
+      std::shared_ptr<MemoryImage> image( new MemoryImage(config.imagePath, detectImageFormat(config.imagePath)) );
+      if ( mappedMemory ) mappedMemory->loadImage( *image );
+      else                sparseMemory->loadImage( image );
+    }
+  }
+};
+
+inline int runTraceReplay(int argc, char* argv[])
+{
+  const char* usage = "usage: tlm2freesampler [-c size] [-l size] [-w ways] [-r lru|plru|fifo|random] [-P none|nextline|stride|stream] [-M entries] [-m size] [-L image] [-f bin|text] trace\n"
+                      "       tlm2freesampler [-c size] [-l size] [-w ways] [-r lru|plru|fifo|random] [-P none|nextline|stride|stream] [-M entries] [-m size] [-L image] [-p size] -n accesses";
+  TopTraceReplayConfig config;
+  try {
+    for( int ii = 1; ii < argc; ii++) {
+      std::string arg = argv[ii];
+      if ( arg.size() != 2 || arg[0] != '-' ) {
+        if ( !config.tracePath.empty() ) throw std::runtime_error(usage);
+        config.tracePath = arg;
+        continue;
+      }
+      if ( ii + 1 >= argc ) throw std::runtime_error(usage);
+      const char* value = argv[++ii];
+      switch( arg[1] ) {
+        case 'c': config.cacheSize  = parseSize(value); break;
+        case 'l': config.lineSize   = parseSize(value); break;
+        case 'w': config.numWays    = parseSize(value); break;
+        case 'r': config.policy     = parsePolicy(value); break;
+        case 'P': config.prefetcher = parsePrefetcher(value); break;
+        case 'M': config.numMSHRs   = parseSize(value); break;
+        case 'f': config.format     = value; break;
+        case 'n': config.numRandom  = parseSize(value); break;
+        case 'p': config.footprint  = parseSize(value); break;
+        case 'm': config.memorySize = parseSize(value); break;
+        case 'L': config.imagePath  = value; break;
+        default:  throw std::runtime_error(usage);
+      }
+    }
+    if ( config.tracePath.empty() == (config.numRandom == 0) ) throw std::runtime_error(usage);
+
+    TopTraceReplay top("top", config);
+    sc_start();
+    sc_stop();
+  }
+  catch( const std::exception& e ) {
+    cerr << "tlm2freesampler: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+#endif